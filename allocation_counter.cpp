@@ -0,0 +1,32 @@
+#ifndef ALLOCATION_COUNTER_CPP
+#define ALLOCATION_COUNTER_CPP
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Replaces the global operator new to count every heap allocation in the
+// process, take the difference around a stage. For the benchmarks and the
+// headless tool, include it from one translation unit only.
+std::atomic<size_t> allocations{0};
+
+// none of them inlined, so the compiler does not pair the malloc of one
+// with the free of another
+__attribute__((noinline)) void *operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void *p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void *p) noexcept {
+  std::free(p);
+}
+
+// what sized deallocation calls, without it -Wsized-deallocation warns
+__attribute__((noinline)) void operator delete(void *p, size_t) noexcept {
+  std::free(p);
+}
+
+#endif
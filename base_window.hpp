@@ -15,6 +15,12 @@
 #define BUFFER_OFFSET(i) ((char *)NULL + (i))
 
 #include <functional>
+#include <memory>
+#include <vector>
+
+#include "frame_scheduler.cpp"
+#include "glyph_atlas.cpp"
+#include "raster.cpp"
 
 GLFWwindow *init_window() {
   GLFWwindow *window;
@@ -31,6 +37,11 @@ GLFWwindow *init_window() {
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 2);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE); // 3.2+ only
   glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // Required on Mac
+#else
+  // GL 3.0 + GLSL 130
+  const char *glsl_version = "#version 130";
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
 #endif
 
   /* Create a windowed mode window and its OpenGL context */
@@ -58,10 +69,159 @@ GLFWwindow *init_window() {
   return window;
 }
 
-void run_until_close(GLFWwindow *window,
-                     std::function<void(GLFWwindow *)> pass) {
+// Sleeps in glfwWaitEvents while nothing asked for a frame. Every event
+// that wakes it up (mouse, keys, resizes) counts as input.
+struct GlfwFrameScheduler : FrameScheduler {
+  FrameTime now() override { return std::chrono::steady_clock::now(); }
+
+  uint32_t wait(const FrameTime *deadline) override {
+    if (deadline == nullptr) {
+      glfwWaitEvents();
+    } else {
+      double seconds =
+          std::chrono::duration<double>(*deadline - this->now()).count();
+      if (seconds <= 0) {
+        glfwPollEvents();
+        return 0;
+      }
+      glfwWaitEventsTimeout(seconds);
+      if (this->now() >= *deadline) {
+        return 0;
+      }
+    }
+    std::lock_guard<std::mutex> lock(this->mutex);
+    // woken up by request_frame, not by the user
+    return this->pending != 0 || this->closing ? 0 : FRAME_INPUT;
+  }
+
+  void wake() override { glfwPostEmptyEvent(); }
+  void poll() override { glfwPollEvents(); }
+};
+
+// One texture per glyph atlas page. The pages only hold coverage, they go
+// up as white with coverage as alpha like ImGui's own font texture.
+struct AtlasTextures {
+  std::vector<GLuint> textures;
+  // scratch, kept between frames
+  std::vector<AtlasUpload> uploads;
+  std::vector<uint32_t> rgba;
+
+  ImTextureID texture(int page) {
+    while (this->textures.size() <= static_cast<size_t>(page)) {
+      GLuint texture;
+      glGenTextures(1, &texture);
+      glBindTexture(GL_TEXTURE_2D, texture);
+      // glyphs are drawn at their size on whole pixels
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, ATLAS_PAGE_SIZE,
+                   ATLAS_PAGE_SIZE, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+      this->textures.push_back(texture);
+    }
+    return (ImTextureID)(intptr_t)this->textures[page];
+  }
+
+  // sends what changed in `atlas` since the last call
+  void upload(GlyphAtlas &atlas) {
+    atlas.take_uploads(this->uploads);
+    for (const AtlasUpload &upload : this->uploads) {
+      this->texture(upload.page);
+      const AtlasPage &page = *atlas.pages[upload.page];
+      const PixelRect &r = upload.rect;
+      this->rgba.resize(size_t(r.width) * r.height);
+      for (int y = 0; y < r.height; y++) {
+        const unsigned char *src =
+            &page.pixels[size_t(r.y + y) * page.size + r.x];
+        uint32_t *dst = &this->rgba[size_t(y) * r.width];
+        for (int x = 0; x < r.width; x++) {
+          dst[x] = uint32_t(src[x]) << 24 | 0xffffff;
+        }
+      }
+      glBindTexture(GL_TEXTURE_2D, this->textures[upload.page]);
+      glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+      glTexSubImage2D(GL_TEXTURE_2D, 0, r.x, r.y, r.width, r.height, GL_RGBA,
+                      GL_UNSIGNED_BYTE, this->rgba.data());
+    }
+  }
+};
+
+// A framebuffer composited on the CPU, put on screen as one texture that
+// covers the display.
+struct FramebufferTexture {
+  GLuint texture = 0;
+  int width = 0, height = 0;
+  std::unique_ptr<ImDrawList> draw_list;
+  ImDrawList *lists[1] = {nullptr};
+  ImDrawData draw_data;
+
+  // Draw data showing `fb`, only valid until the next call
+  ImDrawData *frame(const Framebuffer &fb) {
+    if (this->texture == 0) {
+      glGenTextures(1, &this->texture);
+      glBindTexture(GL_TEXTURE_2D, this->texture);
+      // one texel per pixel
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    glBindTexture(GL_TEXTURE_2D, this->texture);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    if (fb.width != this->width || fb.height != this->height) {
+      this->width = fb.width;
+      this->height = fb.height;
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, fb.width, fb.height, 0, GL_RGBA,
+                   GL_UNSIGNED_BYTE, fb.pixels.data());
+    } else {
+      glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, fb.width, fb.height, GL_RGBA,
+                      GL_UNSIGNED_BYTE, fb.pixels.data());
+    }
+
+    if (!this->draw_list) {
+      this->draw_list =
+          std::make_unique<ImDrawList>(ImGui::GetDrawListSharedData());
+      this->lists[0] = this->draw_list.get();
+    }
+    ImDrawList *draw_list = this->draw_list.get();
+    ImVec2 size(static_cast<float>(fb.width), static_cast<float>(fb.height));
+    draw_list->_ResetForNewFrame();
+    draw_list->PushTextureID(ImGui::GetIO().Fonts->TexID);
+    draw_list->PushClipRect(ImVec2(0, 0), size);
+    draw_list->AddImage((ImTextureID)(intptr_t)this->texture, ImVec2(0, 0),
+                        size);
+    draw_list->PopClipRect();
+    draw_list->PopTextureID();
+
+    ImDrawData &data = this->draw_data;
+    data.Valid = true;
+    data.CmdLists = this->lists;
+    data.CmdListsCount = 1;
+    data.TotalVtxCount = draw_list->VtxBuffer.Size;
+    data.TotalIdxCount = draw_list->IdxBuffer.Size;
+    data.DisplayPos = ImVec2(0, 0);
+    data.DisplaySize = size;
+    data.FramebufferScale = ImGui::GetIO().DisplayFramebufferScale;
+    return &data;
+  }
+};
+
+// Renders a frame whenever `scheduler` hands one out. `page`, if set, gives
+// draw data that is rendered under ImGui's own.
+void run_until_close(GLFWwindow *window, FrameScheduler &scheduler,
+                     std::function<void(GLFWwindow *)> pass,
+                     std::function<ImDrawData *()> page = nullptr) {
+  // ImGui needs a couple of frames after input to settle hover and focus
+  const int SETTLE_FRAMES = 2;
+  int settle = 0;
+  scheduler.request_frame(FRAME_CONTENT);
+
   /* Loop until the user closes the window */
   while (!glfwWindowShouldClose(window)) {
+    uint32_t reasons = scheduler.next_frame();
+    if (reasons == 0) {
+      break;
+    }
+    if (glfwWindowShouldClose(window)) {
+      break;
+    }
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // Clear the buffers
 
     ImGui_ImplOpenGL3_NewFrame();
@@ -71,6 +231,9 @@ void run_until_close(GLFWwindow *window,
     // pass(window);
 
     ImGui::Render();
+    if (page) {
+      ImGui_ImplOpenGL3_RenderDrawData(page());
+    }
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
     // Update and Render additional Platform Windows
@@ -86,8 +249,15 @@ void run_until_close(GLFWwindow *window,
 
     /* Swap front and back buffers */
     glfwSwapBuffers(window);
-    /* Poll for and process events */
-    glfwPollEvents();
+
+    if (reasons & FRAME_INPUT) {
+      settle = SETTLE_FRAMES;
+    } else if (settle > 0) {
+      settle--;
+    }
+    if (settle > 0) {
+      scheduler.request_frame(FRAME_ANIMATION);
+    }
   }
 
   ImGui_ImplOpenGL3_Shutdown();
@@ -0,0 +1,118 @@
+// Helpers shared by the benchmarks.
+
+#ifndef BENCH_COMMON_CPP
+#define BENCH_COMMON_CPP
+
+#include <chrono>
+
+#include "allocation_counter.cpp"
+#include "layout.cpp"
+
+StyledNode block_node() {
+  StyledNode node;
+  node.values["display"] = std::string("block");
+  node.values["margin"] = Length{2, Unit::px};
+  node.values["padding"] = Length{1, Unit::px};
+  node.values["border-width"] = Length{1, Unit::px};
+  node.values["height"] = Length{4, Unit::px};
+  return node;
+}
+
+StyledNode balanced_tree(int fanout, int depth) {
+  StyledNode root = block_node();
+  if (depth > 1) {
+    root.values.erase("height");
+    for (int i = 0; i < fanout; i++) {
+      root.children.push_back(balanced_tree(fanout, depth - 1));
+    }
+  }
+  return root;
+}
+
+struct Document {
+  std::vector<std::unique_ptr<TextNode>> texts;
+  StyledNode root;
+};
+
+// paragraphs of text of different lengths, like lines of a log file
+void build_document(Document &doc, int paragraphs) {
+  const char *words[] = {"GET",  "/index.html", "200", "ms", "user",
+                         "cache", "miss",       "ok",  "404", "retry"};
+  doc.root = block_node();
+  doc.root.values.erase("height");
+  for (int i = 0; i < paragraphs; i++) {
+    std::string content;
+    for (int w = 0; w < 20 + i % 30; w++) {
+      content += words[(i + w * 7) % 10];
+      content += " ";
+    }
+    doc.texts.push_back(std::make_unique<TextNode>(content));
+
+    StyledNode text;
+    text.node = doc.texts.back().get();
+    StyledNode paragraph = block_node();
+    paragraph.values.erase("height");
+    paragraph.children.push_back(text);
+    doc.root.children.push_back(paragraph);
+  }
+}
+
+double ms_since(std::chrono::steady_clock::time_point start) {
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+template <typename F> double time_ms(int iterations, F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; i++) {
+    f();
+  }
+  return ms_since(start) / iterations;
+}
+
+bool same_rect(const Rect &a, const Rect &b) {
+  return a.x == b.x && a.y == b.y && a.width == b.width &&
+         a.height == b.height;
+}
+
+bool same_edges(const EdgeSize &a, const EdgeSize &b) {
+  return a.left == b.left && a.right == b.right && a.top == b.top &&
+         a.bottom == b.bottom;
+}
+
+bool same_geometry(const LayoutTree &a, const LayoutTree &b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (BoxId id = 0; id < a.size(); id++) {
+    const Dimensions &da = a[id].dims;
+    const Dimensions &db = b[id].dims;
+    if (!same_rect(da.content, db.content) ||
+        !same_edges(da.padding, db.padding) ||
+        !same_edges(da.border, db.border) ||
+        !same_edges(da.margin, db.margin)) {
+      std::cout << "box " << id << " differs: " << da.content << " vs "
+                << db.content << std::endl;
+      return false;
+    }
+    const auto &fa = a[id].fragments;
+    const auto &fb = b[id].fragments;
+    if (fa.size() != fb.size()) {
+      std::cout << "box " << id << " has different line fragments"
+                << std::endl;
+      return false;
+    }
+    for (size_t f = 0; f < fa.size(); f++) {
+      if (!same_rect(fa[f].rect, fb[f].rect) || fa[f].start != fb[f].start ||
+          fa[f].text != fb[f].text) {
+        std::cout << "box " << id << " fragment " << f
+                  << " differs: " << fa[f].rect << " vs " << fb[f].rect
+                  << std::endl;
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+#endif
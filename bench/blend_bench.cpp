@@ -0,0 +1,143 @@
+// Premultiplied source-over blending: every span kernel checked bit for bit
+// against blend_pixel on random pixels, at every length up to a few SIMD
+// steps so the tails are covered too, and then their throughput in
+// megapixels per second, compositing a layer over a screen and filling
+// translucent rects.
+//
+//   make bench && ./bench/blend_bench.exe
+
+#include <random>
+
+#include "bench_common.cpp"
+#include "raster.cpp"
+
+struct Kernel {
+  const char *name;
+  BlendSpan blend;
+  BlendColorSpan blend_color;
+};
+
+// premultiplied pixels, a third of them opaque and a third empty in runs,
+// like a layer with text on a transparent background
+std::vector<uint32_t> random_pixels(size_t count, uint32_t seed) {
+  std::mt19937 random(seed);
+  std::vector<uint32_t> pixels(count);
+  for (size_t i = 0; i < count; i++) {
+    uint32_t a = random() & 0xff;
+    switch (i / 16 % 3) {
+    case 0:
+      a = 255;
+      break;
+    case 1:
+      a = random() % 4 == 0 ? a : 0;
+      break;
+    }
+    pixels[i] = premultiply(a << 24 | (random() & 0xffffff));
+  }
+  return pixels;
+}
+
+bool check(const Kernel &kernel) {
+  for (int count = 0; count <= 70; count++) {
+    std::vector<uint32_t> src = random_pixels(count, count);
+    std::vector<uint32_t> dst = random_pixels(count, count + 1000);
+    std::vector<uint32_t> expected = dst, out = dst;
+    blend_span_scalar(expected.data(), src.data(), count);
+    kernel.blend(out.data(), src.data(), count);
+    if (out != expected) {
+      std::cout << "MISMATCH: " << kernel.name << " blend_span, " << count
+                << " pixels" << std::endl;
+      return false;
+    }
+    uint32_t color = src.empty() ? 0x80402010 : src[count / 2];
+    expected = dst;
+    out = dst;
+    blend_color_span_scalar(expected.data(), count, color);
+    kernel.blend_color(out.data(), count, color);
+    if (out != expected) {
+      std::cout << "MISMATCH: " << kernel.name << " blend_color_span, "
+                << count << " pixels" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// the rounding every kernel relies on, for all products of two channels
+bool check_div255() {
+  for (uint32_t x = 0; x <= 255 * 255; x++) {
+    if (div255(x) != (x * 2 + 255) / 510) {
+      std::cout << "MISMATCH: div255(" << x << ")" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+int main() {
+  std::vector<Kernel> kernels = {
+      {"scalar", blend_span_scalar, blend_color_span_scalar},
+      {"sse2", blend_span_sse2, blend_color_span_sse2}};
+#if defined(RASTER_AVX_DISPATCH)
+  if (__builtin_cpu_supports("avx2")) {
+    kernels.push_back({"avx2", blend_span_avx2, blend_color_span_avx2});
+  }
+#endif
+
+  bool ok = check_div255();
+  for (const Kernel &kernel : kernels) {
+    ok = check(kernel) && ok;
+  }
+
+  const int WIDTH = 1920, HEIGHT = 1080;
+  const int FRAMES = 20;
+  double pixels = double(WIDTH) * HEIGHT * FRAMES;
+  std::vector<uint32_t> layer = random_pixels(size_t(WIDTH) * HEIGHT, 1);
+  std::vector<uint32_t> translucent(size_t(WIDTH) * HEIGHT);
+  for (size_t i = 0; i < translucent.size(); i++) {
+    translucent[i] = premultiply(0x80000000 | (layer[i] & 0xffffff));
+  }
+  for (const Kernel &kernel : kernels) {
+    Framebuffer fb(WIDTH, HEIGHT);
+    fb.clear(0xffffffff);
+    double layer_ms = time_ms(1, [&] {
+      for (int frame = 0; frame < FRAMES; frame++) {
+        for (int y = 0; y < HEIGHT; y++) {
+          kernel.blend(fb.row(y), layer.data() + size_t(y) * WIDTH, WIDTH);
+        }
+      }
+    });
+    double translucent_ms = time_ms(1, [&] {
+      for (int frame = 0; frame < FRAMES; frame++) {
+        for (int y = 0; y < HEIGHT; y++) {
+          kernel.blend(fb.row(y), translucent.data() + size_t(y) * WIDTH,
+                       WIDTH);
+        }
+      }
+    });
+    double fill_ms = time_ms(1, [&] {
+      for (int frame = 0; frame < FRAMES; frame++) {
+        for (int y = 0; y < HEIGHT; y++) {
+          kernel.blend_color(fb.row(y), WIDTH, 0x80402010);
+        }
+      }
+    });
+    std::cout << kernel.name << ": layer " << pixels / (layer_ms * 1000)
+              << " MP/s, all translucent "
+              << pixels / (translucent_ms * 1000) << " MP/s, color fill "
+              << pixels / (fill_ms * 1000) << " MP/s" << std::endl;
+  }
+
+  // the rasterizer's translucent rects land where blend_pixel says
+  Framebuffer fb(64, 64);
+  fb.clear(0xff336699);
+  PixelRect all{0, 0, fb.width, fb.height};
+  fill_rect(fb, PixelRect{3, 5, 50, 40}, all, 0x80ffffff);
+  uint32_t expected = blend_pixel(premultiply(0x80ffffff), 0xff336699);
+  if (fb.row(5)[3] != expected || fb.row(44)[52] != expected ||
+      fb.row(4)[3] != 0xff336699) {
+    std::cout << "MISMATCH: translucent fill_rect" << std::endl;
+    ok = false;
+  }
+  return ok ? 0 : 1;
+}
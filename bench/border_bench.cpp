@@ -0,0 +1,320 @@
+// A page of nothing but bordered boxes, painted with one BORDER command per
+// box against the four SOLID_COLOR rects borders used to take: commands,
+// bytes and raster time, for the page and for the borders on their own,
+// and the two have to come out the same pixels. Square borders with a
+// color per side, from the style, have to match the anti-aliased path
+// they skip. Then
+// rounded corners, whose anti-aliased coverage has to add up to the area
+// of the shape.
+//
+//   make bench && ./bench/border_bench.exe
+
+#include <cmath>
+
+#include "bench_common.cpp"
+#include "css_parser.cpp"
+#include "html_parser.cpp"
+#include "painter.cpp"
+#include "raster.cpp"
+
+const PackedColor WHITE = 0xffffffff;
+
+// the list with every border split into its sides, like render_borders
+// used to paint them, and without backgrounds if `backgrounds` is false
+DisplayList split_borders(const DisplayList &list, bool backgrounds = true) {
+  DisplayList out;
+  for (const CommandHeader &command : list) {
+    switch (command.op()) {
+    case DisplayOp::SOLID_COLOR: {
+      if (!backgrounds) {
+        break;
+      }
+      const SolidColorCommand &solid = command.as<SolidColorCommand>();
+      out.push_solid_color(solid.color, solid.box.rect());
+    } break;
+    case DisplayOp::BORDER: {
+      const BorderCommand &border = command.as<BorderCommand>();
+      Rect b = border.box.rect();
+      LayoutUnit top = LayoutUnit::from_raw(border.widths[SIDE_TOP]);
+      LayoutUnit right = LayoutUnit::from_raw(border.widths[SIDE_RIGHT]);
+      LayoutUnit bottom = LayoutUnit::from_raw(border.widths[SIDE_BOTTOM]);
+      LayoutUnit left = LayoutUnit::from_raw(border.widths[SIDE_LEFT]);
+      out.push_solid_color(border.colors[SIDE_LEFT],
+                           Rect{b.x, b.y, left, b.height});
+      out.push_solid_color(border.colors[SIDE_RIGHT],
+                           Rect{b.x + b.width - right, b.y, right, b.height});
+      out.push_solid_color(border.colors[SIDE_TOP],
+                           Rect{b.x, b.y, b.width, top});
+      out.push_solid_color(border.colors[SIDE_BOTTOM],
+                           Rect{b.x, b.y + b.height - bottom, b.width,
+                                bottom});
+    } break;
+    default:
+      break;
+    }
+  }
+  out.build_index();
+  return out;
+}
+
+// only the BORDER commands of `list`
+DisplayList only_borders(const DisplayList &list) {
+  DisplayList out;
+  size_t i = 0;
+  for (const CommandHeader &command : list) {
+    if (command.op() == DisplayOp::BORDER) {
+      out.push_command(command, list.item_boxes[i]);
+    }
+    i++;
+  }
+  out.build_index();
+  return out;
+}
+
+// a screen at a time down the whole page, not counting the clears
+double raster_page(const DisplayList &list, Framebuffer &fb, int height) {
+  double ms = 0;
+  for (int y = 0; y < height; y += fb.height) {
+    fb.clear(WHITE);
+    auto start = std::chrono::steady_clock::now();
+    rasterize(list, fb, 0, y);
+    ms += ms_since(start);
+  }
+  return ms;
+}
+
+// Side colors come from border-{top,right,bottom,left}-color, or from
+// border-color for the sides without one, and reach the pixels.
+bool check_style_colors() {
+  Node *dom = parse_html("<div></div>");
+  StyleSheet sheet = parse_css(
+      "div { display: block; height: 40px; border-width: 4px; "
+      "border-color: #00ff00; border-top-color: #ff0000; "
+      "border-left-color: #0000ff; }");
+  StyledNode styled = style_tree(dom, sheet);
+  LayoutTree tree = build_layout_tree(styled);
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(200);
+  tree.layout(viewport);
+  DisplayList list = build_display_list(tree);
+
+  PackedColor red = pack_color(Color{255, 0, 0, 255});
+  PackedColor green = pack_color(Color{0, 255, 0, 255});
+  PackedColor blue = pack_color(Color{0, 0, 255, 255});
+  PackedColor expected[4] = {red, green, green, blue};
+  bool ok = false;
+  for (const CommandHeader &command : list) {
+    if (command.op() == DisplayOp::BORDER) {
+      const BorderCommand &border = command.as<BorderCommand>();
+      ok = std::equal(expected, expected + 4, border.colors);
+      // the middle of every side, top, right, bottom, left
+      PixelRect box = border.box.rect().snapped();
+      int xs[4] = {box.x + box.width / 2, box.x + box.width - 2,
+                   box.x + box.width / 2, box.x + 1};
+      int ys[4] = {box.y + 1, box.y + box.height / 2,
+                   box.y + box.height - 2, box.y + box.height / 2};
+      Framebuffer fb(200, 100);
+      fb.clear(WHITE);
+      rasterize(list, fb);
+      for (int side = 0; side < 4; side++) {
+        ok = ok && fb.row(ys[side])[xs[side]] == premultiply(expected[side]);
+      }
+    }
+  }
+  // TODO the DOM leaks, see Node
+  if (!ok) {
+    std::cout << "MISMATCH: border side colors from the style" << std::endl;
+  }
+  return ok;
+}
+
+// Square borders with a different color on every side, some translucent
+// and some wider than the box, painted by draw_border against
+// fill_rounded, which is what it paints them with otherwise.
+bool check_square_colors() {
+  PackedColor colors[4] = {0xff0000ff, 0x8000ff00, 0xffff0000, 0xff808080};
+  int sizes[][6] = {
+      // x, y, width, height, then the top and bottom and left and right
+      // border widths
+      {10, 10, 100, 60, 3, 7},  {50, 40, 9, 120, 1, 2},
+      {120, 5, 70, 70, 12, 4},  {-20, 150, 80, 40, 5, 5},
+      {150, 150, 60, 60, 0, 9}, {100, 100, 30, 30, 8, 8}};
+  bool ok = true;
+  for (const int *size : sizes) {
+    LayoutUnit widths[4] = {
+        LayoutUnit::from_px(size[4]), LayoutUnit::from_px(size[5]),
+        LayoutUnit::from_px(size[4]), LayoutUnit::from_px(size[5])};
+    LayoutUnit radii[4];
+    DisplayList list;
+    list.push_border(
+        Rect{LayoutUnit::from_px(size[0]), LayoutUnit::from_px(size[1]),
+             LayoutUnit::from_px(size[2]), LayoutUnit::from_px(size[3])},
+        widths, colors, radii);
+    list.build_index();
+
+    Framebuffer actual(200, 200), expected(200, 200);
+    actual.clear(WHITE);
+    rasterize(list, actual);
+
+    RoundedBox outer, inner;
+    outer.left = float(size[0]);
+    outer.top = float(size[1]);
+    outer.right = outer.left + size[2];
+    outer.bottom = outer.top + size[3];
+    inner.left = outer.left + size[5];
+    inner.top = outer.top + size[4];
+    inner.right = outer.right - size[5];
+    inner.bottom = outer.bottom - size[4];
+    float float_widths[4] = {float(size[4]), float(size[5]), float(size[4]),
+                             float(size[5])};
+    expected.clear(WHITE);
+    fill_rounded(expected, outer, inner, float_widths, colors,
+                 PixelRect{0, 0, 200, 200});
+    size_t different = count_different_pixels(expected, actual);
+    if (different != 0) {
+      std::cout << "MISMATCH: " << different << " pixels of the square "
+                << size[2] << "x" << size[3] << " border differ" << std::endl;
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+void round_corners(StyledNode &node) {
+  node.values["border-radius"] = Length{3, Unit::px};
+  for (StyledNode &child : node.children) {
+    round_corners(child);
+  }
+}
+
+// how much of `fb` is covered by opaque black drawn on transparent, in
+// pixels
+double covered_area(const Framebuffer &fb) {
+  double area = 0;
+  for (uint32_t pixel : fb.pixels) {
+    area += (pixel >> 24) / 255.0;
+  }
+  return area;
+}
+
+bool check_rounded(const char *name, const DisplayList &list,
+                   double expected) {
+  Framebuffer fb(200, 200);
+  fb.clear(0);
+  rasterize(list, fb);
+  double area = covered_area(fb);
+  // a coverage step per pixel along the curves is as close as it gets
+  bool ok = std::abs(area - expected) < 4;
+  std::cout << "  " << name << ": " << area << " pixels covered, " << expected
+            << " expected" << std::endl;
+  if (!ok) {
+    std::cout << "MISMATCH: " << name << " coverage" << std::endl;
+  }
+  return ok;
+}
+
+int main() {
+  StyledNode root = balanced_tree(4, 7);
+  LayoutTree tree = build_layout_tree(root);
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(1280);
+  tree.layout(viewport);
+  int height = tree[tree.root].dims.margin_box().height.round();
+
+  DisplayList list = build_display_list(tree);
+  DisplayList sides = split_borders(list);
+  std::cout << tree.size() << " boxes" << std::endl;
+  std::cout << "  border commands: " << list.size() << " commands, "
+            << list.size_in_bytes() << " bytes" << std::endl;
+  std::cout << "  four rects per border: " << sides.size() << " commands, "
+            << sides.size_in_bytes() << " bytes" << std::endl;
+
+  Framebuffer fb(1280, 720), expected(1280, 720);
+  // warm up, then the best of a few
+  double border_ms = 1e9, sides_ms = 1e9;
+  for (int i = 0; i < 3; i++) {
+    border_ms = std::min(border_ms, raster_page(list, fb, height));
+    sides_ms = std::min(sides_ms, raster_page(sides, expected, height));
+  }
+  std::cout << "  raster " << height << "px: border commands " << border_ms
+            << "ms, four rects per border " << sides_ms << "ms" << std::endl;
+
+  DisplayList borders = only_borders(list);
+  DisplayList border_sides = split_borders(borders, false);
+  double only_ms = 1e9, only_sides_ms = 1e9;
+  for (int i = 0; i < 3; i++) {
+    only_ms = std::min(only_ms, raster_page(borders, fb, height));
+    only_sides_ms =
+        std::min(only_sides_ms, raster_page(border_sides, expected, height));
+  }
+  std::cout << "  borders alone: border commands " << only_ms
+            << "ms, four rects per border " << only_sides_ms << "ms"
+            << std::endl;
+
+  // the same boxes with round corners go through the anti-aliased path
+  StyledNode rounded_root = root;
+  round_corners(rounded_root);
+  LayoutTree rounded_tree = build_layout_tree(rounded_root);
+  rounded_tree.layout(viewport);
+  DisplayList rounded_list = build_display_list(rounded_tree);
+  double rounded_ms = 1e9;
+  for (int i = 0; i < 3; i++) {
+    rounded_ms = std::min(rounded_ms, raster_page(rounded_list, fb, height));
+  }
+  std::cout << "  with 3px round corners: " << rounded_ms << "ms"
+            << std::endl;
+
+  bool ok = true;
+  for (int y = 0; y < height; y += fb.height) {
+    fb.clear(WHITE);
+    rasterize(list, fb, 0, y);
+    expected.clear(WHITE);
+    rasterize(sides, expected, 0, y);
+    size_t different = count_different_pixels(expected, fb);
+    if (different != 0) {
+      std::cout << "MISMATCH: " << different << " pixels at " << y
+                << " differ from the four rects" << std::endl;
+      ok = false;
+      break;
+    }
+  }
+
+  ok = check_square_colors() && ok;
+  ok = check_style_colors() && ok;
+
+  // a rect with round corners and a ring around a circle, both black on
+  // transparent
+  const double PI = 3.14159265358979;
+  LayoutUnit radii[4];
+  for (LayoutUnit &r : radii) {
+    r = LayoutUnit::from_px(30);
+  }
+  DisplayList rounded;
+  rounded.push_rounded_rect(
+      0xff000000,
+      Rect{LayoutUnit::from_px(20), LayoutUnit::from_px(20),
+           LayoutUnit::from_px(160), LayoutUnit::from_px(100)},
+      radii);
+  rounded.build_index();
+  ok = check_rounded("rounded rect", rounded,
+                     160 * 100 - (4 - PI) * 30 * 30) &&
+       ok;
+
+  for (LayoutUnit &r : radii) {
+    r = LayoutUnit::from_px(80);
+  }
+  LayoutUnit widths[4], width = LayoutUnit::from_px(10);
+  PackedColor colors[4];
+  for (int i = 0; i < 4; i++) {
+    widths[i] = width;
+    colors[i] = 0xff000000;
+  }
+  DisplayList ring;
+  ring.push_border(Rect{LayoutUnit::from_px(20), LayoutUnit::from_px(20),
+                        LayoutUnit::from_px(160), LayoutUnit::from_px(160)},
+                   widths, colors, radii);
+  ring.build_index();
+  ok = check_rounded("ring", ring, PI * (80 * 80 - 70 * 70)) && ok;
+
+  return ok ? 0 : 1;
+}
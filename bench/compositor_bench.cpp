@@ -0,0 +1,306 @@
+// Scrolling a text page with a fixed header and a scroll container in it,
+// through the compositor: the page, the container and the header each get
+// a layer, and a scroll only moves layers around. Against that, what a
+// frame costs when it is rasterized from the display list, which scrolling
+// through the compositor has to beat. A word that changes only repaints
+// the damage. Every frame is checked against the layers rasterized straight
+// to the screen, and the paint order of the layers against a page with one
+// display list. The geometry the wheel finds scroll containers with has to
+// follow the scroll offsets.
+//
+//   make bench && ./bench/compositor_bench.exe
+
+#include "bench_common.cpp"
+#include "compositor.cpp"
+
+const PackedColor WHITE = 0xffffffff;
+
+struct Page {
+  Document doc;
+  Document inner;
+  LayoutTree tree;
+  Compositor compositor;
+  Framebuffer fb{1280, 720};
+  Framebuffer expected{1280, 720};
+  PixelRect viewport{0, 0, 1280, 720};
+  bool ok = true;
+};
+
+// a long page, a header that stays on screen and a box that scrolls
+// paragraphs of its own
+void build_page(Page &page) {
+  build_document(page.doc, 2000);
+  build_document(page.inner, 200);
+
+  StyledNode header = block_node();
+  header.values["position"] = std::string("fixed");
+  header.values["height"] = Length{40, Unit::px};
+  page.doc.root.children.insert(page.doc.root.children.begin(), header);
+
+  StyledNode scroller = page.inner.root;
+  scroller.values["overflow"] = std::string("scroll");
+  scroller.values["height"] = Length{300, Unit::px};
+  page.doc.root.children.insert(page.doc.root.children.begin() + 4,
+                                scroller);
+}
+
+// A scroll container whose content fits, and a box after it pulled up over
+// it. Not scrolled, the layers have to look like the one display list.
+bool check_paint_order() {
+  Document doc, inner;
+  build_document(doc, 3);
+  build_document(inner, 3);
+  StyledNode scroller = inner.root;
+  scroller.values["overflow"] = std::string("scroll");
+  scroller.values["height"] = Length{200, Unit::px};
+  StyledNode over = block_node();
+  over.values["margin-top"] = Length{-150, Unit::px};
+  over.values["height"] = Length{80, Unit::px};
+  doc.root.children.insert(doc.root.children.begin() + 1, scroller);
+  doc.root.children.insert(doc.root.children.begin() + 2, over);
+
+  LayoutTree tree = build_layout_tree(doc.root);
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(640);
+  tree.layout(viewport);
+  Compositor compositor;
+  compositor.set_layers(build_layers(tree));
+  Framebuffer fb(640, 480), expected(640, 480);
+  compositor.composite(fb, WHITE);
+  expected.clear(WHITE);
+  rasterize(build_display_list(tree), expected);
+  size_t different = count_different_pixels(expected, fb);
+  if (different != 0) {
+    std::cout << "MISMATCH: " << different
+              << " pixels differ from painting one display list" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+// A fixed header, paragraphs, a scroll container and more paragraphs. The
+// wheel has to go to the container only over it, before and after it
+// scrolled, and the geometry has to move with the scroll offsets.
+bool check_geometry() {
+  Document doc, inner;
+  build_document(doc, 30);
+  build_document(inner, 50);
+  StyledNode header = block_node();
+  header.values["position"] = std::string("fixed");
+  header.values["height"] = Length{40, Unit::px};
+  StyledNode scroller = inner.root;
+  scroller.values["overflow"] = std::string("scroll");
+  scroller.values["height"] = Length{200, Unit::px};
+  doc.root.children.insert(doc.root.children.begin() + 3, scroller);
+  doc.root.children.insert(doc.root.children.begin(), header);
+
+  LayoutTree tree = build_layout_tree(doc.root);
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(640);
+  tree.layout(viewport);
+  PixelRect screen{0, 0, 640, 480};
+  Compositor compositor;
+  compositor.set_layers(build_layers(tree));
+  compositor.set_geometry(export_geometry(tree));
+  size_t layer = 0;
+  for (size_t i = 0; i < compositor.layers.size(); i++) {
+    if (compositor.layers[i].kind == LayerKind::SCROLL) {
+      layer = i;
+    }
+  }
+  BoxId box = compositor.layers[layer].box;
+  BoxId fixed = tree[tree.root].first_child;
+  PixelRect clip = tree[box].dims.padding_box().snapped();
+
+  bool ok = layer != 0;
+  int scroll_y = 0;
+  for (int step = 0; step < 2 && ok; step++) {
+    int y = clip.y - scroll_y;
+    ok = compositor.layer_at(clip.x + 10, y + 10) == layer &&
+         compositor.layer_at(clip.x + 10, y + clip.height + 10) == 0 &&
+         compositor.layer_at(clip.x + 10, y - 10) == 0;
+    compositor.scroll_by(0, 0, 60, screen);
+    compositor.scroll_by(layer, 0, 150, screen);
+    scroll_y = compositor.scroll[0].y;
+  }
+
+  // where layout put the boxes, moved like the layers they are in
+  const GeometryTable &geometry = compositor.geometry;
+  for (BoxId id = 0; id < tree.size() && ok; id++) {
+    int y = tree[id].dims.border_box().y.raw;
+    if (id > box && id < box + tree[box].subtree_size) {
+      y -= LayoutUnit::from_px(compositor.scroll[layer].y).raw;
+    } else if (id == fixed) {
+      y += LayoutUnit::from_px(scroll_y).raw;
+    }
+    ok = geometry.y[id] == y;
+  }
+  GeometryTable moved = geometry;
+  compositor.set_geometry(export_geometry(tree));
+  ok = ok && moved.y == compositor.geometry.y;
+  if (!ok) {
+    std::cout << "MISMATCH: the geometry does not follow the scroll offsets"
+              << std::endl;
+  }
+  return ok;
+}
+
+struct Phase {
+  int frames = 0;
+  double ms = 0;
+  size_t painted = 0;
+};
+
+// composites one frame and checks it
+void frame(Page &page, Phase &phase) {
+  size_t painted = page.compositor.stats.painted;
+  phase.ms += time_ms(1, [&] { page.compositor.composite(page.fb, WHITE); });
+  phase.painted += page.compositor.stats.painted - painted;
+  phase.frames++;
+  page.compositor.composite_direct(page.expected, WHITE);
+  size_t different = count_different_pixels(page.expected, page.fb);
+  if (different != 0 && page.ok) {
+    std::cout << "MISMATCH: " << different
+              << " pixels differ from rasterizing the layers directly"
+              << std::endl;
+    page.ok = false;
+  }
+}
+
+// the text node of a paragraph of the page in the middle of the screen,
+// and the box to relayout when it changes
+BoxId text_on_screen(Page &page, TextNode *&text) {
+  int top = page.compositor.scroll[0].y + page.viewport.height / 3;
+  for (BoxId id = 0; id < page.tree.size(); id++) {
+    const LayoutBox &box = page.tree[id];
+    if (box.type == BoxType::b_ANON && !box.fragments.empty() &&
+        box.dims.content.y > LayoutUnit::from_px(top)) {
+      BoxId inline_box = box.fragments[0].box;
+      text = static_cast<TextNode *>(page.tree[inline_box].style->node);
+      return inline_box;
+    }
+  }
+  return NO_BOX;
+}
+
+void report(const char *name, const Phase &phase) {
+  std::cout << "  " << name << ": " << phase.frames << " frames, "
+            << phase.ms / phase.frames << "ms per frame, " << phase.painted
+            << " layers rasterized again" << std::endl;
+}
+
+int main() {
+  Page page;
+  build_page(page);
+  page.tree = build_layout_tree(page.doc.root);
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(page.viewport.width);
+  page.tree.layout(viewport);
+
+  LayerList layers;
+  double layers_ms = time_ms(1, [&] { layers = build_layers(page.tree); });
+  page.compositor.set_layers(std::move(layers));
+  const Compositor &compositor = page.compositor;
+  size_t scroller = 0;
+  for (size_t i = 0; i < compositor.layers.size(); i++) {
+    if (compositor.layers[i].kind == LayerKind::SCROLL) {
+      scroller = i;
+    }
+  }
+  std::cout << compositor.layers.size() << " layers, painted in "
+            << layers_ms << "ms" << std::endl;
+  if (compositor.layers.size() != 4 || scroller == 0 ||
+      compositor.layers.back().continues != 0) {
+    std::cout << "MISMATCH: expected a root, a fixed and a scroll layer "
+                 "and the rest of the root"
+              << std::endl;
+    return 1;
+  }
+  page.ok = check_paint_order() && page.ok;
+  page.ok = check_geometry() && page.ok;
+
+  Phase first;
+  frame(page, first);
+  report("first frame", first);
+  // the header is the first box on the page
+  BoxId header_box = page.tree[page.tree.root].first_child;
+  PixelRect header = page.tree[header_box].dims.border_box().snapped();
+  Framebuffer top = page.fb;
+
+  // within a screen of the first frame the surfaces cover it all
+  Phase root;
+  for (int i = 0; i < 18; i++) {
+    page.compositor.scroll_by(0, 0, 40, page.viewport);
+    frame(page, root);
+  }
+  report("scrolling the page 720px", root);
+
+  Phase inner;
+  for (int i = 0; i < 15; i++) {
+    page.compositor.scroll_by(scroller, 0, 20, page.viewport);
+    frame(page, inner);
+  }
+  report("scrolling the container 300px", inner);
+  if (root.painted != 0 || inner.painted != 0) {
+    std::cout << "MISMATCH: short scrolls should not rasterize anything"
+              << std::endl;
+    page.ok = false;
+  }
+
+  Phase far;
+  for (int i = 0; i < 200; i++) {
+    page.compositor.scroll_by(0, 0, 40, page.viewport);
+    frame(page, far);
+  }
+  report("scrolling the page 8000px", far);
+  for (int y = header.y; y < header.y + header.height; y++) {
+    const uint32_t *row = top.row(y) + header.x;
+    if (!std::equal(row, row + header.width, page.fb.row(y) + header.x)) {
+      std::cout << "MISMATCH: the fixed header moved" << std::endl;
+      page.ok = false;
+      break;
+    }
+  }
+
+  // new lists for the layers, the surfaces only take the damage
+  TextNode *text = nullptr;
+  BoxId changed_box = text_on_screen(page, text);
+  text->content.replace(0, 3, "PUT");
+  page.tree.mark_needs_layout(changed_box);
+  page.tree.layout(viewport);
+  page.compositor.set_layers(build_layers(page.tree));
+  Phase changed;
+  frame(page, changed);
+  report("a word changed", changed);
+  double damaged = page.compositor.stats.damaged_percent;
+  std::cout << "  " << damaged << "% of the screen damaged" << std::endl;
+  if (changed.painted != 0 || damaged <= 0 || damaged >= 100) {
+    std::cout << "MISMATCH: expected the word to damage part of the screen "
+                 "and no layer to be rasterized again"
+              << std::endl;
+    page.ok = false;
+  }
+
+  // what the same frames cost without layers: the screen rasterized from
+  // one display list every time
+  DisplayList list = build_display_list(page.tree);
+  Framebuffer fb(page.viewport.width, page.viewport.height);
+  int y = 0;
+  double raster_ms = time_ms(200, [&] {
+    fb.clear(WHITE);
+    rasterize(list, fb, 0, y += 40);
+  });
+  std::cout << "  rasterizing every frame instead: " << raster_ms
+            << "ms per frame" << std::endl;
+  for (const Phase *phase : {&root, &inner}) {
+    if (phase->ms / phase->frames >= raster_ms) {
+      std::cout << "MISMATCH: scrolling through the compositor is slower "
+                   "than rasterizing every frame"
+                << std::endl;
+      page.ok = false;
+      break;
+    }
+  }
+
+  return page.ok ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+// Styling and building the layout tree for large documents, with the number
+// of heap allocations each stage makes. Both should grow linearly.
+//
+//   make bench && ./bench/construction_bench.exe
+
+#include "bench_common.cpp"
+
+// rows of a few cells with text, about `nodes` DOM nodes in total
+Node *build_dom(int nodes) {
+  std::vector<Node *> rows;
+  for (int n = 1; n < nodes; n += 7) {
+    std::vector<Node *> cells;
+    for (int c = 0; c < 3; c++) {
+      AttributeMap attrs;
+      if (c == 0) {
+        attrs["class"] = "name";
+      }
+      cells.push_back(createElement("span", attrs, {createText("cell")}));
+    }
+    rows.push_back(createElement("div", {{"class", "row"}}, cells));
+  }
+  return createElement("div", {{"id", "root"}}, rows);
+}
+
+struct Stage {
+  double ms;
+  size_t allocations;
+};
+
+template <typename F> Stage measure(F f) {
+  size_t before = allocations;
+  double ms = time_ms(1, f);
+  return Stage{ms, allocations - before};
+}
+
+void report(const char *name, const Stage &stage, size_t nodes) {
+  std::cout << "  " << name << " " << stage.ms << "ms ("
+            << stage.ms * 1e6 / nodes << "ns/node), " << stage.allocations
+            << " allocations (" << double(stage.allocations) / nodes
+            << "/node)" << std::endl;
+}
+
+int main() {
+  StyleSheet sheet = parse_css("div#root { display: block; }\n"
+                               "div.row { display: block; padding: 2px; }\n"
+                               "span.name { display: inline; }\n");
+  for (int nodes : {10000, 100000, 1000000}) {
+    Node *dom = build_dom(nodes);
+
+    StyledNode styled;
+    Stage style = measure([&] { styled = style_tree(dom, sheet); });
+    size_t count = count_styled_nodes(styled);
+    LayoutTree tree;
+    Stage build = measure([&] { tree = build_layout_tree(styled); });
+
+    std::cout << count << " nodes, " << tree.size() << " boxes" << std::endl;
+    report("style_tree", style, count);
+    report("build_layout_tree", build, count);
+    // TODO the DOM leaks, see Node
+  }
+  return 0;
+}
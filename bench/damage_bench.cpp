@@ -0,0 +1,145 @@
+// Damage between consecutive display lists of a text page: nothing
+// changed, one word changed, and a paragraph that grew. Then two boxes that
+// only swap paint order. Repainting just the damage is checked against a
+// full repaint.
+//
+//   make bench && ./bench/damage_bench.exe
+
+#include "bench_common.cpp"
+#include "damage.cpp"
+#include "painter.cpp"
+
+const PackedColor WHITE = 0xffffffff;
+
+struct Frame {
+  Document doc;
+  LayoutTree tree;
+  Dimensions viewport;
+  DisplayList list;
+  Framebuffer fb{1280, 720};
+  PixelRect screen{0, 5000, 1280, 720};
+};
+
+// an anonymous box with text somewhere on screen, and its text node
+BoxId text_on_screen(Frame &frame, TextNode *&text) {
+  for (BoxId id = 0; id < frame.tree.size(); id++) {
+    const LayoutBox &box = frame.tree[id];
+    if (box.type == BoxType::b_ANON && !box.fragments.empty() &&
+        box.dims.content.y > LayoutUnit::from_px(frame.screen.y + 300)) {
+      BoxId inline_box = box.fragments[0].box;
+      text = static_cast<TextNode *>(frame.tree[inline_box].style->node);
+      return inline_box;
+    }
+  }
+  return NO_BOX;
+}
+
+bool next_frame(Frame &frame, const char *name) {
+  double layout_ms = time_ms(1, [&] { frame.tree.layout(frame.viewport); });
+  DisplayList list;
+  double paint_ms = time_ms(1, [&] { list = build_display_list(frame.tree); });
+  Damage damage;
+  double diff_ms =
+      time_ms(1, [&] { damage = diff_display_lists(frame.list, list); });
+  frame.list = std::move(list);
+
+  double repaint_ms = time_ms(1, [&] {
+    repaint_damage(frame.list, frame.fb, frame.screen.x, frame.screen.y,
+                   WHITE, damage);
+  });
+  Framebuffer expected(frame.fb.width, frame.fb.height);
+  double full_ms = time_ms(1, [&] {
+    expected.clear(WHITE);
+    rasterize(frame.list, expected, frame.screen.x, frame.screen.y);
+  });
+
+  std::cout << name << ": " << damaged_percent(damage, frame.screen)
+            << "% of the screen damaged in " << damage.rects.size()
+            << " rects (" << damage.stats.changed << " changed, "
+            << damage.stats.added << " added, " << damage.stats.removed
+            << " removed, " << damage.stats.unchanged << " unchanged)"
+            << std::endl;
+  std::cout << "  layout " << layout_ms << "ms, paint " << paint_ms
+            << "ms, diff " << diff_ms << "ms, repaint " << repaint_ms
+            << "ms (full raster " << full_ms << "ms)" << std::endl;
+
+  size_t different = count_different_pixels(expected, frame.fb);
+  if (different != 0) {
+    std::cout << "MISMATCH after " << name << ": " << different
+              << " pixels differ from a full repaint" << std::endl;
+  }
+  return different == 0;
+}
+
+// Two overlapping boxes and one next to them, the first two swap paint
+// order and nothing else changes.
+bool check_paint_order() {
+  auto rect = [](int x, int y, int size) {
+    return Rect{LayoutUnit::from_px(x), LayoutUnit::from_px(y),
+                LayoutUnit::from_px(size), LayoutUnit::from_px(size)};
+  };
+  PackedColor red = pack_color(Color{200, 0, 0, 255});
+  PackedColor blue = pack_color(Color{0, 0, 200, 255});
+  PackedColor green = pack_color(Color{0, 200, 0, 255});
+  DisplayList before, after;
+  before.begin_box(1);
+  before.push_solid_color(red, rect(100, 100, 200));
+  before.begin_box(2);
+  before.push_solid_color(blue, rect(200, 200, 200));
+  before.begin_box(3);
+  before.push_solid_color(green, rect(500, 100, 100));
+  after.begin_box(2);
+  after.push_solid_color(blue, rect(200, 200, 200));
+  after.begin_box(1);
+  after.push_solid_color(red, rect(100, 100, 200));
+  after.begin_box(3);
+  after.push_solid_color(green, rect(500, 100, 100));
+  before.build_index();
+  after.build_index();
+
+  Framebuffer fb(640, 480), expected(640, 480);
+  fb.clear(WHITE);
+  rasterize(before, fb);
+  Damage damage = diff_display_lists(before, after);
+  repaint_damage(after, fb, 0, 0, WHITE, damage);
+  expected.clear(WHITE);
+  rasterize(after, expected);
+
+  PixelRect screen{0, 0, fb.width, fb.height};
+  std::cout << "paint order swapped: " << damaged_percent(damage, screen)
+            << "% of the screen damaged (" << damage.stats.reordered
+            << " reordered, " << damage.stats.unchanged << " unchanged)"
+            << std::endl;
+  size_t different = count_different_pixels(expected, fb);
+  if (different != 0 || damage.full || damage.stats.reordered != 1) {
+    std::cout << "MISMATCH after a paint order swap: " << different
+              << " pixels differ from a full repaint" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+int main() {
+  Frame frame;
+  build_document(frame.doc, 2000);
+  frame.tree = build_layout_tree(frame.doc.root);
+  frame.viewport.content.width = LayoutUnit::from_px(1280);
+  frame.tree.layout(frame.viewport);
+  frame.list = build_display_list(frame.tree);
+  frame.fb.clear(WHITE);
+  rasterize(frame.list, frame.fb, frame.screen.x, frame.screen.y);
+
+  bool ok = next_frame(frame, "nothing changed");
+
+  TextNode *text = nullptr;
+  BoxId box = text_on_screen(frame, text);
+  text->content.replace(0, 3, "PUT");
+  frame.tree.mark_needs_layout(box);
+  ok = next_frame(frame, "one word changed") && ok;
+
+  text->content += text->content;
+  frame.tree.mark_needs_layout(box);
+  ok = next_frame(frame, "paragraph grew") && ok;
+  ok = check_paint_order() && ok;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+// Building and walking the display list of a text document: bytes per
+// command, build time, allocations while iterating, and how long finding
+// what is in a viewport takes with the band index. Then recording the
+// list and reading it back.
+//
+//   make bench && ./bench/display_list_bench.exe
+
+#include <cstdio>
+#include <fstream>
+
+#include "bench_common.cpp"
+#include "painter.cpp"
+
+bool run(int paragraphs) {
+  Document doc;
+  build_document(doc, paragraphs);
+  LayoutTree tree = build_layout_tree(doc.root);
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(1280);
+  tree.layout(viewport);
+
+  DisplayList list;
+  size_t before = allocations;
+  double build_ms = time_ms(5, [&] { list = build_display_list(tree); });
+  size_t build_allocations = (allocations - before) / 5;
+
+  // the kind of walk a backend does
+  size_t solid = 0, text = 0, text_bytes = 0, shapes = 0, walked = 0;
+  before = allocations;
+  double walk_ms = time_ms(1, [&] {
+    for (const CommandHeader &command : list) {
+      walked += command.size();
+      switch (command.op()) {
+      case DisplayOp::SOLID_COLOR:
+        solid++;
+        break;
+      case DisplayOp::TEXT:
+        text++;
+        text_bytes += command.as<TextCommand>().length;
+        break;
+      case DisplayOp::BORDER:
+      case DisplayOp::ROUNDED_RECT:
+        shapes++;
+        break;
+      }
+    }
+  });
+  size_t walk_allocations = allocations - before;
+
+  size_t fragments = 0, fragment_bytes = 0;
+  for (BoxId id = 0; id < tree.size(); id++) {
+    for (const TextFragment &fragment : tree[id].fragments) {
+      fragments++;
+      fragment_bytes += fragment.length;
+    }
+  }
+
+  std::cout << paragraphs << " paragraphs: " << list.size() << " commands, "
+            << list.size_in_bytes() << " bytes ("
+            << double(list.size_in_bytes()) / list.size()
+            << " per command), build " << build_ms << "ms ("
+            << build_allocations << " allocations), walk " << walk_ms
+            << "ms (" << walk_allocations << " allocations)" << std::endl;
+
+  bool ok = solid + text + shapes == list.size() &&
+            walked == list.size_in_bytes() && text == fragments &&
+            text_bytes == fragment_bytes && walk_allocations == 0;
+  if (!ok) {
+    std::cout << "MISMATCH between display list and layout" << std::endl;
+  }
+
+  // scroll from top to bottom, a screen at a time
+  LayoutUnit height = tree[tree.root].dims.margin_box().height;
+  Rect screen{LayoutUnit(), LayoutUnit(), LayoutUnit::from_px(1280),
+              LayoutUnit::from_px(720)};
+  std::vector<uint32_t> visible;
+  size_t frames = 0, painted = 0;
+  before = allocations;
+  double query_ms = time_ms(1, [&] {
+    for (screen.y = LayoutUnit(); screen.y < height;
+         screen.y += LayoutUnit::from_px(720)) {
+      list.query(screen, visible);
+      frames++;
+      painted += visible.size();
+    }
+  });
+  std::cout << "  " << list.index.band_count() << " bands, "
+            << list.index.offsets.size() << " entries, query "
+            << query_ms * 1000 / frames << "us per frame (" << painted / frames
+            << " commands), " << allocations - before << " allocations"
+            << std::endl;
+
+  // the index has to find exactly what a full walk finds
+  for (LayoutUnit y : {LayoutUnit(), height / 2, height - screen.height}) {
+    screen.y = y;
+    list.query(screen, visible);
+    std::vector<uint32_t> expected;
+    for (DisplayList::iterator it = list.begin(); it != list.end(); ++it) {
+      if (intersects(paint_bounds(*it), pack_rect(screen))) {
+        expected.push_back(static_cast<uint32_t>(it.at - list.words.data()));
+      }
+    }
+    if (visible != expected) {
+      std::cout << "MISMATCH between index and full walk at " << y
+                << std::endl;
+      ok = false;
+    }
+  }
+
+  // recorded and read back it is the same list
+  const char *path = "display_list_bench.dl";
+  DisplayList replayed;
+  LayoutUnit width, page_height;
+  double record_ms = time_ms(1, [&] {
+    write_display_list(path, list, viewport.content.width, height);
+  });
+  double read_ms = time_ms(1, [&] {
+    read_display_list(path, replayed, width, page_height);
+  });
+  // text is stored byte for byte, whatever the host's byte order
+  std::ifstream file(path, std::ios::binary);
+  std::string recorded((std::istreambuf_iterator<char>(file)),
+                       std::istreambuf_iterator<char>());
+  for (const CommandHeader &command : list) {
+    if (command.op() == DisplayOp::TEXT) {
+      const TextCommand &text = command.as<TextCommand>();
+      if (recorded.find(std::string(text.text(), text.length)) ==
+          std::string::npos) {
+        std::cout << "MISMATCH: text not stored as it is" << std::endl;
+        ok = false;
+      }
+      break;
+    }
+  }
+  std::remove(path);
+  std::cout << "  record " << record_ms << "ms, read back " << read_ms << "ms"
+            << std::endl;
+  if (replayed.words != list.words || replayed.count != list.count ||
+      replayed.item_boxes != list.item_boxes ||
+      replayed.index.offsets != list.index.offsets ||
+      width != viewport.content.width || page_height != height) {
+    std::cout << "MISMATCH between recorded and original list" << std::endl;
+    ok = false;
+  }
+  return ok;
+}
+
+int main() {
+  bool ok = true;
+  for (int paragraphs : {1000, 10000, 50000}) {
+    ok = run(paragraphs) && ok;
+  }
+  return ok ? 0 : 1;
+}
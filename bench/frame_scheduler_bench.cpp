@@ -0,0 +1,123 @@
+// Frames produced for ten seconds of an open page: it loads, the mouse
+// moves over it, a half second animation runs and the content changes
+// once. Driven by the headless scheduler, so the frames are the same on
+// every run; a loop that polls at 60Hz would produce 600. Then the real
+// time scheduler, to see that idling costs no CPU and that a request from
+// another thread wakes it up right away.
+//
+//   make bench && ./bench/frame_scheduler_bench.exe
+
+#include <ctime>
+#include <thread>
+
+#include "bench_common.cpp"
+#include "frame_scheduler.cpp"
+
+using std::chrono::milliseconds;
+
+struct FrameRecord {
+  long long ms;
+  uint32_t reasons;
+
+  bool operator==(const FrameRecord &other) const {
+    return this->ms == other.ms && this->reasons == other.reasons;
+  }
+};
+
+std::vector<FrameRecord> simulate() {
+  HeadlessFrameScheduler scheduler;
+  FrameTime start = scheduler.now();
+  auto at = [&](int ms) { return start + milliseconds(ms); };
+
+  scheduler.request_frame(FRAME_CONTENT);
+  // a mouse move every 10ms for 100ms
+  for (int ms = 1000; ms < 1100; ms += 10) {
+    scheduler.post_at(at(ms));
+  }
+  // a click that starts the animation
+  scheduler.post_at(at(3000));
+  // a stylesheet that finished loading
+  scheduler.post_at(at(6000), FRAME_CONTENT);
+  // whoever owns the page closes it at 10s
+  scheduler.request_frame_at(at(10000));
+
+  const int ANIMATION_MS = 500;
+  const int FRAME_MS = 16;
+  FrameTime animation_end = at(3000 + ANIMATION_MS);
+  std::vector<FrameRecord> frames;
+  run_frames(scheduler, [&](uint32_t reasons) {
+    FrameTime now = scheduler.now();
+    frames.push_back(FrameRecord{
+        std::chrono::duration_cast<milliseconds>(now - start).count(),
+        reasons});
+    bool animating = now >= at(3000) && now < animation_end;
+    if (animating) {
+      // the next animation frame, a display refresh later
+      scheduler.request_frame_at(now + milliseconds(FRAME_MS),
+                                 FRAME_ANIMATION);
+    }
+    if (now >= at(10000)) {
+      scheduler.close();
+    }
+  });
+  return frames;
+}
+
+// process CPU time in ms
+double cpu_ms() { return 1000.0 * std::clock() / CLOCKS_PER_SEC; }
+
+int main() {
+  bool ok = true;
+  std::vector<FrameRecord> frames = simulate();
+  std::vector<FrameRecord> again = simulate();
+  size_t input = 0, animation = 0, content = 0;
+  for (const FrameRecord &frame : frames) {
+    input += (frame.reasons & FRAME_INPUT) != 0;
+    animation += (frame.reasons & FRAME_ANIMATION) != 0;
+    content += (frame.reasons & FRAME_CONTENT) != 0;
+  }
+  std::cout << "10s of an open page: " << frames.size() << " frames ("
+            << input << " input, " << animation << " animation, " << content
+            << " content), 600 when polling at 60Hz" << std::endl;
+  if (frames != again) {
+    std::cout << "MISMATCH: two runs of the headless scheduler differ"
+              << std::endl;
+    ok = false;
+  }
+  // first paint, 10 moves, the click, 32 animation frames (the last one
+  // sees the animation is over), the content change and the last timer
+  if (frames.size() != 46) {
+    std::cout << "MISMATCH: expected 46 frames" << std::endl;
+    ok = false;
+  }
+
+  BlockingFrameScheduler scheduler;
+  FrameTime start = scheduler.now();
+  scheduler.request_frame_at(start + milliseconds(300));
+  double cpu_start = cpu_ms();
+  uint32_t reasons = scheduler.next_frame();
+  double idle_cpu = cpu_ms() - cpu_start;
+  double idle_ms = ms_since(start);
+  std::cout << "idle for " << idle_ms << "ms until a timer, " << idle_cpu
+            << "ms of CPU" << std::endl;
+  if (reasons != FRAME_TIMER || idle_ms < 300) {
+    std::cout << "MISMATCH: the timer fired early" << std::endl;
+    ok = false;
+  }
+
+  auto requested = std::chrono::steady_clock::now();
+  std::thread loader([&] {
+    std::this_thread::sleep_for(milliseconds(50));
+    requested = std::chrono::steady_clock::now();
+    scheduler.request_frame(FRAME_CONTENT);
+  });
+  reasons = scheduler.next_frame();
+  std::cout << "woken by another thread after " << ms_since(requested)
+            << "ms" << std::endl;
+  loader.join();
+  if (reasons != FRAME_CONTENT) {
+    std::cout << "MISMATCH: woken for the wrong reason" << std::endl;
+    ok = false;
+  }
+  return ok ? 0 : 1;
+}
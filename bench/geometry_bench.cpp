@@ -0,0 +1,105 @@
+// Post-layout passes over the GeometryTable vs walking the LayoutBoxes.
+//
+//   make bench && ./bench/geometry_bench.exe
+
+#include "bench_common.cpp"
+#include "geometry_table.cpp"
+
+int main() {
+  StyledNode root = balanced_tree(10, 6);
+  LayoutTree tree = build_layout_tree(root);
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(1280);
+  tree.layout(viewport);
+
+  const int iterations = 50;
+  bool ok = true;
+  std::cout << tree.size() << " boxes" << std::endl;
+
+  double export_ms = time_ms(iterations, [&] { export_geometry(tree); });
+  GeometryTable table = export_geometry(tree);
+  std::cout << "export " << export_ms << "ms" << std::endl;
+
+  LayoutUnit dx = LayoutUnit::from_px(3);
+  LayoutUnit dy = LayoutUnit::from_px(-7);
+  double aos_translate = time_ms(iterations, [&] {
+    for (LayoutBox &box : tree.boxes) {
+      box.dims.content.x += dx;
+      box.dims.content.y += dy;
+    }
+  });
+  double soa_translate = time_ms(
+      iterations, [&] { table.translate(0, table.size(), dx, dy); });
+  std::cout << "translate: boxes " << aos_translate << "ms, table "
+            << soa_translate << "ms" << std::endl;
+  ok = ok && table.border_box(1234).y == tree[1234].dims.border_box().y;
+
+  Rect aos_bounds;
+  double aos_union = time_ms(iterations, [&] {
+    Rect b = tree[0].dims.border_box();
+    LayoutUnit right = b.x + b.width, bottom = b.y + b.height;
+    for (const LayoutBox &box : tree.boxes) {
+      Rect r = box.dims.border_box();
+      b.x = std::min(b.x, r.x);
+      b.y = std::min(b.y, r.y);
+      right = std::max(right, r.x + r.width);
+      bottom = std::max(bottom, r.y + r.height);
+    }
+    aos_bounds = Rect{b.x, b.y, right - b.x, bottom - b.y};
+  });
+  Rect soa_bounds;
+  double soa_union = time_ms(
+      iterations, [&] { soa_bounds = table.bounds(0, table.size()); });
+  std::cout << "bounds: boxes " << aos_union << "ms, table " << soa_union
+            << "ms " << soa_bounds << std::endl;
+  ok = ok && aos_bounds.x == soa_bounds.x && aos_bounds.y == soa_bounds.y &&
+       aos_bounds.width == soa_bounds.width &&
+       aos_bounds.height == soa_bounds.height;
+
+  Rect screen{LayoutUnit(), soa_bounds.y + soa_bounds.height / 2,
+              LayoutUnit::from_px(1280), LayoutUnit::from_px(720)};
+  size_t aos_visible = 0;
+  double aos_cull = time_ms(iterations, [&] {
+    aos_visible = 0;
+    for (const LayoutBox &box : tree.boxes) {
+      Rect r = box.dims.border_box();
+      aos_visible += r.x < screen.x + screen.width &&
+                     r.x + r.width > screen.x &&
+                     r.y < screen.y + screen.height &&
+                     r.y + r.height > screen.y;
+    }
+  });
+  std::vector<uint8_t> visible;
+  size_t soa_visible = 0;
+  double soa_cull = time_ms(
+      iterations, [&] { soa_visible = table.cull(screen, visible); });
+  std::cout << "cull: boxes " << aos_cull << "ms, table " << soa_cull
+            << "ms, " << soa_visible << " visible" << std::endl;
+  ok = ok && aos_visible == soa_visible;
+
+  LayoutUnit px = LayoutUnit::from_px(600);
+  LayoutUnit py = screen.y + LayoutUnit::from_px(100);
+  BoxId aos_hit = NO_BOX;
+  double aos_hit_ms = time_ms(iterations, [&] {
+    aos_hit = NO_BOX;
+    for (size_t i = tree.size(); i-- > 0;) {
+      Rect r = tree[i].dims.border_box();
+      if (px >= r.x && px < r.x + r.width && py >= r.y &&
+          py < r.y + r.height) {
+        aos_hit = static_cast<BoxId>(i);
+        break;
+      }
+    }
+  });
+  BoxId soa_hit = NO_BOX;
+  double soa_hit_ms =
+      time_ms(iterations, [&] { soa_hit = table.hit_test(px, py); });
+  std::cout << "hit test: boxes " << aos_hit_ms << "ms, table " << soa_hit_ms
+            << "ms, box " << soa_hit << std::endl;
+  ok = ok && aos_hit == soa_hit;
+
+  if (!ok) {
+    std::cout << "MISMATCH between table and layout boxes" << std::endl;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,140 @@
+// Text at many font sizes: what ImGui's ImFontAtlas takes to bake them up
+// front (and again for every size added), against GlyphAtlas filling in
+// glyphs as frames need them. A scroll through a page that cycles through
+// more sizes than fit makes the atlas evict; after every frame each glyph
+// in it is checked against the font's own bitmap.
+//
+//   make bench && ./bench/glyph_atlas_bench.exe
+
+#include "bench_common.cpp"
+#include "glyph_atlas.cpp"
+#include "imgui/imgui.h"
+
+const char *SAMPLE = "The quick brown fox jumps over the lazy dog 0123456789 "
+                     "THE QUICK BROWN FOX JUMPS OVER THE LAZY DOG !?.,;:'\"()";
+
+// ImFontAtlas with DroidSans at every size in [first, last]
+double imgui_build_ms(int first, int last) {
+  ImFontAtlas atlas;
+  for (int px = first; px <= last; px++) {
+    atlas.AddFontFromFileTTF(DEFAULT_FONT_PATH, static_cast<float>(px));
+  }
+  return time_ms(1, [&] { atlas.Build(); });
+}
+
+// one frame of a page with text at `sizes`
+void draw_frame(GlyphAtlas &atlas, const std::vector<int> &sizes) {
+  atlas.begin_frame();
+  for (int px : sizes) {
+    FontSize &size = atlas.font->at_size(px);
+    walk_glyphs(size, SAMPLE, std::strlen(SAMPLE),
+                [&](int glyph, int) { atlas.glyph(size, glyph); });
+  }
+}
+
+// every glyph in the atlas still has the pixels it was rasterized with
+bool check_atlas(GlyphAtlas &atlas) {
+  for (const auto &entry : atlas.glyphs) {
+    const AtlasGlyph &glyph = entry.second;
+    if (glyph.page < 0) {
+      continue;
+    }
+    int px = static_cast<int>(entry.first >> 32);
+    int index = static_cast<int>(entry.first & 0xffffffff);
+    const GlyphBitmap &bitmap = atlas.font->at_size(px).glyph_bitmap(index);
+    const unsigned char *pixels = atlas.pixels(glyph);
+    for (int y = 0; y < glyph.height; y++) {
+      if (!std::equal(&bitmap.coverage[size_t(y) * bitmap.width],
+                      &bitmap.coverage[size_t(y + 1) * bitmap.width],
+                      pixels + size_t(y) * atlas.page_size)) {
+        std::cout << "MISMATCH: glyph " << index << " at " << px
+                  << "px was overwritten" << std::endl;
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+struct FrameResult {
+  double ms;
+  size_t rasterized;
+  size_t uploaded;
+};
+
+FrameResult frame(GlyphAtlas &atlas, const std::vector<int> &sizes) {
+  std::vector<AtlasUpload> uploads;
+  AtlasStats before = atlas.stats;
+  double ms = time_ms(1, [&] {
+    draw_frame(atlas, sizes);
+    atlas.take_uploads(uploads);
+  });
+  return FrameResult{ms, atlas.stats.rasterized - before.rasterized,
+                     atlas.stats.uploaded_pixels - before.uploaded_pixels};
+}
+
+void report(const char *name, const FrameResult &r) {
+  std::cout << "  " << name << ": " << r.ms << "ms, " << r.rasterized
+            << " glyphs rasterized, " << r.uploaded << " pixels uploaded"
+            << std::endl;
+}
+
+int main() {
+  if (!default_font().loaded) {
+    std::cout << "run from the repository root, the font is needed"
+              << std::endl;
+    return 1;
+  }
+  IMGUI_CHECKVERSION();
+  ImGui::CreateContext();
+
+  std::cout << "ImFontAtlas, baked up front" << std::endl;
+  std::cout << "  8 sizes: " << imgui_build_ms(12, 19) << "ms" << std::endl;
+  std::cout << "  65 sizes (8 to 72px): " << imgui_build_ms(8, 72) << "ms"
+            << std::endl;
+  std::cout << "  one more size means building all 66 again: "
+            << imgui_build_ms(8, 73) << "ms" << std::endl;
+
+  bool ok = true;
+  std::cout << "GlyphAtlas, on demand" << std::endl;
+  {
+    GlyphAtlas atlas;
+    std::vector<int> sizes = {12, 13, 14, 15, 16, 17, 18, 19};
+    report("first frame, 8 sizes", frame(atlas, sizes));
+    report("same frame again", frame(atlas, sizes));
+    sizes.push_back(40);
+    report("a new size", frame(atlas, sizes));
+    ok = check_atlas(atlas) && ok;
+  }
+
+  // two pages of 512px do not hold all 65 sizes, a scroll through them
+  // evicts what went off screen
+  GlyphAtlas atlas;
+  atlas.page_size = 512;
+  atlas.max_pages = 2;
+  double total_ms = 0, worst_ms = 0;
+  int frames = 0;
+  for (int pass = 0; pass < 2; pass++) {
+    for (int first = 8; first + 6 <= 72; first += 2, frames++) {
+      std::vector<int> sizes;
+      for (int px = first; px < first + 6; px++) {
+        sizes.push_back(px);
+      }
+      FrameResult r = frame(atlas, sizes);
+      total_ms += r.ms;
+      worst_ms = std::max(worst_ms, r.ms);
+      ok = check_atlas(atlas) && ok;
+    }
+  }
+  std::cout << "  scrolling through 65 sizes twice, 2 pages of 512px: "
+            << frames << " frames, " << total_ms / frames << "ms average, "
+            << worst_ms << "ms worst, " << atlas.stats.evicted << " evicted"
+            << std::endl;
+  if (atlas.stats.evicted == 0) {
+    std::cout << "MISMATCH: expected the atlas to evict" << std::endl;
+    ok = false;
+  }
+
+  ImGui::DestroyContext();
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,367 @@
+// Translating a screen of a text page to ImGui draw data, one ImGui call
+// per command against the batched painter. Runs ImGui headless like
+// imgui/examples/example_null, nothing is rendered. The rects both write
+// are rasterized and checked against the software rasterizer. Then the
+// cost of a static page with the retained draw data, for growing pages,
+// and text from the glyph atlas against the software rasterizer.
+//
+//   make bench && ./bench/imgui_paint_bench.exe
+
+#include "bench_common.cpp"
+#include "imgui_painter.cpp"
+#include "painter.cpp"
+#include "raster.cpp"
+
+const PackedColor WHITE = 0xffffffff;
+
+struct DrawCounts {
+  int vertices = 0;
+  int indices = 0;
+  int commands = 0;
+};
+
+DrawCounts counts(const ImDrawList *draw_list) {
+  return DrawCounts{draw_list->VtxBuffer.Size, draw_list->IdxBuffer.Size,
+                    draw_list->CmdBuffer.Size};
+}
+
+// paints in a window covering the whole display, `paint` gets the draw
+// list and the screen position of the page origin
+template <typename F> DrawCounts frame(int scroll, F paint) {
+  ImGuiIO &io = ImGui::GetIO();
+  io.DisplaySize = ImVec2(1280, 720);
+  io.DeltaTime = 1.0f / 60.0f;
+  ImGui::NewFrame();
+  ImGui::SetNextWindowPos(ImVec2(0, 0));
+  ImGui::SetNextWindowSize(io.DisplaySize);
+  ImGui::Begin("page", nullptr,
+               ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoBackground);
+  ImDrawList *draw_list = ImGui::GetWindowDrawList();
+  DrawCounts before = counts(draw_list);
+  paint(draw_list, ImVec2(0, static_cast<float>(-scroll)));
+  DrawCounts after = counts(draw_list);
+  ImGui::End();
+  ImGui::Render();
+  return DrawCounts{after.vertices - before.vertices,
+                    after.indices - before.indices,
+                    after.commands - before.commands};
+}
+
+// fills every quad (4 vertices, as PrimRect writes them) from `first_vertex`
+// on into `fb`, which shows the draw list from `display_pos` on
+void rasterize_quads(const ImDrawList *draw_list, int first_vertex,
+                     Framebuffer &fb, ImVec2 display_pos = ImVec2(0, 0)) {
+  PixelRect clip{0, 0, fb.width, fb.height};
+  for (int i = first_vertex; i + 3 < draw_list->VtxBuffer.Size; i += 4) {
+    const ImDrawVert &a = draw_list->VtxBuffer[i];
+    const ImDrawVert &c = draw_list->VtxBuffer[i + 2];
+    PixelRect r{static_cast<int>(a.pos.x - display_pos.x),
+                static_cast<int>(a.pos.y - display_pos.y),
+                static_cast<int>(c.pos.x - a.pos.x),
+                static_cast<int>(c.pos.y - a.pos.y)};
+    fill_rect(fb, r, clip, a.col);
+  }
+}
+
+// the solid colors of `list`, quads can be checked against the rasterizer
+DisplayList solid_colors(const DisplayList &list) {
+  DisplayList solid;
+  for (const CommandHeader &command : list) {
+    if (command.op() == DisplayOp::SOLID_COLOR) {
+      const SolidColorCommand &c = command.as<SolidColorCommand>();
+      solid.push_solid_color(c.color, c.box.rect());
+    }
+  }
+  solid.build_index();
+  return solid;
+}
+
+bool check_pixels(const char *name, const Framebuffer &expected,
+                  const Framebuffer &actual) {
+  size_t different = count_different_pixels(expected, actual);
+  if (different != 0) {
+    std::cout << "MISMATCH in " << name << ": " << different
+              << " pixels differ" << std::endl;
+  }
+  return different == 0;
+}
+
+// paints only the solid colors of `list` with `paint` and compares the
+// quads with what the software rasterizer makes of them
+template <typename F>
+bool check_rects(const char *name, const DisplayList &list, int scroll,
+                 F paint) {
+  DisplayList solid = solid_colors(list);
+  Framebuffer expected(1280, 720), actual(1280, 720);
+  expected.clear(WHITE);
+  actual.clear(WHITE);
+  rasterize(solid, expected, 0, scroll);
+
+  frame(scroll, [&](ImDrawList *draw_list, const ImVec2 &origin) {
+    int first_vertex = draw_list->VtxBuffer.Size;
+    paint(solid, draw_list, origin);
+    rasterize_quads(draw_list, first_vertex, actual);
+  });
+  return check_pixels(name, expected, actual);
+}
+
+// Frames of a static page through PageDrawCache, for pages of growing
+// size; the time per frame should not grow with them.
+bool retained(int paragraphs) {
+  Document doc;
+  build_document(doc, paragraphs);
+  LayoutTree tree = build_layout_tree(doc.root);
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(1280);
+  tree.layout(viewport);
+  DisplayList list = build_display_list(tree);
+
+  PageDrawCache cache;
+  ImVec2 size(1280, 720);
+  int scroll = 2000;
+  double first_ms = time_ms(1, [&] {
+    frame(0, [&](ImDrawList *, const ImVec2 &) {
+      cache.frame(list, 0, scroll, size);
+    });
+  });
+  const int frames = 200;
+  double static_ms = time_ms(frames, [&] {
+    frame(0, [&](ImDrawList *, const ImVec2 &) {
+      cache.frame(list, 0, scroll, size);
+    });
+  });
+  double scroll_ms = time_ms(frames, [&] {
+    frame(0, [&](ImDrawList *, const ImVec2 &) {
+      cache.frame(list, 0, ++scroll, size);
+    });
+  });
+  std::cout << "  " << paragraphs << " paragraphs: first frame " << first_ms
+            << "ms, static " << static_ms << "ms, scrolling " << scroll_ms
+            << "ms per frame, painted " << cache.stats.painted << " of "
+            << cache.stats.frames << " frames" << std::endl;
+  // the 200px scroll stays within the margin
+  return cache.stats.painted == 1;
+}
+
+// the cached quads, scrolled by DisplayPos, against the rasterizer
+bool check_retained(const DisplayList &list) {
+  DisplayList solid = solid_colors(list);
+  PageDrawCache cache;
+  bool ok = true;
+  for (int scroll : {5000, 5100, 4500, 9000}) {
+    ImDrawData *data = nullptr;
+    frame(0, [&](ImDrawList *, const ImVec2 &) {
+      data = cache.frame(solid, 0, scroll, ImVec2(1280, 720));
+    });
+    Framebuffer expected(1280, 720), actual(1280, 720);
+    expected.clear(WHITE);
+    actual.clear(WHITE);
+    rasterize(solid, expected, 0, scroll);
+    rasterize_quads(data->CmdLists[0], 0, actual, data->DisplayPos);
+    ok = check_pixels("retained", expected, actual) && ok;
+  }
+  // 5100 and 4500 reuse the first paint, 9000 is too far
+  if (cache.stats.painted != 2) {
+    std::cout << "retained painted " << cache.stats.painted
+              << " times, expected 2" << std::endl;
+    ok = false;
+  }
+  return ok;
+}
+
+void report(const char *name, double ms, const DrawCounts &c) {
+  std::cout << "  " << name << " " << ms << "ms, " << c.vertices
+            << " vertices, " << c.indices << " indices, " << c.commands
+            << " draw commands" << std::endl;
+}
+
+// Software renders the quads of `data`, glyphs and solid rects, which
+// sample the white texel, on page (texture id - 1) of `atlas`.
+void rasterize_draw_data(const ImDrawData *data, const GlyphAtlas &atlas,
+                         Framebuffer &fb) {
+  PixelRect clip{0, 0, fb.width, fb.height};
+  const ImDrawList *draw_list = data->CmdLists[0];
+  for (const ImDrawCmd &cmd : draw_list->CmdBuffer) {
+    for (unsigned int i = 0; i < cmd.ElemCount; i += 6) {
+      unsigned int first = draw_list->IdxBuffer[cmd.IdxOffset + i];
+      const ImDrawVert &a = draw_list->VtxBuffer[cmd.VtxOffset + first];
+      const ImDrawVert &b = draw_list->VtxBuffer[cmd.VtxOffset + first + 2];
+      PixelRect r{static_cast<int>(a.pos.x - data->DisplayPos.x),
+                  static_cast<int>(a.pos.y - data->DisplayPos.y),
+                  static_cast<int>(b.pos.x - a.pos.x),
+                  static_cast<int>(b.pos.y - a.pos.y)};
+      const AtlasPage &page =
+          *atlas.pages[reinterpret_cast<intptr_t>(cmd.TextureId) - 1];
+      GlyphBitmap bitmap;
+      bitmap.width = r.width;
+      bitmap.height = r.height;
+      if (a.uv.x == b.uv.x && a.uv.y == b.uv.y) {
+        // one texel stretched over the rect
+        unsigned char texel =
+            page.pixels[size_t(a.uv.y * page.size) * page.size +
+                        size_t(a.uv.x * page.size)];
+        bitmap.coverage.assign(size_t(r.width) * r.height, texel);
+        blend_glyph(fb, bitmap, r.x, r.y, clip, a.col);
+        continue;
+      }
+      int x = static_cast<int>(a.uv.x * page.size + 0.5f);
+      int y = static_cast<int>(a.uv.y * page.size + 0.5f);
+      for (int row = 0; row < r.height; row++) {
+        const unsigned char *src = &page.pixels[size_t(y + row) * page.size];
+        bitmap.coverage.insert(bitmap.coverage.end(), src + x,
+                               src + x + r.width);
+      }
+      blend_glyph(fb, bitmap, r.x, r.y, clip, a.col);
+    }
+  }
+}
+
+// draw commands with vertices, and how many textures they use
+void count_draws(const ImDrawData *data, int &draws, int &textures) {
+  std::vector<ImTextureID> seen;
+  draws = 0;
+  for (const ImDrawCmd &cmd : data->CmdLists[0]->CmdBuffer) {
+    if (cmd.ElemCount == 0) {
+      continue;
+    }
+    draws++;
+    if (std::find(seen.begin(), seen.end(), cmd.TextureId) == seen.end()) {
+      seen.push_back(cmd.TextureId);
+    }
+  }
+  textures = static_cast<int>(seen.size());
+}
+
+// text through the glyph atlas lands on the same pixels as in the
+// software rasterizer, with one draw call per atlas page
+bool check_atlas_text(const DisplayList &list) {
+  GlyphAtlas atlas;
+  PageDrawCache cache;
+  cache.painter.atlas = &atlas;
+  cache.painter.page_texture = [](int page) {
+    return reinterpret_cast<ImTextureID>(intptr_t(page) + 1);
+  };
+  bool ok = true;
+  for (int scroll : {5000, 5100}) {
+    ImDrawData *data = nullptr;
+    frame(0, [&](ImDrawList *, const ImVec2 &) {
+      atlas.begin_frame();
+      data = cache.frame(list, 0, scroll, ImVec2(1280, 720));
+    });
+    Framebuffer expected(1280, 720), actual(1280, 720);
+    expected.clear(WHITE);
+    actual.clear(WHITE);
+    rasterize(list, expected, 0, scroll);
+    rasterize_draw_data(data, atlas, actual);
+    ok = check_pixels("atlas text", expected, actual) && ok;
+
+    int draws, textures;
+    count_draws(data, draws, textures);
+    std::cout << "atlas text at " << scroll << ": " << draws
+              << " draw calls, " << textures << " textures" << std::endl;
+    if (draws != textures) {
+      std::cout << "MISMATCH: expected one draw call per atlas page"
+                << std::endl;
+      ok = false;
+    }
+  }
+  std::cout << "atlas text: " << atlas.stats.rasterized
+            << " glyphs rasterized, " << cache.stats.painted << " of "
+            << cache.stats.frames << " frames painted" << std::endl;
+  return ok;
+}
+
+int main() {
+  IMGUI_CHECKVERSION();
+  ImGui::CreateContext();
+  // like the OpenGL3 backend, lets a draw list go past 64k vertices
+  ImGui::GetIO().BackendFlags |= ImGuiBackendFlags_RendererHasVtxOffset;
+  ImGui::GetIO().IniFilename = nullptr;
+  unsigned char *tex_pixels = nullptr;
+  int tex_w, tex_h;
+  ImGui::GetIO().Fonts->GetTexDataAsRGBA32(&tex_pixels, &tex_w, &tex_h);
+
+  Document doc;
+  build_document(doc, 2000);
+  LayoutTree tree = build_layout_tree(doc.root);
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(1280);
+  tree.layout(viewport);
+  DisplayList list = build_display_list(tree);
+
+  std::vector<uint32_t> offsets;
+  ImGuiPainter painter;
+  auto per_command = [&](const DisplayList &l, ImDrawList *draw_list,
+                         const ImVec2 &origin) {
+    for (uint32_t offset : offsets) {
+      paint_item(draw_list, l.at(offset), origin);
+    }
+  };
+  auto batched = [&](const DisplayList &l, ImDrawList *draw_list,
+                     const ImVec2 &origin) {
+    painter.paint(l, offsets, draw_list, origin);
+  };
+
+  bool ok = true;
+  // a screen, and the whole page to see how it scales
+  struct Case {
+    const char *name;
+    int scroll, height;
+  };
+  for (Case c : {Case{"one screen", 5000, 720},
+                 Case{"whole page", 0, INT32_MAX / 128}}) {
+    Rect visible{LayoutUnit(), LayoutUnit::from_px(c.scroll),
+                 LayoutUnit::from_px(1280), LayoutUnit::from_px(c.height)};
+    list.query(visible, offsets);
+    std::cout << c.name << ", " << offsets.size() << " commands" << std::endl;
+
+    // taking turns, the best of a few, so neither gets the warm caches
+    const int frames = 20;
+    DrawCounts per_command_drawn, batched_drawn;
+    double per_command_ms = 1e9, batched_ms = 1e9;
+    for (int i = 0; i < 5; i++) {
+      per_command_ms = std::min(per_command_ms, time_ms(frames, [&] {
+        per_command_drawn =
+            frame(c.scroll, [&](ImDrawList *draw_list, const ImVec2 &o) {
+              per_command(list, draw_list, o);
+            });
+      }));
+      batched_ms = std::min(batched_ms, time_ms(frames, [&] {
+        batched_drawn =
+            frame(c.scroll, [&](ImDrawList *draw_list, const ImVec2 &o) {
+              batched(list, draw_list, o);
+            });
+      }));
+    }
+    report("per command", per_command_ms, per_command_drawn);
+    report("batched", batched_ms, batched_drawn);
+    std::cout << "  " << painter.stats.rects << " rects, "
+              << painter.stats.merged << " merged, " << painter.stats.batches
+              << " batches, " << painter.stats.texts << " texts, "
+              << painter.stats.culled << " culled" << std::endl;
+  }
+
+  // the offsets are into the solid-only list from here on
+  Rect screen{LayoutUnit(), LayoutUnit::from_px(5000),
+              LayoutUnit::from_px(1280), LayoutUnit::from_px(720)};
+  auto check = [&](const char *name, auto paint) {
+    return check_rects(name, list, 5000,
+                       [&](const DisplayList &solid, ImDrawList *draw_list,
+                           const ImVec2 &origin) {
+                         solid.query(screen, offsets);
+                         paint(solid, draw_list, origin);
+                       });
+  };
+  ok = check("per command", per_command) && ok;
+  ok = check("batched", batched) && ok;
+
+  std::cout << "retained" << std::endl;
+  for (int paragraphs : {500, 2000, 8000}) {
+    ok = retained(paragraphs) && ok;
+  }
+  ok = check_retained(list) && ok;
+  ok = check_atlas_text(list) && ok;
+
+  ImGui::DestroyContext();
+  return ok ? 0 : 1;
+}
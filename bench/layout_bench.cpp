@@ -0,0 +1,330 @@
+// Layout throughput on synthetic block trees.
+//
+//   make bench && ./bench/layout_bench.exe
+
+#include "bench_common.cpp"
+#include "parallel_layout.cpp"
+
+// a single chain of nested blocks
+StyledNode deep_tree(int depth) {
+  StyledNode root = block_node();
+  root.values.erase("height");
+  root.values.erase("margin");
+  root.values.erase("padding");
+  if (depth > 1) {
+    root.children.push_back(deep_tree(depth - 1));
+  }
+  return root;
+}
+
+// one parent with `width` block children
+StyledNode wide_tree(int width) {
+  StyledNode root = block_node();
+  root.values.erase("height");
+  for (int i = 0; i < width; i++) {
+    root.children.push_back(block_node());
+  }
+  return root;
+}
+
+void run(const std::string &name, const StyledNode &root, int iterations) {
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(1280);
+
+  double build_ms = 0;
+  double layout_ms = 0;
+  size_t boxes = 0;
+  long checksum = 0;
+  for (int i = 0; i < iterations; i++) {
+    auto start = std::chrono::steady_clock::now();
+    LayoutTree tree = build_layout_tree(root);
+    build_ms += ms_since(start);
+
+    start = std::chrono::steady_clock::now();
+    tree.layout(viewport);
+    layout_ms += ms_since(start);
+
+    boxes = tree.size();
+    checksum += tree[tree.root].dims.margin_box().height.round();
+  }
+
+  build_ms /= iterations;
+  layout_ms /= iterations;
+  std::cout << name << ": " << boxes << " boxes"
+            << " build " << build_ms << "ms"
+            << " layout " << layout_ms << "ms"
+            << " (" << (boxes / layout_ms) / 1000.0 << "M boxes/s)"
+            << " checksum " << checksum / iterations << std::endl;
+}
+
+bool same_intrinsic_widths(const LayoutTree &a, const LayoutTree &b) {
+  for (BoxId id = 0; id < a.size(); id++) {
+    if (a[id].min_content_width != b[id].min_content_width ||
+        a[id].max_content_width != b[id].max_content_width) {
+      std::cout << "box " << id << " has different intrinsic widths"
+                << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Differential check against the sequential engine, then timing.
+bool run_parallel(const std::string &name, const StyledNode &root,
+                  int iterations, ThreadPool &pool) {
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(1280);
+
+  LayoutTree sequential = build_layout_tree(root);
+  sequential.compute_intrinsic_widths(sequential.root);
+  sequential.layout(viewport);
+
+  double layout_ms = 0;
+  bool identical = true;
+  for (int i = 0; i < iterations; i++) {
+    LayoutTree tree = build_layout_tree(root);
+    auto start = std::chrono::steady_clock::now();
+    parallel_layout(tree, viewport, pool);
+    layout_ms += ms_since(start);
+    identical = identical && same_geometry(sequential, tree) &&
+                same_intrinsic_widths(sequential, tree);
+  }
+
+  layout_ms /= iterations;
+  std::cout << name << " parallel (" << pool.size() << " threads): "
+            << layout_ms << "ms "
+            << (identical ? "identical" : "MISMATCH") << std::endl;
+  return identical;
+}
+
+// the box laid out for `style`, by a scan since only this bench needs it
+BoxId find_box(const LayoutTree &tree, const StyledNode *style) {
+  for (BoxId id = 0; id < tree.size(); id++) {
+    if (tree[id].style == style) {
+      return id;
+    }
+  }
+  return NO_BOX;
+}
+
+// Change the height of one paragraph in a long document and lay out again.
+// Every relayout has to come out the same as a full layout of a fresh tree.
+bool run_incremental(int paragraphs, int iterations) {
+  StyledNode root = block_node();
+  root.values.erase("height");
+  for (int i = 0; i < paragraphs; i++) {
+    StyledNode section = block_node();
+    section.values.erase("height");
+    section.children.push_back(block_node());
+    section.children.push_back(block_node());
+    root.children.push_back(section);
+  }
+
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(1280);
+  LayoutTree tree = build_layout_tree(root);
+  tree.layout(viewport);
+  size_t full = tree.stats.laid_out;
+
+  StyledNode &edited = root.children[paragraphs / 2].children[0];
+  BoxId edited_box = find_box(tree, &edited);
+
+  double layout_ms = 0;
+  bool identical = true;
+  for (int i = 0; i < iterations; i++) {
+    edited.values["height"] = Length{static_cast<float>(4 + i % 2), Unit::px};
+    tree.mark_needs_layout(edited_box);
+
+    auto start = std::chrono::steady_clock::now();
+    tree.layout(viewport);
+    layout_ms += ms_since(start);
+
+    LayoutTree full_tree = build_layout_tree(root);
+    full_tree.layout(viewport);
+    identical = identical && same_geometry(full_tree, tree);
+  }
+
+  std::cout << "incremental " << paragraphs << " paragraphs: full layout "
+            << full << " boxes, relayout " << layout_ms / iterations << "ms"
+            << " laid out " << tree.stats.laid_out << " skipped "
+            << tree.stats.skipped << " translated " << tree.stats.translated
+            << " " << (identical ? "identical" : "MISMATCH") << std::endl;
+  return identical;
+}
+
+// font-size is inherited: changing it on the root, and then on one
+// paragraph, has to lay out again what inherits it.
+bool run_inherited(int paragraphs) {
+  Document doc;
+  build_document(doc, paragraphs);
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(1280);
+  LayoutTree tree = build_layout_tree(doc.root);
+  tree.layout(viewport);
+
+  StyledNode &paragraph = doc.root.children[paragraphs / 2];
+  BoxId paragraph_box = find_box(tree, &paragraph);
+  struct Edit {
+    StyledNode *node;
+    BoxId box;
+    float px;
+  };
+  Edit edits[] = {{&doc.root, tree.root, 32},
+                  {&paragraph, paragraph_box, 10},
+                  {&doc.root, tree.root, 16}};
+  bool identical = true;
+  for (const Edit &edit : edits) {
+    edit.node->values["font-size"] = Length{edit.px, Unit::px};
+    tree.mark_needs_layout(edit.box);
+    tree.layout(viewport);
+    LayoutTree full_tree = build_layout_tree(doc.root);
+    full_tree.layout(viewport);
+    identical = identical && same_geometry(full_tree, tree);
+  }
+  std::cout << "inherited font-size " << paragraphs << " paragraphs: "
+            << (identical ? "identical" : "MISMATCH") << std::endl;
+  return identical;
+}
+
+// Paragraphs of text, laid out once and then again after a resize. The
+// second layout should be served entirely from the word width cache.
+bool run_text(int paragraphs, int words_per_paragraph, ThreadPool &pool) {
+  const char *vocabulary[] = {"lorem", "ipsum", "dolor",  "sit",
+                              "amet",  "report", "quarterly", "revenue",
+                              "the",   "of",    "and",    "numbers"};
+  size_t vocabulary_size = sizeof(vocabulary) / sizeof(vocabulary[0]);
+
+  std::vector<std::unique_ptr<TextNode>> texts;
+  StyledNode root = block_node();
+  root.values.erase("height");
+  for (int i = 0; i < paragraphs; i++) {
+    std::string content;
+    for (int w = 0; w < words_per_paragraph; w++) {
+      content += vocabulary[(i * 7 + w * 3) % vocabulary_size];
+      content += " ";
+    }
+    texts.push_back(std::make_unique<TextNode>(content));
+
+    StyledNode text;
+    text.node = texts.back().get();
+    StyledNode paragraph = block_node();
+    paragraph.values.erase("height");
+    paragraph.children.push_back(text);
+    root.children.push_back(paragraph);
+  }
+
+  LayoutTree tree = build_layout_tree(root);
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(1280);
+
+  size_t lookups = default_font().glyph_lookups;
+  auto start = std::chrono::steady_clock::now();
+  tree.layout(viewport);
+  double first_ms = ms_since(start);
+  size_t first_lookups = default_font().glyph_lookups - lookups;
+
+  viewport.content.width = LayoutUnit::from_px(800);
+  lookups = default_font().glyph_lookups;
+  start = std::chrono::steady_clock::now();
+  tree.layout(viewport);
+  double resize_ms = ms_since(start);
+  size_t resize_lookups = default_font().glyph_lookups - lookups;
+
+  std::cout << "text " << paragraphs << "x" << words_per_paragraph
+            << " words: first layout " << first_ms << "ms (" << first_lookups
+            << " glyph lookups), resize " << resize_ms << "ms ("
+            << resize_lookups << " glyph lookups), height "
+            << tree[tree.root].dims.margin_box().height << std::endl;
+
+  return run_parallel("text", root, 5, pool);
+}
+
+// Lazy mode and content-visibility: auto leave boxes far from the viewport
+// alone, a parallel layout has to leave the same ones.
+bool run_deferred(ThreadPool &pool) {
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(1280);
+  Rect screen;
+  screen.width = viewport.content.width;
+  screen.height = LayoutUnit::from_px(720);
+
+  bool ok = true;
+  for (bool lazy : {true, false}) {
+    Document doc;
+    build_document(doc, 2000);
+    if (!lazy) {
+      for (StyledNode &paragraph : doc.root.children) {
+        paragraph.values["content-visibility"] = std::string("auto");
+      }
+    }
+
+    LayoutTree sequential = build_layout_tree(doc.root);
+    sequential.lazy = lazy;
+    sequential.viewport = screen;
+    sequential.layout(viewport);
+
+    LayoutTree tree = build_layout_tree(doc.root);
+    tree.lazy = lazy;
+    tree.viewport = screen;
+    parallel_layout(tree, viewport, pool);
+
+    bool same = sequential.stats.deferred > 0 &&
+                tree.stats.deferred == sequential.stats.deferred &&
+                tree.stats.laid_out == sequential.stats.laid_out &&
+                same_geometry(sequential, tree);
+    std::cout << (lazy ? "lazy" : "content-visibility") << " parallel: "
+              << tree.stats.laid_out << " laid out, " << tree.stats.deferred
+              << " deferred " << (same ? "identical" : "MISMATCH")
+              << std::endl;
+    ok = ok && same;
+  }
+  return ok;
+}
+
+// Layouts on a second, smaller pool started from the workers of `pool`.
+// Each pool has to put their tasks in its own queues.
+bool run_nested_pools(ThreadPool &pool) {
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(1280);
+  StyledNode root = balanced_tree(4, 5);
+  LayoutTree sequential = build_layout_tree(root);
+  sequential.layout(viewport);
+
+  ThreadPool inner(2);
+  std::atomic<bool> identical{true};
+  TaskGroup group(pool);
+  for (size_t i = 0; i < pool.size() * 4; i++) {
+    group.run([&] {
+      LayoutTree tree = build_layout_tree(root);
+      ParallelLayout(tree, inner, 1).layout(viewport);
+      if (!same_geometry(sequential, tree)) {
+        identical = false;
+      }
+    });
+  }
+  group.wait();
+
+  std::cout << "nested pools (" << pool.size() << " and " << inner.size()
+            << " threads): " << (identical ? "identical" : "MISMATCH")
+            << std::endl;
+  return identical;
+}
+
+int main() {
+  run("deep 2000", deep_tree(2000), 50);
+  run("wide 100000", wide_tree(100000), 20);
+  run("balanced 8^6", balanced_tree(8, 6), 20);
+  bool ok = run_incremental(10000, 20);
+  ok = run_inherited(200) && ok;
+
+  // at least four workers even on a single cpu, so the differential checks
+  // always run subtrees concurrently
+  ThreadPool pool(std::max<size_t>(4, std::thread::hardware_concurrency()));
+  ok = run_text(2000, 200, pool) && ok;
+  ok = run_parallel("deep 2000", deep_tree(2000), 50, pool) && ok;
+  ok = run_parallel("wide 100000", wide_tree(100000), 20, pool) && ok;
+  ok = run_parallel("balanced 8^6", balanced_tree(8, 6), 20, pool) && ok;
+  ok = run_deferred(pool) && ok;
+  ok = run_nested_pools(pool) && ok;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,78 @@
+// Memoized subtree layout on a synthetic table: 50k rows of 4 cells, with
+// only a handful of distinct rows.
+//
+//   make bench && ./bench/layout_cache_bench.exe
+
+#include "bench_common.cpp"
+
+struct Table {
+  std::vector<std::unique_ptr<TextNode>> texts;
+  StyledNode root;
+};
+
+void build_table(Table &table, int rows, int distinct_rows) {
+  const char *words[] = {"acme", "corp", "invoice", "paid", "pending",
+                         "overdue", "total", "usd", "eur", "q3"};
+  table.root = block_node();
+  table.root.values.erase("height");
+
+  for (int r = 0; r < rows; r++) {
+    StyledNode row = block_node();
+    row.values.erase("height");
+    row.values.erase("margin");
+    for (int c = 0; c < 4; c++) {
+      std::string content;
+      int seed = (r % distinct_rows) * 4 + c;
+      for (int w = 0; w < 3 + seed % 4; w++) {
+        content += words[(seed + w * 3) % 10];
+        content += " ";
+      }
+      table.texts.push_back(std::make_unique<TextNode>(content));
+
+      StyledNode text;
+      text.node = table.texts.back().get();
+      StyledNode cell = block_node();
+      cell.values.erase("height");
+      cell.values["padding"] = Length{4, Unit::px};
+      cell.children.push_back(text);
+      row.children.push_back(cell);
+    }
+    table.root.children.push_back(row);
+  }
+}
+
+int main() {
+  const int rows = 50000;
+  Table table;
+  build_table(table, rows, 50);
+
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(1280);
+
+  LayoutTree uncached = build_layout_tree(table.root);
+  double uncached_ms = time_ms(1, [&] { uncached.layout(viewport); });
+  std::cout << rows << " rows, " << uncached.size()
+            << " boxes: no cache " << uncached_ms << "ms" << std::endl;
+
+  LayoutCache cache;
+  LayoutTree cold = build_layout_tree(table.root);
+  cold.cache = &cache;
+  double cold_ms = time_ms(1, [&] { cold.layout(viewport); });
+  std::cout << "empty cache " << cold_ms << "ms: " << cache.hits << " hits "
+            << cache.misses << " misses " << cache.entries.size()
+            << " entries" << std::endl;
+
+  // a second document with the same rows, like another open report
+  size_t hits = cache.hits, misses = cache.misses;
+  LayoutTree warm = build_layout_tree(table.root);
+  warm.cache = &cache;
+  double warm_ms = time_ms(1, [&] { warm.layout(viewport); });
+  std::cout << "warm cache " << warm_ms << "ms: " << cache.hits - hits
+            << " hits " << cache.misses - misses << " misses" << std::endl;
+
+  bool ok = same_geometry(uncached, cold) && same_geometry(uncached, warm);
+  if (!ok) {
+    std::cout << "MISMATCH between cached and uncached layout" << std::endl;
+  }
+  return ok ? 0 : 1;
+}
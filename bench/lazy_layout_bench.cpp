@@ -0,0 +1,73 @@
+// Lazy layout of a long document of paragraphs, like a big log file. Only
+// the part around the viewport is laid out and painted, the rest gets
+// estimated heights.
+//
+//   make bench && ./bench/lazy_layout_bench.exe
+
+#include "bench_common.cpp"
+#include "painter.cpp"
+
+bool run(int paragraphs) {
+  Document doc;
+  build_document(doc, paragraphs);
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(1280);
+  Rect screen{LayoutUnit(), LayoutUnit(), LayoutUnit::from_px(1280),
+              LayoutUnit::from_px(720)};
+
+  LayoutTree eager;
+  double build_ms = time_ms(1, [&] { eager = build_layout_tree(doc.root); });
+  size_t eager_items = 0;
+  double eager_ms = time_ms(1, [&] {
+    eager.layout(viewport);
+    eager_items = build_display_list(eager).size();
+  });
+
+  LayoutTree lazy = build_layout_tree(doc.root);
+  lazy.lazy = true;
+  lazy.viewport = screen;
+  size_t lazy_items = 0;
+  double lazy_ms = time_ms(1, [&] {
+    lazy.layout(viewport);
+    lazy_items = build_display_list(lazy).size();
+  });
+  LayoutUnit estimated = lazy[lazy.root].dims.margin_box().height;
+
+  std::cout << paragraphs << " paragraphs: build " << build_ms
+            << "ms, eager layout+paint " << eager_ms << "ms (" << eager_items
+            << " items), lazy " << lazy_ms << "ms (" << lazy_items
+            << " items, " << lazy.stats.laid_out << " laid out)" << std::endl;
+
+  // jump to the middle, placeholders above get real heights and the
+  // scroll offset follows so the same content stays on screen
+  lazy.viewport.y = estimated / 2;
+  double jump_ms = time_ms(1, [&] {
+    lazy.layout(viewport);
+    build_display_list(lazy);
+  });
+  lazy.viewport.y += lazy.stats.scroll_adjustment;
+  std::cout << "  jump to middle " << jump_ms << "ms, scroll adjusted by "
+            << lazy.stats.scroll_adjustment << ", height estimate "
+            << estimated << " -> "
+            << lazy[lazy.root].dims.margin_box().height << ", real "
+            << eager[eager.root].dims.margin_box().height << std::endl;
+
+  // with everything in view it has to match the eager layout exactly
+  lazy.viewport.y = LayoutUnit();
+  lazy.viewport.height = eager[eager.root].dims.margin_box().height;
+  lazy.layout(viewport);
+  bool ok = same_geometry(eager, lazy) &&
+            build_display_list(lazy).size() == eager_items;
+  if (!ok) {
+    std::cout << "MISMATCH between lazy and eager layout" << std::endl;
+  }
+  return ok;
+}
+
+int main() {
+  bool ok = true;
+  for (int paragraphs : {1000, 10000, 100000}) {
+    ok = run(paragraphs) && ok;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,269 @@
+// Every stage of the pipeline on its own, from source text to display list,
+// for synthetic documents of 1k nodes up to --max-nodes. The documents and
+// style sheets come from generators with knobs for the shape of the tree
+// and the mix of selectors, so scaling curves can be tracked for different
+// kinds of pages. Prints JSON, one entry per document size:
+//
+//   make bench && ./bench/pipeline_bench.exe > pipeline.json
+//   ./bench/pipeline_bench.exe --max-nodes 10000000 --depth 12 --fanout 4
+//
+// Problems go to stderr and make the exit code 1.
+
+#include <cstring>
+#include <random>
+#include <sstream>
+
+#include "bench_common.cpp"
+#include "css_parser.cpp"
+#include "html_parser.cpp"
+#include "painter.cpp"
+
+struct HtmlParams {
+  size_t nodes = 1000;
+  // deepest nesting below the root; the root takes as many subtrees as it
+  // needs to reach `nodes`
+  int depth = 8;
+  int fanout = 4;
+  // the share of children that are text instead of elements
+  double text_ratio = 0.4;
+  // per element, on top of id and class
+  int attributes = 1;
+  int words = 8;
+  uint32_t seed = 1;
+};
+
+struct CssParams {
+  size_t rules = 200;
+  // weights of the kinds of selectors: div, .c3, #n42 and div.c3
+  int type = 1, klass = 4, id = 1, compound = 2;
+  int declarations = 4;
+  uint32_t seed = 2;
+};
+
+const char *TAGS[] = {"div", "p", "span", "section", "ul", "li", "em", "a"};
+const int TAG_COUNT = 8;
+// classes are c0 .. c(CLASS_COUNT - 1)
+const int CLASS_COUNT = 64;
+const char *WORDS[] = {"lorem", "ipsum", "dolor", "sit",  "amet",
+                       "elit",  "sed",   "do",    "magna", "aliqua"};
+
+struct HtmlGenerator {
+  const HtmlParams &params;
+  std::mt19937 random;
+  std::string out;
+  size_t left;
+  size_t next_id = 0;
+
+  explicit HtmlGenerator(const HtmlParams &p)
+      : params(p), random(p.seed), left(p.nodes) {}
+
+  void text() {
+    this->left--;
+    for (int w = 0; w < this->params.words; w++) {
+      this->out += WORDS[this->random() % 10];
+      this->out += ' ';
+    }
+  }
+
+  void element(int depth) {
+    this->left--;
+    const char *tag = TAGS[this->random() % TAG_COUNT];
+    this->out += '<';
+    this->out += tag;
+    this->out += " id=\"n" + std::to_string(this->next_id++) + "\"";
+    this->out +=
+        " class=\"c" + std::to_string(this->random() % CLASS_COUNT) + "\"";
+    for (int a = 0; a < this->params.attributes; a++) {
+      this->out += " data" + std::to_string(a) + "=\"v" +
+                   std::to_string(this->random() % 1000) + "\"";
+    }
+    this->out += '>';
+    if (depth < this->params.depth) {
+      // two text nodes in a row would parse as one
+      bool after_text = false;
+      for (int c = 0; c < this->params.fanout && this->left > 0; c++) {
+        double roll = std::uniform_real_distribution<>()(this->random);
+        bool is_text = !after_text && roll < this->params.text_ratio;
+        if (is_text) {
+          this->text();
+        } else {
+          this->element(depth + 1);
+        }
+        after_text = is_text;
+      }
+    }
+    this->out += "</";
+    this->out += tag;
+    this->out += '>';
+  }
+};
+
+std::string generate_html(const HtmlParams &params) {
+  HtmlGenerator generator(params);
+  generator.out.reserve(params.nodes * 64);
+  generator.left--;
+  generator.out += "<html>";
+  while (generator.left > 0) {
+    generator.element(1);
+  }
+  generator.out += "</html>";
+  return generator.out;
+}
+
+// rules for the tags, classes and ids generate_html uses, about one in
+// three setting display: block
+std::string generate_css(const CssParams &params, size_t ids) {
+  std::mt19937 random(params.seed);
+  const char *properties[] = {"margin", "padding", "border-width",
+                              "font-size"};
+  int total = params.type + params.klass + params.id + params.compound;
+  std::string out;
+  for (size_t r = 0; r < params.rules; r++) {
+    int kind = static_cast<int>(random() % std::max(total, 1));
+    std::string tag = TAGS[random() % TAG_COUNT];
+    std::string klass = "c" + std::to_string(random() % CLASS_COUNT);
+    if (kind < params.type) {
+      out += tag;
+    } else if ((kind -= params.type) < params.klass) {
+      out += "." + klass;
+    } else if ((kind -= params.klass) < params.id) {
+      out += "#n" + std::to_string(random() % std::max<size_t>(ids, 1));
+    } else {
+      out += tag + "." + klass;
+    }
+    out += " {";
+    for (int d = 0; d < params.declarations; d++) {
+      if (d == 0 && random() % 3 == 0) {
+        out += " display: block;";
+        continue;
+      }
+      const char *property = properties[random() % 4];
+      int px = std::strcmp(property, "font-size") == 0 ? 10 + random() % 12
+                                                       : random() % 6;
+      out += std::string(" ") + property + ": " + std::to_string(px) + "px;";
+    }
+    out += " }\n";
+  }
+  return out;
+}
+
+size_t count_dom_nodes(const Node *node) {
+  size_t count = 1;
+  for (const Node *child : node->children) {
+    count += count_dom_nodes(child);
+  }
+  return count;
+}
+
+struct Stage {
+  const char *name;
+  double ms;
+  size_t allocations;
+};
+
+template <typename F> Stage measure(const char *name, F f) {
+  size_t before = allocations;
+  double ms = time_ms(1, f);
+  return Stage{name, ms, allocations - before};
+}
+
+// one document through every stage, as a JSON object
+bool run(const HtmlParams &html_params, const CssParams &css_params,
+         std::ostream &json) {
+  std::string html = generate_html(html_params);
+  std::string css = generate_css(css_params, html_params.nodes);
+  std::vector<Stage> stages;
+
+  Node *dom = nullptr;
+  stages.push_back(measure("parse_html", [&] { dom = parse_html(html); }));
+  StyleSheet sheet;
+  stages.push_back(measure("parse_css", [&] { sheet = parse_css(css); }));
+  StyledNode styled;
+  stages.push_back(
+      measure("style_tree", [&] { styled = style_tree(dom, sheet); }));
+  LayoutTree tree;
+  stages.push_back(measure("build_layout_tree",
+                           [&] { tree = build_layout_tree(styled); }));
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(1280);
+  stages.push_back(measure("layout", [&] { tree.layout(viewport); }));
+  DisplayList list;
+  stages.push_back(measure("build_display_list",
+                           [&] { list = build_display_list(tree); }));
+
+  size_t nodes = count_dom_nodes(dom);
+  bool ok = nodes == html_params.nodes &&
+            sheet.rules.size() == css_params.rules &&
+            count_styled_nodes(styled) == nodes;
+  if (!ok) {
+    std::cerr << "MISMATCH: asked for " << html_params.nodes << " nodes and "
+              << css_params.rules << " rules, got " << nodes << " and "
+              << sheet.rules.size() << std::endl;
+  }
+
+  json << "    {\"nodes\": " << nodes << ", \"html_bytes\": " << html.size()
+       << ", \"rules\": " << sheet.rules.size()
+       << ", \"css_bytes\": " << css.size() << ", \"boxes\": " << tree.size()
+       << ", \"commands\": " << list.size() << ", \"stages\": {";
+  for (size_t i = 0; i < stages.size(); i++) {
+    const Stage &stage = stages[i];
+    json << (i == 0 ? "" : ", ") << "\"" << stage.name << "\": {\"ms\": "
+         << stage.ms << ", \"ns_per_node\": " << stage.ms * 1e6 / nodes
+         << ", \"allocations\": " << stage.allocations << "}";
+  }
+  json << "}}";
+  // TODO the DOM leaks, see Node
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  HtmlParams html;
+  CssParams css;
+  size_t max_nodes = 1000000;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string flag = argv[i];
+    double value = std::atof(argv[i + 1]);
+    if (flag == "--max-nodes") {
+      max_nodes = static_cast<size_t>(value);
+    } else if (flag == "--depth") {
+      html.depth = static_cast<int>(value);
+    } else if (flag == "--fanout") {
+      html.fanout = static_cast<int>(value);
+    } else if (flag == "--text-ratio") {
+      html.text_ratio = value;
+    } else if (flag == "--attributes") {
+      html.attributes = static_cast<int>(value);
+    } else if (flag == "--rules") {
+      css.rules = static_cast<size_t>(value);
+    } else if (flag == "--declarations") {
+      css.declarations = static_cast<int>(value);
+    } else {
+      std::cerr << "unknown flag " << flag << std::endl;
+      return 2;
+    }
+  }
+  html.depth = std::max(html.depth, 1);
+  html.fanout = std::max(html.fanout, 1);
+
+  std::ostringstream json;
+  json << "{\n  \"html\": {\"depth\": " << html.depth
+       << ", \"fanout\": " << html.fanout
+       << ", \"text_ratio\": " << html.text_ratio
+       << ", \"attributes\": " << html.attributes
+       << ", \"words\": " << html.words << "},\n  \"css\": {\"rules\": "
+       << css.rules << ", \"declarations\": " << css.declarations
+       << ", \"selectors\": {\"type\": " << css.type
+       << ", \"class\": " << css.klass << ", \"id\": " << css.id
+       << ", \"compound\": " << css.compound << "}},\n  \"runs\": [\n";
+  bool ok = true;
+  for (size_t nodes = 1000; nodes <= max_nodes; nodes *= 10) {
+    html.nodes = nodes;
+    if (nodes != 1000) {
+      json << ",\n";
+    }
+    ok = run(html, css, json) && ok;
+  }
+  json << "\n  ]\n}\n";
+  std::cout << json.str();
+  return ok ? 0 : 1;
+}
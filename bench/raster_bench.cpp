@@ -0,0 +1,145 @@
+// Fill rate of the software rasterizer's span kernels, in megapixels per
+// second, and the time to rasterize a screen of a text page. Text of any
+// size has to stay inside its paint_bounds(), which culling and damage go
+// by.
+//
+//   make bench && ./bench/raster_bench.exe
+
+#include "bench_common.cpp"
+#include "painter.cpp"
+#include "raster.cpp"
+
+struct Kernel {
+  const char *name;
+  FillSpan fill;
+};
+
+// `count` rects of `size` pixels spread over the framebuffer
+double fill_rate(Framebuffer &fb, FillSpan fill, int size, int count) {
+  PixelRect clip{0, 0, fb.width, fb.height};
+  double ms = time_ms(1, [&] {
+    for (int i = 0; i < count; i++) {
+      PixelRect r = intersect(
+          PixelRect{(i * 97) % fb.width, (i * 61) % fb.height, size, size},
+          clip);
+      for (int y = r.y; y < r.y + r.height; y++) {
+        fill(fb.row(y) + r.x, r.width, 0xff000000 | i);
+      }
+    }
+  });
+  // only what landed on screen counts
+  double pixels = 0;
+  for (int i = 0; i < count; i++) {
+    PixelRect r = intersect(
+        PixelRect{(i * 97) % fb.width, (i * 61) % fb.height, size, size},
+        clip);
+    pixels += double(r.width) * r.height;
+  }
+  return pixels / (ms * 1000);
+}
+
+// every glyph pixel of a line of text at `px` inside paint_bounds()
+bool check_text_bounds(int px) {
+  Document doc;
+  doc.texts.push_back(std::make_unique<TextNode>("Wg|jy Q"));
+  StyledNode text;
+  text.node = doc.texts.back().get();
+  doc.root = block_node();
+  doc.root.values.erase("height");
+  doc.root.values["font-size"] = Length{float(px), Unit::px};
+  doc.root.children.push_back(text);
+  LayoutTree tree = build_layout_tree(doc.root);
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(px * 8);
+  tree.layout(viewport);
+  DisplayList all = build_display_list(tree), texts;
+  for (const CommandHeader &command : all) {
+    if (command.op() == DisplayOp::TEXT) {
+      texts.push_command(command, 0);
+    }
+  }
+  texts.build_index();
+
+  // room around the page for glyphs that reach out of it
+  int margin = px * 2;
+  Framebuffer fb(px * 8 + 2 * margin, px * 4 + 2 * margin);
+  fb.clear(0xffffffff);
+  rasterize(texts, fb, -margin, -margin);
+  size_t inked = 0, outside = 0;
+  for (int y = 0; y < fb.height; y++) {
+    for (int x = 0; x < fb.width; x++) {
+      if (fb.row(y)[x] == 0xffffffff) {
+        continue;
+      }
+      inked++;
+      bool in_bounds = false;
+      for (const CommandHeader &command : texts) {
+        PixelRect r = paint_bounds(command).rect().snapped();
+        in_bounds = in_bounds || (x - margin >= r.x && y - margin >= r.y &&
+                                  x - margin < r.x + r.width &&
+                                  y - margin < r.y + r.height);
+      }
+      outside += !in_bounds;
+    }
+  }
+  if (inked == 0 || outside != 0) {
+    std::cout << "MISMATCH: text at " << px << "px inked " << inked
+              << " pixels, " << outside << " outside its paint bounds"
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+int main() {
+  std::vector<Kernel> kernels = {{"scalar", fill_span_scalar},
+                                 {"sse2", fill_span_sse2}};
+#if defined(RASTER_AVX_DISPATCH)
+  if (__builtin_cpu_supports("avx")) {
+    kernels.push_back({"avx", fill_span_avx});
+  }
+#endif
+
+  bool ok = true;
+  struct Case {
+    int size, count;
+  };
+  for (Case c : {Case{1920, 50}, Case{256, 2000}, Case{16, 200000}}) {
+    std::cout << c.count << " rects of " << c.size << "x" << c.size << ":";
+    Framebuffer reference;
+    for (const Kernel &kernel : kernels) {
+      Framebuffer fb(1920, 1080);
+      double rate = fill_rate(fb, kernel.fill, c.size, c.count);
+      std::cout << " " << kernel.name << " " << rate << " MP/s";
+      if (reference.pixels.empty()) {
+        reference = fb;
+      } else if (count_different_pixels(reference, fb) != 0) {
+        std::cout << " MISMATCH";
+        ok = false;
+      }
+    }
+    std::cout << std::endl;
+  }
+
+  Document doc;
+  build_document(doc, 1000);
+  LayoutTree tree = build_layout_tree(doc.root);
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(1280);
+  tree.layout(viewport);
+  DisplayList list = build_display_list(tree);
+  Framebuffer fb(1280, 720);
+  // the first frame fills the glyph cache
+  rasterize(list, fb);
+  double frame_ms = time_ms(20, [&] {
+    fb.clear(0xffffffff);
+    rasterize(list, fb, 0, 5000);
+  });
+  std::cout << "text page 1280x720: " << frame_ms << "ms per frame"
+            << std::endl;
+
+  for (int px : {16, 64, 200, 400}) {
+    ok = check_text_bounds(px) && ok;
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+// Selector matching and the parser underneath the HTML and CSS parsers.
+// Every part a selector has must match and the parts it lacks match
+// anything; Parser::starts_with compares in place, so parsing stays linear.
+// Then styling against sheets whose rules match nothing has to make as many
+// heap allocations as styling against an empty sheet, so matching itself
+// allocates nothing.
+//
+//   make bench && ./bench/style_bench.exe
+//
+// Problems print MISMATCH and make the exit code 1.
+
+#include "bench_common.cpp"
+#include "css_parser.cpp"
+#include "html_parser.cpp"
+
+struct SelectorCase {
+  const char *selector;
+  bool matches;
+};
+
+// all against <div id="main" class="c1 c10 wide">
+bool check_selectors() {
+  ElementNode div("div", {{"id", "main"}, {"class", "c1 c10 wide"}});
+  SelectorCase cases[] = {
+      {"div", true},          {"p", false},
+      {"#main", true},        {"#other", false},
+      {".c1", true},          {".c10", true},
+      {".c", false},          {".c100", false},
+      {".wide", true},        {".c1.wide", true},
+      {".c1.narrow", false},  {"div.c10", true},
+      {"p.c10", false},       {"div#main.c1", true},
+      {"div#other.c1", false}, {"*", true},
+  };
+  bool ok = true;
+  for (const SelectorCase &c : cases) {
+    StyleSheet sheet = parse_css(std::string(c.selector) + " { margin: 1px; }");
+    bool matches = matches_selector(div, sheet.rules[0].selectors[0]);
+    if (matches != c.matches) {
+      std::cout << "MISMATCH: " << c.selector << " should "
+                << (c.matches ? "" : "not ") << "match" << std::endl;
+      ok = false;
+    }
+  }
+
+  ElementNode bare("div", {});
+  StyleSheet sheet = parse_css(".c1 { margin: 1px; }");
+  if (matches_selector(bare, sheet.rules[0].selectors[0])) {
+    std::cout << "MISMATCH: .c1 matches an element without classes"
+              << std::endl;
+    ok = false;
+  }
+  return ok;
+}
+
+bool check_starts_with() {
+  Parser parser("<p></p>");
+  parser.position = 3;
+  bool ok = parser.starts_with("</") && parser.starts_with("</p>") &&
+            !parser.starts_with("</p> ") && !parser.starts_with("<p");
+  parser.position = 7;
+  ok = ok && !parser.starts_with("</");
+  if (!ok) {
+    std::cout << "MISMATCH: starts_with" << std::endl;
+  }
+  return ok;
+}
+
+// rows of a span with a few classes each, about `nodes` DOM nodes in total
+Node *build_rows(int nodes) {
+  std::vector<Node *> rows;
+  for (int n = 1; n < nodes; n += 3) {
+    std::vector<Node *> cells = {createElement(
+        "span", {{"class", "cell c" + std::to_string(n % 64)}},
+        {createText("cell")})};
+    rows.push_back(createElement("div", {{"id", "r" + std::to_string(n)}},
+                                 cells));
+  }
+  return createElement("div", {}, rows);
+}
+
+// rules of every kind that match no element of build_rows
+std::string unmatched_rules(int rules) {
+  std::string css;
+  for (int r = 0; r < rules; r++) {
+    std::string n = std::to_string(r);
+    switch (r % 4) {
+    case 0:
+      css += "p";
+      break;
+    case 1:
+      css += ".other" + n;
+      break;
+    case 2:
+      css += "#other" + n;
+      break;
+    case 3:
+      css += "span.cell.other" + n;
+      break;
+    }
+    css += " { margin: 1px; }\n";
+  }
+  return css;
+}
+
+bool check_matching_allocations(int nodes) {
+  Node *dom = build_rows(nodes);
+  StyleSheet empty;
+  StyleSheet sheet = parse_css(unmatched_rules(200));
+
+  StyledNode styled;
+  size_t before = allocations;
+  double empty_ms = time_ms(1, [&] { styled = style_tree(dom, empty); });
+  size_t empty_allocations = allocations - before;
+
+  before = allocations;
+  double ms = time_ms(1, [&] { styled = style_tree(dom, sheet); });
+  size_t matching_allocations = allocations - before;
+
+  size_t count = count_styled_nodes(styled);
+  std::cout << count << " nodes, " << sheet.rules.size()
+            << " rules that match nothing: " << ms << "ms ("
+            << ms * 1e6 / count / sheet.rules.size()
+            << "ns per rule and node), " << matching_allocations
+            << " allocations; no rules " << empty_ms << "ms, "
+            << empty_allocations << " allocations" << std::endl;
+  // TODO the DOM leaks, see Node
+  if (matching_allocations != empty_allocations) {
+    std::cout << "MISMATCH: matching selectors allocated "
+              << matching_allocations - empty_allocations << " times"
+              << std::endl;
+    return false;
+  }
+  return true;
+}
+
+int main() {
+  bool ok = check_selectors();
+  ok = check_starts_with() && ok;
+  ok = check_matching_allocations(100000) && ok;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+// Tiled rasterization of a 4K screen of a text page: a cold frame, the same
+// frame again, a small scroll and a change to one paragraph. Every frame is
+// checked against the plain rasterizer.
+//
+//   make bench && ./bench/tile_raster_bench.exe
+
+#include "bench_common.cpp"
+#include "painter.cpp"
+#include "tile_raster.cpp"
+
+const PackedColor WHITE = 0xffffffff;
+
+bool check(const char *name, const DisplayList &list, const Framebuffer &fb,
+           int origin_y) {
+  Framebuffer expected(fb.width, fb.height);
+  expected.clear(WHITE);
+  rasterize(list, expected, 0, origin_y);
+  size_t different = count_different_pixels(expected, fb);
+  if (different != 0) {
+    std::cout << "MISMATCH after " << name << ": " << different
+              << " pixels differ" << std::endl;
+  }
+  return different == 0;
+}
+
+void report(const char *name, double ms, const TileRasterizer &tiles) {
+  std::cout << "  " << name << " " << ms << "ms, " << tiles.stats.rastered
+            << " of " << tiles.stats.tiles << " tiles rastered" << std::endl;
+}
+
+int main() {
+  Document doc;
+  build_document(doc, 2000);
+  LayoutTree tree = build_layout_tree(doc.root);
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(3840);
+  tree.layout(viewport);
+  DisplayList list = build_display_list(tree);
+  Framebuffer fb(3840, 2160);
+  int scroll = 5000;
+
+  // warm the glyph cache so the first frames compare fairly
+  rasterize(list, fb, 0, scroll);
+  double plain_ms = time_ms(1, [&] {
+    fb.clear(WHITE);
+    rasterize(list, fb, 0, scroll);
+  });
+  std::cout << "3840x2160, plain rasterizer " << plain_ms << "ms"
+            << std::endl;
+
+  bool ok = true;
+  ThreadPool pool;
+  for (ThreadPool *p : {static_cast<ThreadPool *>(nullptr), &pool}) {
+    TileRasterizer tiles;
+    tiles.pool = p;
+    std::cout << "tiled, " << (p ? p->size() : 1) << " threads" << std::endl;
+
+    double ms = time_ms(1, [&] {
+      tiles.rasterize(list, fb, 0, scroll, WHITE);
+    });
+    report("cold", ms, tiles);
+    ok = check("cold", list, fb, scroll) && ok;
+
+    ms = time_ms(1, [&] { tiles.rasterize(list, fb, 0, scroll, WHITE); });
+    report("same frame", ms, tiles);
+    ok = check("same frame", list, fb, scroll) && ok;
+
+    ms = time_ms(1, [&] {
+      tiles.rasterize(list, fb, 0, scroll + 3, WHITE);
+    });
+    report("scroll 3px", ms, tiles);
+    ok = check("scroll", list, fb, scroll + 3) && ok;
+  }
+
+  // change a word in a paragraph on screen, only its lines move
+  TileRasterizer tiles;
+  tiles.pool = &pool;
+  tiles.rasterize(list, fb, 0, scroll, WHITE);
+  TextNode *text = nullptr;
+  for (BoxId id = 0; id < tree.size() && text == nullptr; id++) {
+    const LayoutBox &box = tree[id];
+    if (box.type == BoxType::b_ANON && !box.fragments.empty() &&
+        box.dims.content.y > LayoutUnit::from_px(scroll + 1000)) {
+      BoxId inline_box = box.fragments[0].box;
+      text = static_cast<TextNode *>(tree[inline_box].style->node);
+      tree.mark_needs_layout(inline_box);
+    }
+  }
+  text->content.replace(0, 3, "PUT");
+  double ms = time_ms(1, [&] {
+    tree.layout(viewport);
+    list = build_display_list(tree);
+    tiles.rasterize(list, fb, 0, scroll, WHITE);
+  });
+  report("edit one paragraph (layout, paint and raster)", ms, tiles);
+  ok = check("edit", list, fb, scroll) && ok;
+  return ok ? 0 : 1;
+}
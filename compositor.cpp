@@ -0,0 +1,469 @@
+#ifndef COMPOSITOR_CPP
+#define COMPOSITOR_CPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "damage.cpp"
+#include "geometry_table.cpp"
+#include "painter.cpp"
+#include "raster.cpp"
+
+// Runs shorter than this are blended along with their neighbours, blending
+// an opaque pixel copies it and blending a transparent one keeps what is
+// under it, and a short run costs more to go through than to blend.
+const int MIN_SURFACE_RUN = 16;
+
+// pixels of a surface row that go on screen, the rest is transparent
+struct SurfaceRun {
+  int x, width;
+  // copied, not blended
+  bool opaque;
+};
+
+// A layer rasterized on its own, transparent where it paints nothing. It
+// covers what is on screen of the layer and up to `margin_screens` more in
+// every direction, as far as the layer has content. The root layer is
+// painted on the page background, so all of it is opaque.
+struct LayerSurface {
+  Framebuffer pixels;
+  // page position of the top left pixel
+  int x = 0, y = 0;
+  // of the list it was painted from, 0 before the first paint
+  uint64_t version = 0;
+  // what is under the commands, transparent but for the root layer
+  PackedColor background = 0;
+  // the runs of row y are runs[row_runs[y]] up to runs[row_runs[y + 1]]
+  std::vector<SurfaceRun> runs;
+  std::vector<uint32_t> row_runs;
+};
+
+// Splits every row of `surface` into runs to copy and runs to blend, or
+// makes every row one run to copy.
+void index_runs(LayerSurface &surface, bool copy_all) {
+  const Framebuffer &fb = surface.pixels;
+  surface.runs.clear();
+  surface.row_runs.assign(1, 0);
+  for (int y = 0; y < fb.height; y++) {
+    const uint32_t *row = fb.row(y);
+    size_t first = surface.runs.size();
+    int x = 0;
+    if (copy_all) {
+      surface.runs.push_back(SurfaceRun{0, fb.width, true});
+      x = fb.width;
+    }
+    while (x < fb.width) {
+      uint32_t alpha = row[x] >> 24;
+      int end = x + 1;
+      while (end < fb.width && row[end] >> 24 == alpha) {
+        end++;
+      }
+      if (alpha == 0 && end - x >= MIN_SURFACE_RUN) {
+        x = end;
+        continue;
+      }
+      bool opaque = alpha == 255 && end - x >= MIN_SURFACE_RUN;
+      SurfaceRun *last = surface.runs.size() > first ? &surface.runs.back()
+                                                     : nullptr;
+      if (last && last->x + last->width == x && !last->opaque && !opaque) {
+        last->width += end - x;
+      } else {
+        surface.runs.push_back(SurfaceRun{x, end - x, opaque});
+      }
+      x = end;
+    }
+    surface.row_runs.push_back(static_cast<uint32_t>(surface.runs.size()));
+  }
+}
+
+struct ScrollOffset {
+  int x = 0, y = 0;
+};
+
+struct CompositorStats {
+  size_t composites = 0;
+  // layers rasterized into their surface, and the pixels that took
+  size_t painted = 0;
+  size_t painted_pixels = 0;
+  // how much of the screen the last composite() showed changed since the
+  // frame before, because set_layers() gave layers new content
+  double damaged_percent = 0;
+};
+
+bool contains(const PixelRect &outer, const PixelRect &inner) {
+  return inner.x >= outer.x && inner.y >= outer.y &&
+         inner.x + inner.width <= outer.x + outer.width &&
+         inner.y + inner.height <= outer.y + outer.height;
+}
+
+// Puts the layers of a page on screen at their scroll offsets. Every layer
+// is rasterized into a surface of its own that is kept across frames, so
+// scrolling the page or a scroll container only moves surfaces around; a
+// layer is rasterized again when its list changes or it is scrolled past
+// what its surface covers.
+//
+// Layers go on screen in tree order, which is paint order because a layer
+// is split at the scroll containers in it, fixed ones and the layers in them
+// last.
+//
+// New lists for the layers are diffed against the old ones, and only the
+// damage is rasterized again into the surfaces that are kept.
+struct Compositor {
+  LayerList layers;
+  // all of these have one entry per layer
+  std::vector<LayerSurface> surfaces;
+  // how far each layer is scrolled, the root layer by the viewport; a layer
+  // continuing another one goes by the scroll of that one
+  std::vector<ScrollOffset> scroll;
+  // what the commands cover, with those of the layers continuing it, and
+  // what they can paint, in page pixels
+  std::vector<PixelRect> content;
+  std::vector<PixelRect> painted;
+  // what set_layers() changed, in page pixels, until it is composited
+  std::vector<Damage> damage;
+  // Where the boxes are on the page as it is scrolled, to find what is
+  // under the mouse: the children of a scroll container moved by its
+  // offset, fixed boxes by the page's. Empty unless set_geometry() was
+  // called after set_layers().
+  GeometryTable geometry;
+
+  int margin_screens = 1;
+  CompositorStats stats;
+
+  // The layer the one at `index` of `list` takes over from, the same box
+  // and for layers continuing another one the same place among those.
+  // layers.size() for none.
+  size_t previous_layer(const LayerList &list, size_t index) const {
+    size_t nth = 0;
+    for (size_t i = 0; i < index; i++) {
+      if (list[i].box == list[index].box) {
+        nth++;
+      }
+    }
+    for (size_t old = 0; old < this->layers.size(); old++) {
+      if (this->layers[old].box == list[index].box &&
+          this->layers[old].kind == list[index].kind && nth-- == 0) {
+        return old;
+      }
+    }
+    return this->layers.size();
+  }
+
+  // The layers of a new display list. Scroll offsets and surfaces stay
+  // with their boxes, and the surfaces are repainted where the lists differ.
+  void set_layers(LayerList new_layers) {
+    std::vector<ScrollOffset> new_scroll(new_layers.size());
+    std::vector<LayerSurface> new_surfaces(new_layers.size());
+    this->damage.assign(new_layers.size(), Damage());
+    for (size_t i = 0; i < new_layers.size(); i++) {
+      size_t old = this->previous_layer(new_layers, i);
+      if (old == this->layers.size()) {
+        this->damage[i].full = true;
+        continue;
+      }
+      new_scroll[i] = this->scroll[old];
+      new_surfaces[i] = std::move(this->surfaces[old]);
+      this->damage[i] =
+          diff_display_lists(this->layers[old].list, new_layers[i].list);
+    }
+    this->layers = std::move(new_layers);
+    this->scroll = std::move(new_scroll);
+    this->surfaces = std::move(new_surfaces);
+    for (size_t i = 0; i < this->layers.size(); i++) {
+      LayerSurface &surface = this->surfaces[i];
+      if (surface.version == 0) {
+        continue;
+      }
+      repaint_damage(this->layers[i].list, surface.pixels, surface.x,
+                     surface.y, surface.background, this->damage[i]);
+      index_runs(surface, i == 0);
+      surface.version = this->layers[i].list.version;
+    }
+    this->content.assign(this->layers.size(), PixelRect());
+    this->painted.assign(this->layers.size(), PixelRect());
+    std::vector<bool> any(this->layers.size());
+    for (size_t i = 0; i < this->layers.size(); i++) {
+      size_t scrolled = this->layers[i].continues;
+      bool first = true;
+      for (const CommandHeader &command : this->layers[i].list) {
+        PixelRect box = command_bounds(command).rect().snapped();
+        PixelRect ink = paint_bounds(command).rect().snapped();
+        this->content[scrolled] = any[scrolled]
+                                      ? union_of(this->content[scrolled], box)
+                                      : box;
+        this->painted[i] = first ? ink : union_of(this->painted[i], ink);
+        any[scrolled] = true;
+        first = false;
+      }
+    }
+  }
+
+  // Takes the geometry of the layout the layers were painted from, and
+  // moves it by the offsets the layers are scrolled by.
+  void set_geometry(GeometryTable table) {
+    this->geometry = std::move(table);
+    for (size_t i = 0; i < this->layers.size(); i++) {
+      if (this->layers[i].continues == i &&
+          this->layers[i].kind != LayerKind::FIXED) {
+        this->move_geometry(i, this->scroll[i].x, this->scroll[i].y);
+      }
+    }
+  }
+
+  // Moves the geometry for layer `index` scrolling by (dx, dy): the page
+  // is not moved, points are moved onto it instead, the children of a
+  // scroll container go the other way, and fixed boxes in what scrolled
+  // stay where they are on screen.
+  void move_geometry(size_t index, int dx, int dy) {
+    if (this->geometry.size() == 0) {
+      return;
+    }
+    LayoutUnit x = LayoutUnit::from_px(dx), y = LayoutUnit::from_px(dy);
+    BoxId first = 0;
+    size_t count = this->geometry.size();
+    const Layer &layer = this->layers[index];
+    if (layer.kind == LayerKind::SCROLL) {
+      first = layer.box + 1;
+      count = this->geometry.subtree_size[layer.box] - 1;
+      this->geometry.translate(first, count, -x, -y);
+    }
+    for (const Layer &fixed : this->layers) {
+      if (fixed.kind == LayerKind::FIXED && fixed.box >= first &&
+          fixed.box < first + count) {
+        this->geometry.translate(fixed.box,
+                                 this->geometry.subtree_size[fixed.box], x, y);
+      }
+    }
+  }
+
+  // The layer a scroll at (x, y) on screen goes to: the innermost scroll
+  // container with its padding box under the point, or the page.
+  size_t layer_at(int x, int y) const {
+    if (this->geometry.size() == 0 || this->layers.empty()) {
+      return 0;
+    }
+    LayoutUnit px = LayoutUnit::from_px(x + this->scroll[0].x);
+    LayoutUnit py = LayoutUnit::from_px(y + this->scroll[0].y);
+    for (BoxId box = this->geometry.hit_test(px, py); box != NO_BOX;
+         box = this->geometry.parent[box]) {
+      Rect clip = this->geometry.padding_box(box);
+      if (px < clip.x || px >= clip.x + clip.width || py < clip.y ||
+          py >= clip.y + clip.height) {
+        continue;
+      }
+      for (size_t i = 0; i < this->layers.size(); i++) {
+        const Layer &layer = this->layers[i];
+        if (layer.kind == LayerKind::SCROLL && layer.box == box &&
+            layer.continues == i) {
+          return i;
+        }
+      }
+    }
+    return 0;
+  }
+
+  // the part of the page layer `index` shows through, in page pixels
+  PixelRect page_clip(size_t index, const PixelRect &viewport) const {
+    if (this->layers[index].kind == LayerKind::SCROLL) {
+      return this->layers[index].clip.snapped();
+    }
+    return PixelRect{0, 0, viewport.width, viewport.height};
+  }
+
+  // scrolls a layer by (dx, dy), but not past its content; fixed layers
+  // do not scroll
+  void scroll_by(size_t index, int dx, int dy, const PixelRect &viewport) {
+    if (this->layers[index].kind == LayerKind::FIXED) {
+      return;
+    }
+    index = this->layers[index].continues;
+    PixelRect clip = this->page_clip(index, viewport);
+    const PixelRect &c = this->content[index];
+    int max_x = std::max(c.x + c.width - clip.x - clip.width, 0);
+    int max_y = std::max(c.y + c.height - clip.y - clip.height, 0);
+    ScrollOffset &s = this->scroll[index];
+    ScrollOffset before = s;
+    s.x = std::clamp(s.x + dx, 0, max_x);
+    s.y = std::clamp(s.y + dy, 0, max_y);
+    this->move_geometry(index, s.x - before.x, s.y - before.y);
+  }
+
+  // Where layer `index` goes on the screen: a page position minus
+  // `offset`, only inside `clip`. Parents come first, so their placement
+  // is already in the vectors.
+  void place(size_t index, const PixelRect &viewport,
+             std::vector<ScrollOffset> &offsets,
+             std::vector<PixelRect> &clips) const {
+    const Layer &layer = this->layers[index];
+    ScrollOffset offset = this->scroll[layer.continues];
+    PixelRect clip = viewport;
+    if (layer.kind == LayerKind::SCROLL) {
+      // the container moves with the layer it is in
+      const ScrollOffset &parent = offsets[layer.parent];
+      offset.x += parent.x;
+      offset.y += parent.y;
+      clip = layer.clip.snapped();
+      clip.x -= parent.x;
+      clip.y -= parent.y;
+      clip = intersect(clip, clips[layer.parent]);
+    }
+    offsets[index] = offset;
+    clips[index] = clip;
+  }
+
+  // order the layers go on screen in
+  std::vector<size_t> paint_order() const {
+    // parents come first, so theirs is known
+    std::vector<bool> in_fixed(this->layers.size());
+    for (size_t i = 0; i < this->layers.size(); i++) {
+      const Layer &layer = this->layers[i];
+      in_fixed[i] = layer.kind == LayerKind::FIXED ||
+                    (i != 0 && in_fixed[layer.parent]);
+    }
+    std::vector<size_t> order;
+    for (int fixed = 0; fixed < 2; fixed++) {
+      for (size_t i = 0; i < this->layers.size(); i++) {
+        if (in_fixed[i] == (fixed == 1)) {
+          order.push_back(i);
+        }
+      }
+    }
+    return order;
+  }
+
+  // what the surface of layer `index` has to cover of `visible` (page
+  // pixels), the root layer fills the screen with its background
+  PixelRect extent(size_t index, const PixelRect &visible) const {
+    if (index == 0) {
+      return union_of(this->painted[0], visible);
+    }
+    return this->painted[index];
+  }
+
+  // makes the surface of layer `index` cover `needed` (page pixels)
+  LayerSurface &surface(size_t index, const PixelRect &needed,
+                        const PixelRect &visible, PackedColor background) {
+    LayerSurface &surface = this->surfaces[index];
+    const DisplayList &list = this->layers[index].list;
+    PixelRect covered{surface.x, surface.y, surface.pixels.width,
+                      surface.pixels.height};
+    if (index != 0) {
+      background = 0;
+    }
+    if (surface.version == list.version && list.version != 0 &&
+        surface.background == background && contains(covered, needed)) {
+      return surface;
+    }
+    int margin_x = visible.width * this->margin_screens;
+    int margin_y = visible.height * this->margin_screens;
+    PixelRect area = intersect(
+        PixelRect{visible.x - margin_x, visible.y - margin_y,
+                  visible.width + 2 * margin_x, visible.height + 2 * margin_y},
+        this->extent(index, visible));
+    surface.x = area.x;
+    surface.y = area.y;
+    surface.version = list.version;
+    surface.background = background;
+    surface.pixels = Framebuffer(area.width, area.height);
+    surface.pixels.clear(background);
+    rasterize(list, surface.pixels, area.x, area.y);
+    index_runs(surface, index == 0);
+    this->stats.painted++;
+    this->stats.painted_pixels += size_t(area.width) * area.height;
+    return surface;
+  }
+
+  // The page as it looks scrolled, on `background`, into `fb`. The root
+  // surface covers the screen, so it is copied and the layers on it are
+  // copied where they are opaque and blended where they are translucent.
+  void composite(Framebuffer &fb, PackedColor background) {
+    this->stats.composites++;
+    if (this->layers.empty()) {
+      fb.clear(background);
+      return;
+    }
+    PixelRect viewport{0, 0, fb.width, fb.height};
+    std::vector<ScrollOffset> offsets(this->layers.size());
+    std::vector<PixelRect> clips(this->layers.size());
+    for (size_t i = 0; i < this->layers.size(); i++) {
+      this->place(i, viewport, offsets, clips);
+    }
+    this->count_damage(viewport, offsets, clips);
+    for (size_t i : this->paint_order()) {
+      const ScrollOffset &offset = offsets[i];
+      PixelRect visible = clips[i];
+      visible.x += offset.x;
+      visible.y += offset.y;
+      PixelRect needed = intersect(visible, this->extent(i, visible));
+      if (needed.width == 0 || needed.height == 0) {
+        continue;
+      }
+      const LayerSurface &surface =
+          this->surface(i, needed, visible, background);
+      // surface columns, and how far right of them they go on screen
+      int left = needed.x - surface.x;
+      int right = left + needed.width;
+      int shift = surface.x - offset.x;
+      for (int y = needed.y; y < needed.y + needed.height; y++) {
+        int row = y - surface.y;
+        uint32_t *dst = fb.row(y - offset.y);
+        const uint32_t *src = surface.pixels.row(row);
+        for (uint32_t r = surface.row_runs[row]; r < surface.row_runs[row + 1];
+             r++) {
+          const SurfaceRun &run = surface.runs[r];
+          int x = std::max(run.x, left);
+          int end = std::min(run.x + run.width, right);
+          if (x >= end) {
+            continue;
+          }
+          if (run.opaque) {
+            std::memcpy(dst + x + shift, src + x,
+                        sizeof(uint32_t) * (end - x));
+          } else {
+            blend_span(dst + x + shift, src + x, end - x);
+          }
+        }
+      }
+    }
+  }
+
+  // takes the damage of the layers, as it shows on screen, into the stats
+  void count_damage(const PixelRect &viewport,
+                    const std::vector<ScrollOffset> &offsets,
+                    const std::vector<PixelRect> &clips) {
+    Damage screen;
+    for (size_t i = 0; i < this->damage.size(); i++) {
+      if (this->damage[i].full) {
+        screen.rects.push_back(clips[i]);
+      }
+      for (const PixelRect &r : this->damage[i].rects) {
+        screen.rects.push_back(intersect(
+            PixelRect{r.x - offsets[i].x, r.y - offsets[i].y, r.width,
+                      r.height},
+            clips[i]));
+      }
+    }
+    this->damage.clear();
+    this->stats.damaged_percent = damaged_percent(screen, viewport);
+  }
+
+  // The same picture without surfaces, every layer rasterized straight
+  // into `fb`. For checking composite().
+  void composite_direct(Framebuffer &fb, PackedColor background) const {
+    fb.clear(background);
+    PixelRect viewport{0, 0, fb.width, fb.height};
+    std::vector<ScrollOffset> offsets(this->layers.size());
+    std::vector<PixelRect> clips(this->layers.size());
+    for (size_t i = 0; i < this->layers.size(); i++) {
+      this->place(i, viewport, offsets, clips);
+    }
+    for (size_t i : this->paint_order()) {
+      rasterize_area(this->layers[i].list, fb, offsets[i].x, offsets[i].y,
+                     clips[i]);
+    }
+  }
+};
+
+#endif
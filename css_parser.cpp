@@ -2,7 +2,10 @@
 #define CSS_PARSER_HPP
 
 #include <fstream>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <unordered_map>
 #include <variant>
 #include <vector>
 
@@ -108,64 +111,44 @@ bool is_valid_id(char c) {
   // std::cout << "is valid id? " << c << std::endl;
   return isalnum(c) || c == '-' || c == '_';
 }
-struct EdgeSize {
-  int left = 0, right = 0, top = 0, bottom = 0;
-};
-
-struct Rect {
-  int x = 0, y = 0, width = 0, height = 0;
-
-  Rect expanded_by(EdgeSize edge) {
-    return Rect{
-        this->x - edge.left,
-        this->y - edge.top,
-        this->width + edge.left + edge.right,
-        this->height + edge.top + edge.bottom,
-    };
-  }
-
-  friend std::ostream &operator<<(std::ostream &os, const Rect &r) {
-    os << "Rect(" << r.x << "," << r.y << "," << r.width << "," << r.height
-       << ")";
-    return os;
-  }
-};
 
-struct Dimensions {
-  Rect content;
-  EdgeSize padding;
-  EdgeSize margin;
-  EdgeSize border;
-
-  Rect padding_box() { return this->content.expanded_by(this->padding); }
-
-  Rect border_box() { return this->padding_box().expanded_by(this->border); }
-  Rect margin_box() { return this->border_box().expanded_by(this->margin); }
-};
-
-enum BoxType { b_BLOCK, b_INLINE, b_ANON };
 enum DisplayType { BLOCK, INLINE, NONE };
 typedef std::map<std::string, DeclarationValueType> PropertyMap;
 
 struct StyledNode {
-  Node node;
+  Node *node = nullptr;
   PropertyMap values;
   std::vector<StyledNode> children;
 
-  std::optional<DeclarationValueType> value(std::string name) {
-    try {
-      return values.at(name);
-    } catch (const std::exception &e) {
+  std::optional<DeclarationValueType> value(const std::string &name) const {
+    auto it = this->values.find(name);
+    if (it == this->values.end()) {
       return {};
     }
+    return it->second;
   }
 
-  DisplayType display() {
+  // value of `name`, falling back to the shorthand `fallback_name` and then
+  // to `default_value`
+  DeclarationValueType lookup(const std::string &name,
+                              const std::string &fallback_name,
+                              const DeclarationValueType &default_value) const {
+    auto v = this->value(name);
+    if (v) {
+      return v.value();
+    }
+    v = this->value(fallback_name);
+    if (v) {
+      return v.value();
+    }
+    return default_value;
+  }
+
+  DisplayType display() const {
     std::string display = "inline";
-    try {
-      auto value = this->values.at("display");
-      display = std::get<std::string>(value);
-    } catch (const std::exception &e) {
+    auto value = this->value("display");
+    if (value && std::holds_alternative<std::string>(value.value())) {
+      display = std::get<std::string>(value.value());
     }
 
     if (display == "block") {
@@ -177,43 +160,6 @@ struct StyledNode {
   }
 };
 
-struct LayoutBox {
-  Dimensions dims;
-  BoxType type;
-  std::vector<LayoutBox> children;
-
-  LayoutBox get_inline_container() {
-    switch (type) {
-    case BoxType::b_INLINE:
-    case BoxType::b_ANON:
-      return *this;
-    case BoxType::b_BLOCK:
-      LayoutBox last_child = this->children.back();
-      if (last_child.type == BoxType::b_ANON) {
-        // do nothing
-      } else {
-        this->children.push_back(newbox(BoxType::b_ANON));
-      }
-      break;
-    }
-    return this->children.back();
-  }
-
-  LayoutBox newbox(BoxType type) {
-    LayoutBox b;
-    b.type = type;
-    return b;
-  }
-
-  void layout(Dimensions container) {
-    std::cout << "todo this is where id do the layout" << std::endl;
-    // if (this->type == BoxType::BLOCK) {
-    // this->layout_block(container);
-    // }
-    // TODO other box types;
-  }
-};
-
 struct CSSParser : public Parser {
   CSSParser(std::string i) : Parser(i) {}
 
@@ -335,7 +281,7 @@ struct CSSParser : public Parser {
   }
 
   int parse_hex_pair() {
-    std::string hx_as_str = this->input.substr(0, 2);
+    std::string hx_as_str = this->input.substr(this->position, 2);
     this->position += 2;
     int hx = std::stoul(hx_as_str, nullptr, 16);
     return hx;
@@ -343,6 +289,8 @@ struct CSSParser : public Parser {
 
   Color parse_color() {
     Color c;
+    char hash = this->consume_next_character();
+    assert(hash == '#');
     c.r = this->parse_hex_pair();
     c.g = this->parse_hex_pair();
     c.b = this->parse_hex_pair();
@@ -354,7 +302,7 @@ struct CSSParser : public Parser {
 
   DeclarationValueType parse_value() {
     char next = this->next_character();
-    if (isnumber(next)) {
+    if (isdigit(next)) {
       return this->parse_length();
     }
     if (next == '#') {
@@ -425,99 +373,71 @@ struct CSSParser : public Parser {
   }
 };
 
-bool matches_selector(ElementNode node, Selector s) {
-
-  bool type_matches = s.name == node.name;
-  if (!type_matches) {
+// every part the selector has must match, a missing part matches anything
+bool matches_selector(const ElementNode &node, const Selector &s) {
+  if (!s.name.empty() && s.name != node.name) {
     return false;
   }
 
-  bool id_matches = false;
-  try {
-    id_matches = s.id == node.id();
-  } catch (const std::exception &e) {
-  }
-  if (!id_matches) {
-    return false;
-  }
-
-  auto selector_classes = s.classes;
-  auto element_class_set = node.classes();
-  auto class_matches = std::any_of(
-      selector_classes.begin(), selector_classes.end(),
-      [&](std::string c) { return element_class_set.count(c) == 1; });
-  if (!class_matches) {
-    return false;
+  if (!s.id.empty()) {
+    auto id = node.attrs.find("id");
+    if (id == node.attrs.end() || s.id != id->second) {
+      return false;
+    }
   }
 
-  return true;
+  return std::all_of(
+      s.classes.begin(), s.classes.end(),
+      [&](const std::string &c) { return node.has_class(c); });
 }
 
-std::optional<Rule> matched_rule(ElementNode elem, Rule rule) {
-  for (auto selector : rule.selectors) {
+bool matched_rule(const ElementNode &elem, const Rule &rule) {
+  for (const auto &selector : rule.selectors) {
     bool m = matches_selector(elem, selector);
     if (m) {
-      return rule;
+      return true;
     }
   }
-  return {};
+  return false;
 }
 
-std::vector<Rule> matching_rules(ElementNode elem, StyleSheet sheet) {
-  std::vector<Rule> matched;
-  std::copy_if(sheet.rules.begin(), sheet.rules.end(),
-               std::back_inserter(matched),
-               [&](Rule r) { return matched_rule(elem, r); });
-  return matched;
-}
-
-PropertyMap specified_values(ElementNode elem, StyleSheet sheet) {
+PropertyMap specified_values(const ElementNode &elem, const StyleSheet &sheet) {
   // TODO also include any directly added style tag
   // <p style="color: red"> hi </p>
   PropertyMap values;
-  std::vector<Rule> rules = matching_rules(elem, sheet);
   // TODO sort rules by highest specificity
-  for (Rule rule : rules) {
-    for (Declaration decl : rule.declarations) {
+  // applied as they match, in sheet order, without collecting them first
+  for (const Rule &rule : sheet.rules) {
+    if (!matched_rule(elem, rule)) {
+      continue;
+    }
+    for (const Declaration &decl : rule.declarations) {
       values[decl.name] = decl.value;
     }
   }
   return values;
 }
 
-BoxType display_to_box_type(DisplayType d) {
-  switch (d) {
-  case DisplayType::BLOCK:
-    return BoxType::b_BLOCK;
-  case DisplayType::INLINE:
-    return BoxType::b_INLINE;
-  case DisplayType::NONE:
-    return BoxType::b_ANON;
+// Children are styled straight into their slot in the parent, nothing is
+// copied on the way back up.
+void style_node(StyledNode &styled_node, Node *node, const StyleSheet &sheet) {
+  styled_node.node = node;
+  if (node->type == NodeType::Element) {
+    styled_node.values =
+        specified_values(*static_cast<ElementNode *>(node), sheet);
   }
-}
+  // text and unknown nodes have no values of their own
 
-LayoutBox build_layout_tree(StyledNode styled_node) {
-  LayoutBox root;
-
-  DisplayType display = styled_node.display();
-  if (display == DisplayType::NONE) {
-    std::cout << "Root node has display:none" << std::endl;
-    assert(false);
-  }
-  root.type = display_to_box_type(display);
-
-  for (auto child : styled_node.children) {
-    display = child.display();
-    if (display == DisplayType::BLOCK) {
-      root.children.push_back(build_layout_tree(child));
-    } else if (display == DisplayType::INLINE) {
-      auto container = root.get_inline_container();
-      container.children.push_back(build_layout_tree(child));
-    } else {
-      // display none, dont render them
-    }
+  styled_node.children.resize(node->children.size());
+  for (size_t i = 0; i < node->children.size(); i++) {
+    style_node(styled_node.children[i], node->children[i], sheet);
   }
-  return root;
+}
+
+StyledNode style_tree(Node *root, const StyleSheet &sheet) {
+  StyledNode styled_root;
+  style_node(styled_root, root, sheet);
+  return styled_root;
 }
 
 StyleSheet parse_css(std::string input) {
@@ -525,4 +445,60 @@ StyleSheet parse_css(std::string input) {
   auto sheet = parser.parse_sheet();
   return sheet;
 }
+
+// Parsed sheets are immutable once they leave parse_css, so every document
+// (and every style_tree recursion) can share a single instance.
+typedef std::shared_ptr<const StyleSheet> SharedStyleSheet;
+
+struct StyleSheetCache {
+  std::mutex mutex;
+  // keyed by the css source itself, so two sheets are only shared when
+  // their text is the same. Entries expire once the last document holding
+  // the sheet goes away and are dropped the next time they are seen.
+  std::unordered_map<std::string, std::weak_ptr<const StyleSheet>> entries;
+
+  SharedStyleSheet get(const std::string &source) {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      auto it = this->entries.find(source);
+      if (it != this->entries.end()) {
+        if (SharedStyleSheet sheet = it->second.lock()) {
+          return sheet;
+        }
+        this->entries.erase(it);
+      }
+    }
+
+    // parse outside of the lock so big sheets dont block other documents
+    SharedStyleSheet parsed =
+        std::make_shared<const StyleSheet>(parse_css(source));
+
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto it = this->entries.find(source);
+    if (it != this->entries.end()) {
+      // someone else parsed the same source while we were busy
+      if (SharedStyleSheet sheet = it->second.lock()) {
+        return sheet;
+      }
+      it->second = parsed;
+      return parsed;
+    }
+    // a parse costs more than a walk over the cache, so sheets no document
+    // holds anymore go here too and the cache only grows with live sheets
+    for (auto e = this->entries.begin(); e != this->entries.end();) {
+      e = e->second.expired() ? this->entries.erase(e) : std::next(e);
+    }
+    this->entries.emplace(source, parsed);
+    return parsed;
+  }
+};
+
+StyleSheetCache &stylesheet_cache() {
+  static StyleSheetCache cache;
+  return cache;
+}
+
+SharedStyleSheet load_stylesheet(const std::string &source) {
+  return stylesheet_cache().get(source);
+}
 #endif
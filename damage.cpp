@@ -0,0 +1,341 @@
+#ifndef DAMAGE_CPP
+#define DAMAGE_CPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "raster.cpp"
+
+// a diff never hands out more rects than this, the rest get merged
+const size_t MAX_DAMAGE_RECTS = 8;
+
+struct DamageStats {
+  size_t unchanged = 0;
+  size_t changed = 0;
+  size_t added = 0;
+  size_t removed = 0;
+  // unchanged, but painted in another order relative to the others
+  size_t reordered = 0;
+};
+
+// What changed between two display lists, in page pixels.
+struct Damage {
+  std::vector<PixelRect> rects;
+  // everything has to be repainted
+  bool full = false;
+  DamageStats stats;
+};
+
+int64_t area(const PixelRect &r) { return int64_t(r.width) * r.height; }
+
+PixelRect union_of(const PixelRect &a, const PixelRect &b) {
+  int left = std::min(a.x, b.x);
+  int top = std::min(a.y, b.y);
+  int right = std::max(a.x + a.width, b.x + b.width);
+  int bottom = std::max(a.y + a.height, b.y + b.height);
+  return PixelRect{left, top, right - left, bottom - top};
+}
+
+// Area covered by any of the rects, by splitting the plane along every rect
+// edge. Only meant for the handful of rects a Damage has.
+int64_t union_area(const std::vector<PixelRect> &rects) {
+  std::vector<int> xs, ys;
+  for (const PixelRect &r : rects) {
+    xs.insert(xs.end(), {r.x, r.x + r.width});
+    ys.insert(ys.end(), {r.y, r.y + r.height});
+  }
+  std::sort(xs.begin(), xs.end());
+  std::sort(ys.begin(), ys.end());
+  int64_t total = 0;
+  for (size_t i = 0; i + 1 < xs.size(); i++) {
+    for (size_t j = 0; j + 1 < ys.size(); j++) {
+      PixelRect cell{xs[i], ys[j], xs[i + 1] - xs[i], ys[j + 1] - ys[j]};
+      for (const PixelRect &r : rects) {
+        if (area(intersect(cell, r)) == area(cell)) {
+          total += area(cell);
+          break;
+        }
+      }
+    }
+  }
+  return total;
+}
+
+void add_damage(std::vector<PixelRect> &rects, const PixelRect &r) {
+  if (r.width <= 0 || r.height <= 0) {
+    return;
+  }
+  // commands next to each other in the list are usually next to each other
+  // on the page, so grow the last rect while that costs nothing
+  if (!rects.empty()) {
+    PixelRect merged = union_of(rects.back(), r);
+    if (area(merged) <= area(rects.back()) + area(r)) {
+      rects.back() = merged;
+      return;
+    }
+  }
+  rects.push_back(r);
+}
+
+// Merges rects that overlap, then the pairs that waste the least area
+// until there are at most MAX_DAMAGE_RECTS.
+void merge_damage(std::vector<PixelRect> &rects) {
+  if (rects.size() > 64) {
+    // a lot of scattered damage, first merge neighbours top to bottom
+    std::sort(rects.begin(), rects.end(),
+              [](const PixelRect &a, const PixelRect &b) { return a.y < b.y; });
+    size_t per_rect = (rects.size() + 63) / 64;
+    std::vector<PixelRect> merged;
+    for (size_t i = 0; i < rects.size(); i++) {
+      if (i % per_rect == 0) {
+        merged.push_back(rects[i]);
+      } else {
+        merged.back() = union_of(merged.back(), rects[i]);
+      }
+    }
+    rects.swap(merged);
+  }
+  while (rects.size() > 1) {
+    size_t best_i = 0, best_j = 0;
+    int64_t best_waste = INT64_MAX;
+    for (size_t i = 0; i < rects.size(); i++) {
+      for (size_t j = i + 1; j < rects.size(); j++) {
+        int64_t waste = area(union_of(rects[i], rects[j])) - area(rects[i]) -
+                        area(rects[j]);
+        if (waste < best_waste) {
+          best_waste = waste;
+          best_i = i;
+          best_j = j;
+        }
+      }
+    }
+    if (best_waste > 0 && rects.size() <= MAX_DAMAGE_RECTS) {
+      break;
+    }
+    rects[best_i] = union_of(rects[best_i], rects[best_j]);
+    rects.erase(rects.begin() + best_j);
+  }
+}
+
+PixelRect damage_bounds(const CommandHeader &command) {
+  return paint_bounds(command).rect().snapped();
+}
+
+// One merge pass over two lists sorted by (box, position among that box's
+// commands). False if either list is not sorted.
+bool diff_in_order(const DisplayList &before, const DisplayList &after,
+                   Damage &damage) {
+  auto old_it = before.begin(), new_it = after.begin();
+  size_t old_i = 0, new_i = 0;
+  uint32_t old_run = 0, new_run = 0;
+  uint64_t old_key = 0, new_key = 0, last_old = 0, last_new = 0;
+
+  // (box, position) of the command at `i`, `run` counts within the box
+  auto key_at = [](const DisplayList &list, size_t i, uint32_t &run) {
+    if (i > 0 && list.item_boxes[i - 1] == list.item_boxes[i]) {
+      run++;
+    } else {
+      run = 0;
+    }
+    return uint64_t(list.item_boxes[i]) << 32 | run;
+  };
+
+  if (old_i < before.size()) {
+    old_key = key_at(before, old_i, old_run);
+  }
+  if (new_i < after.size()) {
+    new_key = key_at(after, new_i, new_run);
+  }
+  while (old_i < before.size() || new_i < after.size()) {
+    bool has_old = old_i < before.size();
+    bool has_new = new_i < after.size();
+    if ((has_old && old_key < last_old) || (has_new && new_key < last_new)) {
+      return false;
+    }
+    bool take_old = has_old && (!has_new || old_key <= new_key);
+    bool take_new = has_new && (!has_old || new_key <= old_key);
+
+    if (take_old && take_new) {
+      const CommandHeader &a = *old_it;
+      const CommandHeader &b = *new_it;
+      if (a.size() == b.size() && std::memcmp(&a, &b, a.size()) == 0) {
+        damage.stats.unchanged++;
+      } else {
+        damage.stats.changed++;
+        add_damage(damage.rects, damage_bounds(a));
+        add_damage(damage.rects, damage_bounds(b));
+      }
+    } else if (take_old) {
+      damage.stats.removed++;
+      add_damage(damage.rects, damage_bounds(*old_it));
+    } else {
+      damage.stats.added++;
+      add_damage(damage.rects, damage_bounds(*new_it));
+    }
+
+    if (take_old) {
+      last_old = old_key;
+      ++old_it;
+      if (++old_i < before.size()) {
+        old_key = key_at(before, old_i, old_run);
+      }
+    }
+    if (take_new) {
+      last_new = new_key;
+      ++new_it;
+      if (++new_i < after.size()) {
+        new_key = key_at(after, new_i, new_run);
+      }
+    }
+  }
+  return true;
+}
+
+// (box, how many commands of the box came before) for every command, unique
+// even when the commands of a box are not next to each other
+void command_keys(const DisplayList &list, std::vector<uint64_t> &keys) {
+  std::unordered_map<uint32_t, uint32_t> seen;
+  keys.clear();
+  for (size_t i = 0; i < list.size(); i++) {
+    uint32_t box = list.item_boxes[i];
+    keys.push_back(uint64_t(box) << 32 | seen[box]++);
+  }
+}
+
+// marks one of the longest strictly increasing subsequences of `values`
+std::vector<bool> longest_increasing(const std::vector<size_t> &values) {
+  // tails[n] ends the smallest ending subsequence of length n + 1
+  std::vector<size_t> tails;
+  std::vector<size_t> previous(values.size(), SIZE_MAX);
+  for (size_t i = 0; i < values.size(); i++) {
+    auto it = std::lower_bound(
+        tails.begin(), tails.end(), values[i],
+        [&values](size_t tail, size_t value) { return values[tail] < value; });
+    if (it != tails.begin()) {
+      previous[i] = *(it - 1);
+    }
+    if (it == tails.end()) {
+      tails.push_back(i);
+    } else {
+      *it = i;
+    }
+  }
+  std::vector<bool> in_sequence(values.size());
+  for (size_t i = tails.empty() ? SIZE_MAX : tails.back(); i != SIZE_MAX;
+       i = previous[i]) {
+    in_sequence[i] = true;
+  }
+  return in_sequence;
+}
+
+// Matches up commands by key through a hash map. Unchanged commands that
+// are off the longest run still in their old order were moved in paint
+// order; repainting them also puts back in order whatever they overlap.
+void diff_reordered(const DisplayList &before, const DisplayList &after,
+                    Damage &damage) {
+  std::vector<uint64_t> old_keys, new_keys;
+  command_keys(before, old_keys);
+  command_keys(after, new_keys);
+  std::vector<const CommandHeader *> old_commands;
+  std::unordered_map<uint64_t, size_t> old_index;
+  for (const CommandHeader &command : before) {
+    old_index.emplace(old_keys[old_commands.size()], old_commands.size());
+    old_commands.push_back(&command);
+  }
+
+  std::vector<bool> matched(old_commands.size());
+  // the old position of every unchanged command, in the new order
+  std::vector<size_t> order;
+  std::vector<const CommandHeader *> unchanged;
+  size_t i = 0;
+  for (const CommandHeader &b : after) {
+    auto it = old_index.find(new_keys[i++]);
+    if (it == old_index.end()) {
+      damage.stats.added++;
+      add_damage(damage.rects, damage_bounds(b));
+      continue;
+    }
+    matched[it->second] = true;
+    const CommandHeader &a = *old_commands[it->second];
+    if (a.size() == b.size() && std::memcmp(&a, &b, a.size()) == 0) {
+      order.push_back(it->second);
+      unchanged.push_back(&b);
+    } else {
+      damage.stats.changed++;
+      add_damage(damage.rects, damage_bounds(a));
+      add_damage(damage.rects, damage_bounds(b));
+    }
+  }
+  for (size_t old = 0; old < old_commands.size(); old++) {
+    if (!matched[old]) {
+      damage.stats.removed++;
+      add_damage(damage.rects, damage_bounds(*old_commands[old]));
+    }
+  }
+
+  std::vector<bool> in_order = longest_increasing(order);
+  for (size_t u = 0; u < unchanged.size(); u++) {
+    if (in_order[u]) {
+      damage.stats.unchanged++;
+    } else {
+      damage.stats.reordered++;
+      add_damage(damage.rects, damage_bounds(*unchanged[u]));
+    }
+  }
+}
+
+// Matches up commands by layout box and position among that box's
+// commands. The painter walks boxes in preorder and boxes are allocated in
+// preorder, so both lists are usually sorted by that key and one merge
+// pass finds every changed, added and removed command. Lists that are not
+// sorted, because something paints out of tree order, are matched up
+// through a hash map and also damaged where the paint order changed.
+Damage diff_display_lists(const DisplayList &before,
+                          const DisplayList &after) {
+  Damage damage;
+  if (!diff_in_order(before, after, damage)) {
+    damage = Damage();
+    diff_reordered(before, after, damage);
+  }
+  merge_damage(damage.rects);
+  return damage;
+}
+
+// how much of `viewport` (page pixels) has to be repainted
+double damaged_percent(const Damage &damage, const PixelRect &viewport) {
+  if (damage.full) {
+    return 100;
+  }
+  std::vector<PixelRect> visible;
+  for (const PixelRect &r : damage.rects) {
+    visible.push_back(intersect(r, viewport));
+  }
+  return 100.0 * union_area(visible) / area(viewport);
+}
+
+// Repaints only the damaged parts of `fb`, which shows the page at
+// (origin_x, origin_y) and was painted from the list `damage` came from.
+void repaint_damage(const DisplayList &list, Framebuffer &fb, int origin_x,
+                    int origin_y, PackedColor background,
+                    const Damage &damage) {
+  PixelRect screen{0, 0, fb.width, fb.height};
+  if (damage.full) {
+    clear_rect(fb, screen, background);
+    rasterize(list, fb, origin_x, origin_y);
+    return;
+  }
+  for (const PixelRect &r : damage.rects) {
+    PixelRect clip = intersect(
+        PixelRect{r.x - origin_x, r.y - origin_y, r.width, r.height}, screen);
+    if (area(clip) == 0) {
+      continue;
+    }
+    clear_rect(fb, clip, background);
+    rasterize_area(list, fb, origin_x, origin_y, clip);
+  }
+}
+
+#endif
@@ -0,0 +1,539 @@
+#ifndef DISPLAY_LIST_CPP
+#define DISPLAY_LIST_CPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "layout.cpp"
+
+// The display list is one buffer of variable length commands packed back to
+// back. Every command starts with a header holding its opcode and its size,
+// so a walker can skip ops it does not know about and new ones (clips,
+// images) only need a new struct.
+enum class DisplayOp : uint8_t {
+  SOLID_COLOR,
+  TEXT,
+  BORDER,
+  ROUNDED_RECT,
+};
+
+// 8 bits per channel, red in the low byte like IM_COL32
+typedef uint32_t PackedColor;
+
+PackedColor pack_color(const Color &c) {
+  return (c.r & 0xff) | (c.g & 0xff) << 8 | (c.b & 0xff) << 16 |
+         static_cast<uint32_t>(c.a & 0xff) << 24;
+}
+
+Color unpack_color(PackedColor c) {
+  return Color{static_cast<int>(c & 0xff), static_cast<int>(c >> 8 & 0xff),
+               static_cast<int>(c >> 16 & 0xff),
+               static_cast<int>(c >> 24 & 0xff)};
+}
+
+// raw LayoutUnit values, see Rect
+struct PackedRect {
+  int32_t x, y, width, height;
+
+  Rect rect() const {
+    return Rect{LayoutUnit::from_raw(this->x), LayoutUnit::from_raw(this->y),
+                LayoutUnit::from_raw(this->width),
+                LayoutUnit::from_raw(this->height)};
+  }
+};
+
+PackedRect pack_rect(const Rect &r) {
+  return PackedRect{r.x.raw, r.y.raw, r.width.raw, r.height.raw};
+}
+
+struct CommandHeader {
+  // opcode in the top byte, size in bytes (header and trailing data
+  // included) in the rest
+  uint32_t bits;
+
+  DisplayOp op() const { return static_cast<DisplayOp>(this->bits >> 24); }
+  uint32_t size() const { return this->bits & 0xffffff; }
+
+  // only valid for the command type that matches op()
+  template <typename T> const T &as() const {
+    return *reinterpret_cast<const T *>(this);
+  }
+};
+
+const uint32_t MAX_COMMAND_SIZE = 0xffffff;
+
+struct SolidColorCommand {
+  static const DisplayOp OP = DisplayOp::SOLID_COLOR;
+  CommandHeader header;
+  PackedColor color;
+  PackedRect box;
+};
+
+// followed by `length` bytes of utf-8, padded to a multiple of 4
+struct TextCommand {
+  static const DisplayOp OP = DisplayOp::TEXT;
+  CommandHeader header;
+  PackedColor color;
+  PackedRect box;
+  uint32_t font_size;
+  uint32_t length;
+
+  const char *text() const { return reinterpret_cast<const char *>(this + 1); }
+};
+
+// Sides are in CSS order (top, right, bottom, left), corners too (top left
+// first, clockwise). Lengths are raw LayoutUnit values like PackedRect.
+enum Side { SIDE_TOP, SIDE_RIGHT, SIDE_BOTTOM, SIDE_LEFT };
+
+// A whole border in one command instead of one rect per side. Each corner
+// has one radius, the inner edge of a corner is an ellipse when the sides
+// next to it have different widths.
+struct BorderCommand {
+  static const DisplayOp OP = DisplayOp::BORDER;
+  CommandHeader header;
+  // the border box
+  PackedRect box;
+  int32_t widths[4];
+  PackedColor colors[4];
+  int32_t radii[4];
+};
+
+// a background with rounded corners
+struct RoundedRectCommand {
+  static const DisplayOp OP = DisplayOp::ROUNDED_RECT;
+  CommandHeader header;
+  PackedColor color;
+  PackedRect box;
+  int32_t radii[4];
+};
+
+PackedRect command_bounds(const CommandHeader &command) {
+  switch (command.op()) {
+  case DisplayOp::SOLID_COLOR:
+    return command.as<SolidColorCommand>().box;
+  case DisplayOp::TEXT:
+    return command.as<TextCommand>().box;
+  case DisplayOp::BORDER:
+    return command.as<BorderCommand>().box;
+  case DisplayOp::ROUNDED_RECT:
+    return command.as<RoundedRectCommand>().box;
+  }
+  return PackedRect{0, 0, 0, 0};
+}
+
+// Glyphs can reach a little past the box of their text command, by less
+// than half an em, in pixels
+int text_overflow(uint32_t font_size) {
+  return static_cast<int>(font_size / 2 + 1);
+}
+
+// what a command can paint, for binning, damage and paint order
+PackedRect paint_bounds(const CommandHeader &command) {
+  PackedRect box = command_bounds(command);
+  if (command.op() == DisplayOp::TEXT) {
+    int32_t overflow = LayoutUnit::from_px(
+                           text_overflow(command.as<TextCommand>().font_size))
+                           .raw;
+    box.x -= overflow;
+    box.y -= overflow;
+    box.width += 2 * overflow;
+    box.height += 2 * overflow;
+  }
+  return box;
+}
+
+bool intersects(const PackedRect &a, const PackedRect &b) {
+  // 64 bit so rects near the end of the LayoutUnit range dont wrap
+  return int64_t(a.x) < int64_t(b.x) + b.width &&
+         int64_t(b.x) < int64_t(a.x) + a.width &&
+         int64_t(a.y) < int64_t(b.y) + b.height &&
+         int64_t(b.y) < int64_t(a.y) + a.height;
+}
+
+const LayoutUnit DISPLAY_LIST_BAND_HEIGHT = LayoutUnit::from_px(256);
+
+// Commands bucketed into horizontal bands of the page, so painting a
+// viewport only looks at the few bands it overlaps instead of the whole
+// list. The bands are stored flat: band b holds
+// offsets[band_start[b] .. band_start[b + 1]), word offsets of commands in
+// paint order. A command is in every band its paint_bounds() touch.
+struct DisplayListIndex {
+  int32_t band_height = DISPLAY_LIST_BAND_HEIGHT.raw;
+  std::vector<uint32_t> band_start;
+  std::vector<uint32_t> offsets;
+
+  size_t band_count() const {
+    return this->band_start.empty() ? 0 : this->band_start.size() - 1;
+  }
+
+  // bands covering [top, bottom), anything above the page is in band 0.
+  // Empty rects still get the band they sit in, like intersects() does.
+  void band_range(int64_t top, int64_t bottom, size_t &first,
+                  size_t &last) const {
+    top = std::max<int64_t>(top, 0);
+    bottom = std::max(bottom - 1, top);
+    first = static_cast<size_t>(top / this->band_height);
+    last = static_cast<size_t>(bottom / this->band_height);
+  }
+};
+
+struct DisplayList {
+  // words keep every command 4 byte aligned
+  std::vector<uint32_t> words;
+  size_t count = 0;
+  // see build_index()
+  DisplayListIndex index;
+  // layout box of every command, in list order; with the position among
+  // the commands of that box it identifies a command across frames
+  std::vector<uint32_t> item_boxes;
+  uint32_t current_box = UINT32_MAX;
+  // Set by build_index(), different for every list content that got
+  // indexed, copies keep it. Zero for a list that is not done yet.
+  uint64_t version = 0;
+
+  struct iterator {
+    const uint32_t *at;
+
+    const CommandHeader &operator*() const {
+      return *reinterpret_cast<const CommandHeader *>(this->at);
+    }
+    iterator &operator++() {
+      this->at += (**this).size() / sizeof(uint32_t);
+      return *this;
+    }
+    bool operator!=(const iterator &other) const {
+      return this->at != other.at;
+    }
+  };
+
+  iterator begin() const { return iterator{this->words.data()}; }
+  iterator end() const {
+    return iterator{this->words.data() + this->words.size()};
+  }
+
+  // number of commands
+  size_t size() const { return this->count; }
+  bool empty() const { return this->count == 0; }
+  size_t size_in_bytes() const {
+    return this->words.size() * sizeof(uint32_t);
+  }
+  void clear() {
+    this->words.clear();
+    this->count = 0;
+    this->index = DisplayListIndex();
+    this->item_boxes.clear();
+    this->version = 0;
+  }
+
+  // commands pushed from now on belong to layout box `box`
+  void begin_box(uint32_t box) { this->current_box = box; }
+
+  const CommandHeader &at(uint32_t offset) const {
+    return *reinterpret_cast<const CommandHeader *>(&this->words[offset]);
+  }
+
+  // Call once the list is complete, query() needs it. Counts the commands
+  // per band first so the flat arrays are allocated once.
+  void build_index() {
+    static std::atomic<uint64_t> next_version{1};
+    this->version = next_version++;
+    DisplayListIndex &index = this->index;
+    index.offsets.clear();
+    size_t bands = 0;
+    for (const CommandHeader &command : *this) {
+      PackedRect box = paint_bounds(command);
+      size_t first, last;
+      index.band_range(box.y, int64_t(box.y) + box.height, first, last);
+      bands = std::max(bands, last + 1);
+    }
+    index.band_start.assign(bands + 1, 0);
+
+    for (const CommandHeader &command : *this) {
+      PackedRect box = paint_bounds(command);
+      size_t first, last;
+      index.band_range(box.y, int64_t(box.y) + box.height, first, last);
+      for (size_t band = first; band <= last; band++) {
+        index.band_start[band + 1]++;
+      }
+    }
+    for (size_t band = 0; band < bands; band++) {
+      index.band_start[band + 1] += index.band_start[band];
+    }
+
+    index.offsets.resize(index.band_start[bands]);
+    std::vector<uint32_t> fill(index.band_start.begin(),
+                               index.band_start.end() - 1);
+    for (iterator it = this->begin(); it != this->end(); ++it) {
+      PackedRect box = paint_bounds(*it);
+      size_t first, last;
+      index.band_range(box.y, int64_t(box.y) + box.height, first, last);
+      uint32_t offset = static_cast<uint32_t>(it.at - this->words.data());
+      for (size_t band = first; band <= last; band++) {
+        index.offsets[fill[band]++] = offset;
+      }
+    }
+  }
+
+  // Offsets (for at()) of the commands that can paint into `area`, in
+  // paint order. `out` is reused so a steady scroll does not allocate.
+  void query(const Rect &area, std::vector<uint32_t> &out) const {
+    out.clear();
+    PackedRect target = pack_rect(area);
+    size_t first, last;
+    this->index.band_range(target.y, int64_t(target.y) + target.height,
+                           first, last);
+    last = std::min(last + 1, this->index.band_count());
+    for (size_t band = first; band < last; band++) {
+      for (uint32_t i = this->index.band_start[band];
+           i < this->index.band_start[band + 1]; i++) {
+        uint32_t offset = this->index.offsets[i];
+        if (intersects(paint_bounds(this->at(offset)), target)) {
+          out.push_back(offset);
+        }
+      }
+    }
+    if (last > first + 1) {
+      // commands that span bands were found once per band
+      std::sort(out.begin(), out.end());
+      out.erase(std::unique(out.begin(), out.end()), out.end());
+    }
+  }
+
+  // room for a T and `extra` trailing bytes at the end of the buffer
+  template <typename T> T &append(size_t extra) {
+    size_t size = (sizeof(T) + extra + 3) & ~size_t(3);
+    size_t at = this->words.size();
+    this->words.resize(at + size / sizeof(uint32_t));
+    T *command = new (&this->words[at]) T;
+    command->header.bits =
+        static_cast<uint32_t>(T::OP) << 24 | static_cast<uint32_t>(size);
+    this->count++;
+    this->item_boxes.push_back(this->current_box);
+    this->version = 0;
+    return *command;
+  }
+
+  void push_solid_color(PackedColor color, const Rect &box) {
+    SolidColorCommand &command = this->append<SolidColorCommand>(0);
+    command.color = color;
+    command.box = pack_rect(box);
+  }
+
+  // `widths`, `colors` and `radii` as in BorderCommand
+  void push_border(const Rect &box, const LayoutUnit widths[4],
+                   const PackedColor colors[4], const LayoutUnit radii[4]) {
+    BorderCommand &command = this->append<BorderCommand>(0);
+    command.box = pack_rect(box);
+    for (int i = 0; i < 4; i++) {
+      command.widths[i] = widths[i].raw;
+      command.colors[i] = colors[i];
+      command.radii[i] = radii[i].raw;
+    }
+  }
+
+  void push_rounded_rect(PackedColor color, const Rect &box,
+                         const LayoutUnit radii[4]) {
+    RoundedRectCommand &command = this->append<RoundedRectCommand>(0);
+    command.color = color;
+    command.box = pack_rect(box);
+    for (int i = 0; i < 4; i++) {
+      command.radii[i] = radii[i].raw;
+    }
+  }
+
+  // a copy of a command of another list, for `box`
+  void push_command(const CommandHeader &command, uint32_t box) {
+    const uint32_t *words = reinterpret_cast<const uint32_t *>(&command);
+    this->words.insert(this->words.end(), words,
+                       words + command.size() / sizeof(uint32_t));
+    this->count++;
+    this->item_boxes.push_back(box);
+    this->version = 0;
+  }
+
+  void push_text(PackedColor color, const Rect &box, int font_size,
+                 const char *text, size_t length) {
+    // a single word longer than 16MB gets cut off
+    length = std::min(length, MAX_COMMAND_SIZE - sizeof(TextCommand) - 3);
+    TextCommand &command = this->append<TextCommand>(length);
+    command.color = color;
+    command.box = pack_rect(box);
+    command.font_size = static_cast<uint32_t>(font_size);
+    command.length = static_cast<uint32_t>(length);
+    std::memcpy(reinterpret_cast<char *>(&command + 1), text, length);
+  }
+};
+
+std::ostream &operator<<(std::ostream &os, const CommandHeader &command) {
+  os << "DisplayCommand: ";
+  os << "(" << static_cast<int>(command.op()) << ")";
+  switch (command.op()) {
+  case DisplayOp::SOLID_COLOR: {
+    const SolidColorCommand &solid = command.as<SolidColorCommand>();
+    os << " color: " << unpack_color(solid.color) << "\n";
+    os << solid.box.rect();
+  } break;
+  case DisplayOp::TEXT: {
+    const TextCommand &text = command.as<TextCommand>();
+    os << " color: " << unpack_color(text.color) << "\n";
+    os << text.box.rect() << " ";
+    os.write(text.text(), text.length);
+  } break;
+  case DisplayOp::BORDER: {
+    const BorderCommand &border = command.as<BorderCommand>();
+    os << " widths:";
+    for (int32_t width : border.widths) {
+      os << " " << LayoutUnit::from_raw(width);
+    }
+    os << " color: " << unpack_color(border.colors[SIDE_TOP]) << "\n";
+    os << border.box.rect();
+  } break;
+  case DisplayOp::ROUNDED_RECT: {
+    const RoundedRectCommand &rounded = command.as<RoundedRectCommand>();
+    os << " color: " << unpack_color(rounded.color) << "\n";
+    os << rounded.box.rect() << " radius "
+       << LayoutUnit::from_raw(rounded.radii[0]);
+  } break;
+  }
+  return os;
+}
+
+// size of the struct of `op` without trailing data, 0 if there is none
+uint32_t command_struct_size(DisplayOp op) {
+  switch (op) {
+  case DisplayOp::SOLID_COLOR:
+    return sizeof(SolidColorCommand);
+  case DisplayOp::TEXT:
+    return sizeof(TextCommand);
+  case DisplayOp::BORDER:
+    return sizeof(BorderCommand);
+  case DisplayOp::ROUNDED_RECT:
+    return sizeof(RoundedRectCommand);
+  }
+  return 0;
+}
+
+// A recorded display list, to paint a page again without parsing and
+// laying it out. Every field is a little endian 32 bit word:
+//   magic, format, page width, page height (raw LayoutUnit values),
+//   command count, word count, the commands, the box of every command
+// but the text after a text command, which is stored byte for byte with its
+// padding. Commands are stored field by field as they are in memory, so the
+// format changes whenever a command struct does; bump DISPLAY_LIST_FORMAT
+// then.
+const uint32_t DISPLAY_LIST_MAGIC = 0x4c445743; // "CWDL"
+const uint32_t DISPLAY_LIST_FORMAT = 2;
+
+void put_word(std::vector<unsigned char> &bytes, uint32_t word) {
+  for (int b = 0; b < 4; b++) {
+    bytes.push_back(static_cast<unsigned char>(word >> (b * 8)));
+  }
+}
+
+uint32_t get_word(const unsigned char *bytes) {
+  return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | uint32_t(bytes[3]) << 24;
+}
+
+bool write_display_list(const std::string &path, const DisplayList &list,
+                        LayoutUnit page_width, LayoutUnit page_height) {
+  std::vector<unsigned char> bytes;
+  bytes.reserve((6 + list.words.size() + list.item_boxes.size()) * 4);
+  put_word(bytes, DISPLAY_LIST_MAGIC);
+  put_word(bytes, DISPLAY_LIST_FORMAT);
+  put_word(bytes, static_cast<uint32_t>(page_width.raw));
+  put_word(bytes, static_cast<uint32_t>(page_height.raw));
+  put_word(bytes, static_cast<uint32_t>(list.size()));
+  put_word(bytes, static_cast<uint32_t>(list.words.size()));
+  for (const CommandHeader &command : list) {
+    const uint32_t *fields = &command.bits;
+    uint32_t struct_size = command_struct_size(command.op());
+    for (uint32_t i = 0; i < struct_size / 4; i++) {
+      put_word(bytes, fields[i]);
+    }
+    const unsigned char *data =
+        reinterpret_cast<const unsigned char *>(fields) + struct_size;
+    bytes.insert(bytes.end(), data, data + command.size() - struct_size);
+  }
+  for (uint32_t box : list.item_boxes) {
+    put_word(bytes, box);
+  }
+  std::ofstream out(path, std::ios::binary);
+  out.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+  return static_cast<bool>(out);
+}
+
+// Reads what write_display_list wrote and indexes it. Fails on anything
+// else, including commands that would point outside of the list.
+bool read_display_list(const std::string &path, DisplayList &list,
+                       LayoutUnit &page_width, LayoutUnit &page_height) {
+  std::ifstream in(path, std::ios::binary | std::ios::ate);
+  if (!in) {
+    return false;
+  }
+  std::streamoff end = in.tellg();
+  if (end < 0) {
+    return false;
+  }
+  std::vector<unsigned char> bytes(static_cast<size_t>(end));
+  in.seekg(0);
+  if (!in.read(reinterpret_cast<char *>(bytes.data()), bytes.size()) ||
+      bytes.size() % 4 != 0 || bytes.size() < 6 * 4) {
+    return false;
+  }
+  // word `i` of the file
+  auto word = [&](size_t i) { return get_word(bytes.data() + i * 4); };
+  uint32_t count = word(4);
+  uint32_t size = word(5);
+  if (word(0) != DISPLAY_LIST_MAGIC || word(1) != DISPLAY_LIST_FORMAT ||
+      bytes.size() / 4 != 6 + size_t(size) + count) {
+    return false;
+  }
+
+  list.clear();
+  list.words.resize(size);
+  size_t commands = 0;
+  for (size_t at = 0; at < size; commands++) {
+    CommandHeader header{word(6 + at)};
+    uint32_t struct_size = command_struct_size(header.op());
+    if (struct_size == 0 || header.size() < struct_size ||
+        header.size() % 4 != 0 || header.size() / 4 > size - at) {
+      list.clear();
+      return false;
+    }
+    for (size_t i = 0; i < struct_size / 4; i++) {
+      list.words[at + i] = word(6 + at + i);
+    }
+    std::memcpy(list.words.data() + at + struct_size / 4,
+                bytes.data() + (6 + at) * 4 + struct_size,
+                header.size() - struct_size);
+    const CommandHeader &command = list.at(static_cast<uint32_t>(at));
+    if (command.op() == DisplayOp::TEXT &&
+        command.as<TextCommand>().length > command.size() - struct_size) {
+      list.clear();
+      return false;
+    }
+    at += command.size() / 4;
+  }
+  if (commands != count) {
+    list.clear();
+    return false;
+  }
+  list.item_boxes.resize(count);
+  for (size_t i = 0; i < count; i++) {
+    list.item_boxes[i] = word(6 + size_t(size) + i);
+  }
+  list.count = count;
+  page_width = LayoutUnit::from_raw(static_cast<int32_t>(word(2)));
+  page_height = LayoutUnit::from_raw(static_cast<int32_t>(word(3)));
+  list.build_index();
+  return true;
+}
+
+#endif
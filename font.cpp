@@ -0,0 +1,220 @@
+#ifndef FONT_CPP
+#define FONT_CPP
+
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+#define STBTT_STATIC
+#define STB_TRUETYPE_IMPLEMENTATION
+#include "imgui/imstb_truetype.h"
+#pragma GCC diagnostic pop
+
+#include "layout_unit.cpp"
+
+const char *DEFAULT_FONT_PATH = "imgui/misc/fonts/DroidSans.ttf";
+
+// Reads one codepoint and advances `it`, bad bytes come back as '?'.
+int decode_utf8(const char *&it, const char *end) {
+  unsigned char c = static_cast<unsigned char>(*it++);
+  if (c < 0x80) {
+    return c;
+  }
+  int extra = c >= 0xF0 ? 3 : c >= 0xE0 ? 2 : c >= 0xC0 ? 1 : -1;
+  if (extra < 0 || end - it < extra) {
+    return '?';
+  }
+  int codepoint = c & (0x3F >> extra);
+  for (int i = 0; i < extra; i++) {
+    codepoint = (codepoint << 6) | (static_cast<unsigned char>(*it++) & 0x3F);
+  }
+  return codepoint;
+}
+
+struct Font;
+
+// Coverage of one glyph, x0/y0 are relative to the pen position on the
+// baseline.
+struct GlyphBitmap {
+  int x0 = 0, y0 = 0, width = 0, height = 0;
+  std::vector<unsigned char> coverage;
+};
+
+// A font at one pixel size. Word widths are cached here, so laying out the
+// same words again (after a resize, say) never goes back to the font.
+struct FontSize {
+  const Font *font;
+  int px;
+  float scale = 0;
+  LayoutUnit ascent;
+  LayoutUnit line_height;
+  LayoutUnit space_width;
+
+  std::mutex mutex;
+  std::unordered_map<std::string, LayoutUnit> word_widths;
+  // for the software rasterizer, node based so references stay valid
+  std::unordered_map<int, GlyphBitmap> glyph_bitmaps;
+
+  FontSize(const Font *f, int p);
+
+  LayoutUnit word_width(const char *word, size_t length) {
+    std::string key(word, length);
+    std::lock_guard<std::mutex> lock(this->mutex);
+    auto it = this->word_widths.find(key);
+    if (it != this->word_widths.end()) {
+      return it->second;
+    }
+    LayoutUnit width = this->measure(word, length);
+    this->word_widths.emplace(std::move(key), width);
+    return width;
+  }
+
+  LayoutUnit measure(const char *word, size_t length) const;
+
+  const GlyphBitmap &glyph_bitmap(int glyph);
+};
+
+struct Font {
+  bool loaded = false;
+  std::vector<unsigned char> data;
+  stbtt_fontinfo info;
+
+  // how many times we had to ask stb_truetype for glyph metrics
+  mutable std::atomic<size_t> glyph_lookups{0};
+
+  std::mutex mutex;
+  std::map<int, std::unique_ptr<FontSize>> sizes;
+
+  explicit Font(const std::string &path) {
+    std::ifstream file(path, std::ios::binary);
+    this->data.assign(std::istreambuf_iterator<char>(file),
+                      std::istreambuf_iterator<char>());
+    if (this->data.empty()) {
+      std::cout << "Failed to load font " << path
+                << ", text will use fallback metrics" << std::endl;
+      return;
+    }
+    int offset = stbtt_GetFontOffsetForIndex(this->data.data(), 0);
+    this->loaded = stbtt_InitFont(&this->info, this->data.data(), offset);
+  }
+
+  FontSize &at_size(int px) {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    std::unique_ptr<FontSize> &size = this->sizes[px];
+    if (!size) {
+      size = std::make_unique<FontSize>(this, px);
+    }
+    return *size;
+  }
+};
+
+FontSize::FontSize(const Font *f, int p) : font(f), px(p) {
+  if (!this->font->loaded) {
+    this->ascent = LayoutUnit::from_px(this->px);
+    this->line_height = LayoutUnit::from_float(this->px * 1.2f);
+    this->space_width = this->measure(" ", 1);
+    return;
+  }
+  this->scale = stbtt_ScaleForPixelHeight(&this->font->info,
+                                          static_cast<float>(this->px));
+  int ascent, descent, line_gap;
+  stbtt_GetFontVMetrics(&this->font->info, &ascent, &descent, &line_gap);
+  this->ascent = LayoutUnit::from_float(ascent * this->scale);
+  this->line_height =
+      LayoutUnit::from_float((ascent - descent + line_gap) * this->scale);
+  this->space_width = this->measure(" ", 1);
+}
+
+LayoutUnit FontSize::measure(const char *word, size_t length) const {
+  const char *it = word;
+  const char *end = word + length;
+  if (!this->font->loaded) {
+    // no font file, pretend every character is half an em wide
+    int chars = 0;
+    while (it < end) {
+      decode_utf8(it, end);
+      chars++;
+    }
+    return LayoutUnit::from_px(chars * this->px) / 2;
+  }
+
+  float width = 0;
+  int previous = 0;
+  while (it < end) {
+    int glyph = stbtt_FindGlyphIndex(&this->font->info, decode_utf8(it, end));
+    int advance, left_side_bearing;
+    stbtt_GetGlyphHMetrics(&this->font->info, glyph, &advance,
+                           &left_side_bearing);
+    width += advance;
+    if (previous != 0) {
+      width += stbtt_GetGlyphKernAdvance(&this->font->info, previous, glyph);
+    }
+    previous = glyph;
+    this->font->glyph_lookups++;
+  }
+  return LayoutUnit::from_float(width * this->scale);
+}
+
+const GlyphBitmap &FontSize::glyph_bitmap(int glyph) {
+  std::lock_guard<std::mutex> lock(this->mutex);
+  auto it = this->glyph_bitmaps.find(glyph);
+  if (it != this->glyph_bitmaps.end()) {
+    return it->second;
+  }
+  GlyphBitmap &bitmap = this->glyph_bitmaps[glyph];
+  if (!this->font->loaded) {
+    return bitmap;
+  }
+  int x1, y1;
+  stbtt_GetGlyphBitmapBox(&this->font->info, glyph, this->scale, this->scale,
+                          &bitmap.x0, &bitmap.y0, &x1, &y1);
+  bitmap.width = x1 - bitmap.x0;
+  bitmap.height = y1 - bitmap.y0;
+  bitmap.coverage.resize(bitmap.width * bitmap.height);
+  if (!bitmap.coverage.empty()) {
+    stbtt_MakeGlyphBitmap(&this->font->info, bitmap.coverage.data(),
+                          bitmap.width, bitmap.height, bitmap.width,
+                          this->scale, this->scale, glyph);
+  }
+  return bitmap;
+}
+
+// Walks `text` the way FontSize::measure does and calls f(glyph, x) for
+// every glyph, x being the pen position rounded to pixels.
+template <typename F>
+void walk_glyphs(const FontSize &size, const char *text, size_t length, F f) {
+  const stbtt_fontinfo &info = size.font->info;
+  const char *it = text;
+  const char *end = text + length;
+  float pen = 0;
+  int previous = 0;
+  while (it < end) {
+    int glyph = stbtt_FindGlyphIndex(&info, decode_utf8(it, end));
+    if (previous != 0) {
+      pen += stbtt_GetGlyphKernAdvance(&info, previous, glyph) * size.scale;
+    }
+    f(glyph, static_cast<int>(std::lround(pen)));
+
+    int advance, left_side_bearing;
+    stbtt_GetGlyphHMetrics(&info, glyph, &advance, &left_side_bearing);
+    pen += advance * size.scale;
+    previous = glyph;
+  }
+}
+
+Font &default_font() {
+  static Font font(DEFAULT_FONT_PATH);
+  return font;
+}
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef FRAME_SCHEDULER_CPP
+#define FRAME_SCHEDULER_CPP
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+typedef std::chrono::steady_clock::time_point FrameTime;
+
+// Why a frame was asked for, a frame can have several reasons
+enum FrameReason : uint32_t {
+  FRAME_INPUT = 1,
+  FRAME_TIMER = 2,
+  FRAME_ANIMATION = 4,
+  FRAME_CONTENT = 8,
+};
+
+struct FrameStats {
+  size_t frames = 0;
+  // times the scheduler blocked with nothing to do
+  size_t waits = 0;
+};
+
+// Hands out frames only when something asked for one: input, a timer, an
+// animation that wants its next frame or new content. In between it
+// blocks, so an open page that does not change costs no CPU. The platform
+// part (how to block, what the clock is, where input comes from) is up to
+// the subclasses.
+struct FrameScheduler {
+  FrameStats stats;
+
+  struct Timer {
+    FrameTime at;
+    uint32_t reasons;
+  };
+  // guards what is below, frames can be requested from any thread
+  std::mutex mutex;
+  uint32_t pending = 0;
+  std::vector<Timer> timers;
+  bool closing = false;
+
+  virtual ~FrameScheduler() {}
+
+  // Blocks until input arrives, wake() is called or `deadline` (if any)
+  // passes. Returns FRAME_INPUT if there was input.
+  virtual uint32_t wait(const FrameTime *deadline) = 0;
+  virtual FrameTime now() = 0;
+  // wakes up wait() from any thread
+  virtual void wake() {}
+  // handles input that came in while frames kept the loop busy
+  virtual void poll() {}
+
+  void request_frame(uint32_t reasons) {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->pending |= reasons;
+    }
+    this->wake();
+  }
+
+  void request_frame_at(FrameTime at, uint32_t reasons = FRAME_TIMER) {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->timers.push_back(Timer{at, reasons});
+    }
+    this->wake();
+  }
+
+  // next_frame() returns 0 from now on
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(this->mutex);
+      this->closing = true;
+    }
+    this->wake();
+  }
+
+  // Blocks until a frame is due and returns its reasons, 0 once closed.
+  uint32_t next_frame() {
+    this->poll();
+    while (true) {
+      FrameTime deadline;
+      bool has_deadline = false;
+      {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (this->closing) {
+          return 0;
+        }
+        uint32_t reasons = this->take_due(this->now());
+        if (reasons != 0) {
+          this->stats.frames++;
+          return reasons;
+        }
+        for (const Timer &timer : this->timers) {
+          if (!has_deadline || timer.at < deadline) {
+            deadline = timer.at;
+            has_deadline = true;
+          }
+        }
+      }
+      this->stats.waits++;
+      uint32_t input = this->wait(has_deadline ? &deadline : nullptr);
+      if (input != 0) {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->pending |= input;
+      }
+    }
+  }
+
+  // pending reasons and timers that are due, with the mutex held
+  uint32_t take_due(FrameTime now) {
+    uint32_t reasons = this->pending;
+    this->pending = 0;
+    auto due = std::remove_if(
+        this->timers.begin(), this->timers.end(), [&](const Timer &timer) {
+          if (timer.at <= now) {
+            reasons |= timer.reasons;
+            return true;
+          }
+          return false;
+        });
+    this->timers.erase(due, this->timers.end());
+    return reasons;
+  }
+};
+
+// Real time without a window, for headless tools: blocks on a condition
+// variable, input is whatever gets posted with request_frame.
+struct BlockingFrameScheduler : FrameScheduler {
+  std::mutex wait_mutex;
+  std::condition_variable woken;
+  bool wakeup = false;
+
+  FrameTime now() override { return std::chrono::steady_clock::now(); }
+
+  uint32_t wait(const FrameTime *deadline) override {
+    std::unique_lock<std::mutex> lock(this->wait_mutex);
+    auto ready = [this] { return this->wakeup; };
+    if (deadline == nullptr) {
+      this->woken.wait(lock, ready);
+    } else {
+      this->woken.wait_until(lock, *deadline, ready);
+    }
+    this->wakeup = false;
+    return 0;
+  }
+
+  void wake() override {
+    {
+      std::lock_guard<std::mutex> lock(this->wait_mutex);
+      this->wakeup = true;
+    }
+    this->woken.notify_one();
+  }
+};
+
+// Deterministic driver for benchmarks and tests. Time only moves when the
+// scheduler would block: it jumps to the next timer or scripted input
+// event, and with neither left the scheduler closes.
+struct HeadlessFrameScheduler : FrameScheduler {
+  FrameTime clock;
+
+  struct Event {
+    FrameTime at;
+    uint32_t reasons;
+  };
+  // sorted by time, see post_at
+  std::vector<Event> script;
+
+  FrameTime now() override { return this->clock; }
+
+  // `reasons` arrive as input at `at`, like an event from the window
+  void post_at(FrameTime at, uint32_t reasons = FRAME_INPUT) {
+    Event event{at, reasons};
+    auto it = std::upper_bound(
+        this->script.begin(), this->script.end(), event,
+        [](const Event &a, const Event &b) { return a.at < b.at; });
+    this->script.insert(it, event);
+  }
+
+  uint32_t wait(const FrameTime *deadline) override {
+    if (!this->script.empty() &&
+        (deadline == nullptr || this->script.front().at <= *deadline)) {
+      Event event = this->script.front();
+      this->script.erase(this->script.begin());
+      this->clock = std::max(this->clock, event.at);
+      return event.reasons;
+    }
+    if (deadline == nullptr) {
+      // nothing can ask for a frame anymore
+      this->close();
+      return 0;
+    }
+    this->clock = std::max(this->clock, *deadline);
+    return 0;
+  }
+};
+
+// Calls `frame(reasons)` for every frame `scheduler` hands out, until it
+// closes. Returns the number of frames.
+template <typename F> size_t run_frames(FrameScheduler &scheduler, F frame) {
+  size_t frames = 0;
+  for (uint32_t reasons = scheduler.next_frame(); reasons != 0;
+       reasons = scheduler.next_frame()) {
+    frame(reasons);
+    frames++;
+  }
+  return frames;
+}
+
+#endif
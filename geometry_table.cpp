@@ -0,0 +1,261 @@
+#ifndef GEOMETRY_TABLE_CPP
+#define GEOMETRY_TABLE_CPP
+
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "layout.cpp"
+
+// Layout results as a structure of arrays, indexed by BoxId. Passes that
+// only care about where boxes are (scrolling, culling, hit testing) stream
+// through a few int32 arrays instead of dragging whole LayoutBoxes through
+// the cache. Values are raw LayoutUnits.
+//
+// Boxes are allocated in preorder, so the subtree of `id` is the index range
+// [id, id + subtree_size) and subtree passes are plain loops too.
+struct GeometryTable {
+  // border box
+  std::vector<int32_t> x, y, width, height;
+  // edges, in left/right/top/bottom order
+  std::vector<int32_t> margin[4];
+  std::vector<int32_t> border[4];
+  std::vector<int32_t> padding[4];
+  // the tree, to get from a box to its subtree and its ancestors
+  std::vector<BoxId> parent;
+  std::vector<uint32_t> subtree_size;
+
+  size_t size() const { return this->x.size(); }
+
+  void resize(size_t n) {
+    for (std::vector<int32_t> *column : {&this->x, &this->y, &this->width,
+                                         &this->height}) {
+      column->resize(n);
+    }
+    this->parent.resize(n);
+    this->subtree_size.resize(n);
+    for (int side = 0; side < 4; side++) {
+      this->margin[side].resize(n);
+      this->border[side].resize(n);
+      this->padding[side].resize(n);
+    }
+  }
+
+  Rect border_box(BoxId id) const {
+    return Rect{LayoutUnit::from_raw(this->x[id]),
+                LayoutUnit::from_raw(this->y[id]),
+                LayoutUnit::from_raw(this->width[id]),
+                LayoutUnit::from_raw(this->height[id])};
+  }
+
+  Rect padding_box(BoxId id) const {
+    int32_t left = this->border[0][id], right = this->border[1][id];
+    int32_t top = this->border[2][id], bottom = this->border[3][id];
+    return Rect{LayoutUnit::from_raw(this->x[id] + left),
+                LayoutUnit::from_raw(this->y[id] + top),
+                LayoutUnit::from_raw(this->width[id] - left - right),
+                LayoutUnit::from_raw(this->height[id] - top - bottom)};
+  }
+
+  // Moves boxes [first, first + count) by (dx, dy), e.g. a scrolled subtree.
+  void translate(size_t first, size_t count, LayoutUnit dx, LayoutUnit dy) {
+    int32_t *__restrict xs = this->x.data() + first;
+    int32_t *__restrict ys = this->y.data() + first;
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128i vdx = _mm_set1_epi32(dx.raw);
+    __m128i vdy = _mm_set1_epi32(dy.raw);
+    for (; i + 4 <= count; i += 4) {
+      __m128i *px = reinterpret_cast<__m128i *>(xs + i);
+      __m128i *py = reinterpret_cast<__m128i *>(ys + i);
+      _mm_storeu_si128(px, _mm_add_epi32(_mm_loadu_si128(px), vdx));
+      _mm_storeu_si128(py, _mm_add_epi32(_mm_loadu_si128(py), vdy));
+    }
+#endif
+    for (; i < count; i++) {
+      xs[i] += dx.raw;
+      ys[i] += dy.raw;
+    }
+  }
+
+  // Union of the border boxes [first, first + count).
+  Rect bounds(size_t first, size_t count) const {
+    if (count == 0) {
+      return Rect();
+    }
+    const int32_t *xs = this->x.data() + first;
+    const int32_t *ys = this->y.data() + first;
+    const int32_t *ws = this->width.data() + first;
+    const int32_t *hs = this->height.data() + first;
+
+    int32_t min_x = xs[0], min_y = ys[0];
+    int32_t max_x = xs[0] + ws[0], max_y = ys[0] + hs[0];
+    size_t i = 0;
+#if defined(__SSE2__)
+    // SSE2 has no 32 bit min/max, select through a compare mask
+    auto vmin = [](__m128i a, __m128i b) {
+      __m128i a_greater = _mm_cmpgt_epi32(a, b);
+      return _mm_or_si128(_mm_and_si128(a_greater, b),
+                          _mm_andnot_si128(a_greater, a));
+    };
+    auto vmax = [](__m128i a, __m128i b) {
+      __m128i a_greater = _mm_cmpgt_epi32(a, b);
+      return _mm_or_si128(_mm_and_si128(a_greater, a),
+                          _mm_andnot_si128(a_greater, b));
+    };
+    __m128i lo_x = _mm_set1_epi32(min_x), lo_y = _mm_set1_epi32(min_y);
+    __m128i hi_x = _mm_set1_epi32(max_x), hi_y = _mm_set1_epi32(max_y);
+    for (; i + 4 <= count; i += 4) {
+      __m128i vx = _mm_loadu_si128(reinterpret_cast<const __m128i *>(xs + i));
+      __m128i vy = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ys + i));
+      __m128i vw = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ws + i));
+      __m128i vh = _mm_loadu_si128(reinterpret_cast<const __m128i *>(hs + i));
+      lo_x = vmin(lo_x, vx);
+      lo_y = vmin(lo_y, vy);
+      hi_x = vmax(hi_x, _mm_add_epi32(vx, vw));
+      hi_y = vmax(hi_y, _mm_add_epi32(vy, vh));
+    }
+    alignas(16) int32_t lanes[4][4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes[0]), lo_x);
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes[1]), lo_y);
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes[2]), hi_x);
+    _mm_store_si128(reinterpret_cast<__m128i *>(lanes[3]), hi_y);
+    for (int lane = 0; lane < 4; lane++) {
+      min_x = std::min(min_x, lanes[0][lane]);
+      min_y = std::min(min_y, lanes[1][lane]);
+      max_x = std::max(max_x, lanes[2][lane]);
+      max_y = std::max(max_y, lanes[3][lane]);
+    }
+#endif
+    for (; i < count; i++) {
+      min_x = std::min(min_x, xs[i]);
+      min_y = std::min(min_y, ys[i]);
+      max_x = std::max(max_x, xs[i] + ws[i]);
+      max_y = std::max(max_y, ys[i] + hs[i]);
+    }
+    return Rect{LayoutUnit::from_raw(min_x), LayoutUnit::from_raw(min_y),
+                LayoutUnit::from_raw(max_x - min_x),
+                LayoutUnit::from_raw(max_y - min_y)};
+  }
+
+  // Sets visible[i] for every border box that intersects `viewport`,
+  // returns how many do.
+  size_t cull(const Rect &viewport, std::vector<uint8_t> &visible) const {
+    size_t count = this->size();
+    visible.resize(count);
+    const int32_t *xs = this->x.data();
+    const int32_t *ys = this->y.data();
+    const int32_t *ws = this->width.data();
+    const int32_t *hs = this->height.data();
+    int32_t left = viewport.x.raw;
+    int32_t top = viewport.y.raw;
+    int32_t right = (viewport.x + viewport.width).raw;
+    int32_t bottom = (viewport.y + viewport.height).raw;
+
+    size_t visible_count = 0;
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128i vleft = _mm_set1_epi32(left), vtop = _mm_set1_epi32(top);
+    __m128i vright = _mm_set1_epi32(right), vbottom = _mm_set1_epi32(bottom);
+    for (; i + 4 <= count; i += 4) {
+      __m128i vx = _mm_loadu_si128(reinterpret_cast<const __m128i *>(xs + i));
+      __m128i vy = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ys + i));
+      __m128i vw = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ws + i));
+      __m128i vh = _mm_loadu_si128(reinterpret_cast<const __m128i *>(hs + i));
+      __m128i hit = _mm_and_si128(
+          _mm_and_si128(_mm_cmplt_epi32(vx, vright),
+                        _mm_cmpgt_epi32(_mm_add_epi32(vx, vw), vleft)),
+          _mm_and_si128(_mm_cmplt_epi32(vy, vbottom),
+                        _mm_cmpgt_epi32(_mm_add_epi32(vy, vh), vtop)));
+      int mask = _mm_movemask_ps(_mm_castsi128_ps(hit));
+      for (int lane = 0; lane < 4; lane++) {
+        visible[i + lane] = (mask >> lane) & 1;
+      }
+      visible_count += __builtin_popcount(mask);
+    }
+#endif
+    for (; i < count; i++) {
+      bool hit = xs[i] < right && xs[i] + ws[i] > left && ys[i] < bottom &&
+                 ys[i] + hs[i] > top;
+      visible[i] = hit;
+      visible_count += hit;
+    }
+    return visible_count;
+  }
+
+  // The last box in paint order whose border box contains the point.
+  BoxId hit_test(LayoutUnit px, LayoutUnit py) const {
+    const int32_t *xs = this->x.data();
+    const int32_t *ys = this->y.data();
+    const int32_t *ws = this->width.data();
+    const int32_t *hs = this->height.data();
+    size_t i = this->size();
+#if defined(__SSE2__)
+    __m128i vpx = _mm_set1_epi32(px.raw);
+    __m128i vpy = _mm_set1_epi32(py.raw);
+    // walk backwards four at a time, the first hit is the topmost box
+    for (; i >= 4; i -= 4) {
+      size_t base = i - 4;
+      __m128i vx =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(xs + base));
+      __m128i vy =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(ys + base));
+      __m128i vw =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(ws + base));
+      __m128i vh =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(hs + base));
+      // px >= x  <=>  !(x > px)
+      __m128i outside = _mm_or_si128(
+          _mm_or_si128(_mm_cmpgt_epi32(vx, vpx),
+                       _mm_cmpgt_epi32(vy, vpy)),
+          _mm_or_si128(
+              _mm_cmpgt_epi32(vpx, _mm_sub_epi32(_mm_add_epi32(vx, vw),
+                                                 _mm_set1_epi32(1))),
+              _mm_cmpgt_epi32(vpy, _mm_sub_epi32(_mm_add_epi32(vy, vh),
+                                                 _mm_set1_epi32(1)))));
+      int mask = ~_mm_movemask_ps(_mm_castsi128_ps(outside)) & 0xF;
+      if (mask != 0) {
+        return static_cast<BoxId>(base + 31 - __builtin_clz(mask));
+      }
+    }
+#endif
+    while (i-- > 0) {
+      if (px.raw >= xs[i] && px.raw < xs[i] + ws[i] && py.raw >= ys[i] &&
+          py.raw < ys[i] + hs[i]) {
+        return static_cast<BoxId>(i);
+      }
+    }
+    return NO_BOX;
+  }
+};
+
+GeometryTable export_geometry(const LayoutTree &tree) {
+  GeometryTable table;
+  table.resize(tree.size());
+  for (BoxId id = 0; id < tree.size(); id++) {
+    const Dimensions &d = tree[id].dims;
+    Rect border_box = d.border_box();
+    table.x[id] = border_box.x.raw;
+    table.y[id] = border_box.y.raw;
+    table.width[id] = border_box.width.raw;
+    table.height[id] = border_box.height.raw;
+    table.parent[id] = tree[id].parent;
+    table.subtree_size[id] = tree[id].subtree_size;
+
+    const EdgeSize *edges[3] = {&d.margin, &d.border, &d.padding};
+    std::vector<int32_t> *columns[3] = {table.margin, table.border,
+                                        table.padding};
+    for (int e = 0; e < 3; e++) {
+      columns[e][0][id] = edges[e]->left.raw;
+      columns[e][1][id] = edges[e]->right.raw;
+      columns[e][2][id] = edges[e]->top.raw;
+      columns[e][3][id] = edges[e]->bottom.raw;
+    }
+  }
+  return table;
+}
+
+#endif
@@ -0,0 +1,296 @@
+#ifndef GLYPH_ATLAS_CPP
+#define GLYPH_ATLAS_CPP
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "font.cpp"
+#include "layout.cpp"
+
+// One channel of coverage per pixel, a page is one GPU texture.
+const int ATLAS_PAGE_SIZE = 1024;
+// empty pixels around every glyph so filtering never picks up a neighbour
+const int ATLAS_PADDING = 1;
+
+// A glyph at one pixel size, somewhere in the atlas.
+struct AtlasGlyph {
+  // -1 for glyphs without pixels (spaces)
+  int page = -1;
+  int x = 0, y = 0, width = 0, height = 0;
+  // relative to the pen position on the baseline, like GlyphBitmap
+  int x0 = 0, y0 = 0;
+  size_t shelf = 0;
+  uint64_t last_used = 0;
+};
+
+// A row of glyphs of about the same height. Glyphs are added at `cursor`,
+// evicted ones leave holes that later glyphs can take.
+struct AtlasShelf {
+  int y = 0, height = 0;
+  int cursor = 0;
+  size_t glyphs = 0;
+  // x and width of the holes
+  std::vector<std::pair<int, int>> holes;
+};
+
+struct AtlasPage {
+  int size;
+  std::vector<unsigned char> pixels;
+  std::vector<AtlasShelf> shelves;
+  // shelves are stacked from the top down to here
+  int top = 0;
+  // changed since the last upload, at most one rect per shelf
+  std::vector<PixelRect> dirty;
+
+  explicit AtlasPage(int s)
+      : size(s), pixels(size_t(s) * s), dirty{PixelRect{0, 0, s, s}} {
+    // a covered pixel in the top left corner, solid rects sample it so
+    // they can go in the same draw call as the glyphs
+    int x, y;
+    size_t shelf;
+    this->allocate(1 + ATLAS_PADDING, 1 + ATLAS_PADDING, x, y, shelf);
+    this->pixels[0] = 255;
+  }
+
+  void mark_dirty(const PixelRect &r) {
+    for (PixelRect &d : this->dirty) {
+      if (d.y <= r.y && r.y + r.height <= d.y + d.height) {
+        // the same shelf, or the whole new page
+        int left = std::min(d.x, r.x);
+        int right = std::max(d.x + d.width, r.x + r.width);
+        d.x = left;
+        d.width = right - left;
+        return;
+      }
+    }
+    this->dirty.push_back(r);
+  }
+
+  // Finds room for a `width` x `height` block. Shelves only take glyphs
+  // that are not much shorter than they are, unless they are empty.
+  bool allocate(int width, int height, int &x, int &y, size_t &shelf_index) {
+    for (size_t i = 0; i < this->shelves.size(); i++) {
+      AtlasShelf &shelf = this->shelves[i];
+      if (shelf.height < height ||
+          (shelf.glyphs != 0 && shelf.height > height + height / 2)) {
+        continue;
+      }
+      for (size_t h = 0; h < shelf.holes.size(); h++) {
+        std::pair<int, int> &hole = shelf.holes[h];
+        if (hole.second >= width) {
+          x = hole.first;
+          hole.first += width;
+          hole.second -= width;
+          if (hole.second == 0) {
+            shelf.holes.erase(shelf.holes.begin() + h);
+          }
+          y = shelf.y;
+          shelf.glyphs++;
+          shelf_index = i;
+          return true;
+        }
+      }
+      if (this->size - shelf.cursor >= width) {
+        x = shelf.cursor;
+        shelf.cursor += width;
+        y = shelf.y;
+        shelf.glyphs++;
+        shelf_index = i;
+        return true;
+      }
+    }
+    if (this->size - this->top < height || width > this->size) {
+      return false;
+    }
+    AtlasShelf shelf;
+    shelf.y = this->top;
+    // round up so glyphs of neighbouring sizes share shelves
+    shelf.height = std::min((height + 3) & ~3, this->size - this->top);
+    shelf.cursor = width;
+    shelf.glyphs = 1;
+    this->top += shelf.height;
+    this->shelves.push_back(shelf);
+    x = 0;
+    y = shelf.y;
+    shelf_index = this->shelves.size() - 1;
+    return true;
+  }
+
+  void release(const AtlasGlyph &glyph) {
+    AtlasShelf &shelf = this->shelves[glyph.shelf];
+    if (--shelf.glyphs == 0) {
+      shelf.cursor = 0;
+      shelf.holes.clear();
+      return;
+    }
+    shelf.holes.emplace_back(glyph.x - ATLAS_PADDING,
+                             glyph.width + ATLAS_PADDING);
+  }
+};
+
+// which parts of which page have to go to the GPU
+struct AtlasUpload {
+  int page;
+  PixelRect rect;
+};
+
+struct AtlasStats {
+  size_t hits = 0;
+  size_t rasterized = 0;
+  size_t evicted = 0;
+  size_t uploaded_pixels = 0;
+};
+
+// Glyphs of page content at whatever sizes it uses, rasterized the first
+// time they are drawn and packed into pages on shelves. When the pages are
+// full the glyphs that were not used for the longest are evicted, never
+// the ones of the current frame. Only what changed since the last frame
+// is uploaded, so a new font size costs its glyphs and not a rebuild of
+// the whole atlas. Not thread safe, it belongs to the thread that paints.
+struct GlyphAtlas {
+  Font *font;
+  int page_size = ATLAS_PAGE_SIZE;
+  size_t max_pages = 4;
+
+  std::vector<std::unique_ptr<AtlasPage>> pages;
+  // (px << 32 | glyph index)
+  std::unordered_map<uint64_t, AtlasGlyph> glyphs;
+  uint64_t frame = 1;
+  // bumped whenever glyphs are evicted, anything holding on to atlas
+  // coordinates from before has to look them up again
+  uint64_t generation = 0;
+  AtlasStats stats;
+
+  explicit GlyphAtlas(Font &f = default_font()) : font(&f) {}
+
+  void add_page() {
+    this->pages.push_back(std::make_unique<AtlasPage>(this->page_size));
+  }
+
+  // glyphs looked up from now on belong to a new frame
+  void begin_frame() { this->frame++; }
+
+  // Null if the glyph does not fit even after evicting everything that is
+  // not used this frame.
+  const AtlasGlyph *glyph(FontSize &size, int glyph) {
+    uint64_t key = uint64_t(uint32_t(size.px)) << 32 | uint32_t(glyph);
+    auto it = this->glyphs.find(key);
+    if (it != this->glyphs.end()) {
+      it->second.last_used = this->frame;
+      this->stats.hits++;
+      return &it->second;
+    }
+
+    AtlasGlyph entry;
+    entry.last_used = this->frame;
+    int x1 = 0, y1 = 0;
+    if (this->font->loaded) {
+      stbtt_GetGlyphBitmapBox(&this->font->info, glyph, size.scale,
+                              size.scale, &entry.x0, &entry.y0, &x1, &y1);
+    }
+    entry.width = x1 - entry.x0;
+    entry.height = y1 - entry.y0;
+    if (entry.width > 0 && entry.height > 0 && !this->place(entry)) {
+      return nullptr;
+    }
+    if (entry.page >= 0) {
+      stbtt_MakeGlyphBitmap(&this->font->info, this->pixels(entry), entry.width,
+                            entry.height, this->page_size, size.scale,
+                            size.scale, glyph);
+    }
+    this->stats.rasterized++;
+    return &this->glyphs.emplace(key, entry).first->second;
+  }
+
+  // coverage of a placed glyph, rows are page_size apart
+  unsigned char *pixels(const AtlasGlyph &glyph) const {
+    AtlasPage &page = *this->pages[glyph.page];
+    return &page.pixels[size_t(glyph.y) * page.size + glyph.x];
+  }
+
+  // what changed since the last call, the pages count as clean after it
+  void take_uploads(std::vector<AtlasUpload> &out) {
+    out.clear();
+    for (size_t i = 0; i < this->pages.size(); i++) {
+      for (const PixelRect &dirty : this->pages[i]->dirty) {
+        out.push_back(AtlasUpload{static_cast<int>(i), dirty});
+        this->stats.uploaded_pixels += size_t(dirty.width) * dirty.height;
+      }
+      this->pages[i]->dirty.clear();
+    }
+  }
+
+  // finds room for `entry` and clears it, evicting if it has to
+  bool place(AtlasGlyph &entry) {
+    int width = entry.width + ATLAS_PADDING;
+    int height = entry.height + ATLAS_PADDING;
+    if (width > this->page_size || height > this->page_size) {
+      return false;
+    }
+    for (int attempt = 0; attempt < 2; attempt++) {
+      for (size_t i = 0; i <= this->pages.size(); i++) {
+        if (i == this->pages.size()) {
+          if (this->pages.size() >= this->max_pages) {
+            break;
+          }
+          this->add_page();
+        }
+        AtlasPage &page = *this->pages[i];
+        int x, y;
+        if (page.allocate(width, height, x, y, entry.shelf)) {
+          entry.page = static_cast<int>(i);
+          // the padding goes left of and above the glyph
+          entry.x = x + ATLAS_PADDING;
+          entry.y = y + ATLAS_PADDING;
+          for (int row = y; row < y + height; row++) {
+            std::fill_n(&page.pixels[size_t(row) * page.size + x], width, 0);
+          }
+          // as tall as the shelf, so it stays one rect per shelf
+          page.mark_dirty(
+              PixelRect{x, y, width, page.shelves[entry.shelf].height});
+          return true;
+        }
+      }
+      if (attempt == 0 && !this->evict()) {
+        break;
+      }
+    }
+    return false;
+  }
+
+  // Drops the older half of the glyphs not used this frame, a lot at once
+  // so a full atlas does not go through this for every new glyph.
+  bool evict() {
+    std::vector<uint64_t> ages;
+    for (const auto &entry : this->glyphs) {
+      if (entry.second.last_used < this->frame) {
+        ages.push_back(entry.second.last_used);
+      }
+    }
+    if (ages.empty()) {
+      return false;
+    }
+    size_t middle = ages.size() / 2;
+    std::nth_element(ages.begin(), ages.begin() + middle, ages.end());
+    uint64_t cutoff = ages[middle];
+    for (auto it = this->glyphs.begin(); it != this->glyphs.end();) {
+      const AtlasGlyph &glyph = it->second;
+      if (glyph.last_used <= cutoff && glyph.last_used < this->frame) {
+        if (glyph.page >= 0) {
+          this->pages[glyph.page]->release(glyph);
+        }
+        this->stats.evicted++;
+        it = this->glyphs.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    this->generation++;
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,247 @@
+// Runs the engine from HTML and CSS files to a display list without a
+// window, GLFW or ImGui, for batch jobs and performance tracking. Prints
+// how long every stage took, how many heap allocations it made and how
+// many nodes it produced; --dump prints what a stage produced as well.
+//
+//   make headless
+//   ./headless.exe page.html page.css [--width px] [--height px]
+//                  [--dump dom|css|style|layout|display|all]...
+//
+// A page that fails to load makes the exit code 1.
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <set>
+#include <sstream>
+
+#include "allocation_counter.cpp"
+#include "css_parser.cpp"
+#include "html_parser.cpp"
+#include "layout.cpp"
+#include "painter.cpp"
+
+bool read_file(const std::string &path, std::string &out) {
+  std::ifstream file(path);
+  if (!file) {
+    return false;
+  }
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  out = buffer.str();
+  return true;
+}
+
+struct StageStats {
+  const char *name;
+  double ms = 0;
+  size_t allocations = 0;
+  size_t nodes = 0;
+};
+
+// runs `stage` and records its time and allocations under `name`, the
+// caller fills in the nodes
+template <typename F>
+void run_stage(std::vector<StageStats> &stages, const char *name, F stage) {
+  size_t before = allocations;
+  auto start = std::chrono::steady_clock::now();
+  stage();
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  StageStats stats{name};
+  stats.ms = elapsed.count();
+  stats.allocations = allocations - before;
+  stages.push_back(stats);
+}
+
+size_t count_nodes(const Node *node) {
+  size_t count = 1;
+  for (const Node *child : node->children) {
+    count += count_nodes(child);
+  }
+  return count;
+}
+
+size_t count_nodes(const StyledNode &node) {
+  size_t count = 1;
+  for (const StyledNode &child : node.children) {
+    count += count_nodes(child);
+  }
+  return count;
+}
+
+void indent(std::ostream &os, int depth) {
+  for (int i = 0; i < depth; i++) {
+    os << "  ";
+  }
+}
+
+// one line per node: the tag and its attributes, or the text
+void dump_node(std::ostream &os, const Node *node, int depth = 0) {
+  indent(os, depth);
+  if (node->type == NodeType::Element) {
+    const ElementNode *element = static_cast<const ElementNode *>(node);
+    os << "<" << element->name;
+    for (const auto &attr : element->attrs) {
+      os << " " << attr.first << "=\"" << attr.second << "\"";
+    }
+    os << ">\n";
+  } else if (node->type == NodeType::Text) {
+    os << "\"" << static_cast<const TextNode *>(node)->content << "\"\n";
+  } else {
+    os << "?\n";
+  }
+  for (const Node *child : node->children) {
+    dump_node(os, child, depth + 1);
+  }
+}
+
+void dump_styled_node(std::ostream &os, const StyledNode &node,
+                      int depth = 0) {
+  indent(os, depth);
+  if (node.node && node.node->type == NodeType::Element) {
+    os << static_cast<const ElementNode *>(node.node)->name;
+  } else {
+    os << "text";
+  }
+  for (const auto &value : node.values) {
+    os << " " << value.first << ": ";
+    std::visit([&](const auto &v) { os << v; }, value.second);
+    os << ";";
+  }
+  os << "\n";
+  for (const StyledNode &child : node.children) {
+    dump_styled_node(os, child, depth + 1);
+  }
+}
+
+// the type and border box of every box, and its lines of text
+void dump_layout_box(std::ostream &os, const LayoutTree &tree, BoxId id,
+                     int depth = 0) {
+  const LayoutBox &box = tree[id];
+  indent(os, depth);
+  switch (box.type) {
+  case BoxType::b_BLOCK:
+    os << "block";
+    break;
+  case BoxType::b_INLINE:
+    os << "inline";
+    break;
+  case BoxType::b_ANON:
+    os << "anonymous";
+    break;
+  }
+  os << " " << box.dims.border_box() << "\n";
+  for (const TextFragment &fragment : box.fragments) {
+    indent(os, depth + 1);
+    os << fragment.rect << " \"";
+    os.write(fragment.text->data() + fragment.start, fragment.length);
+    os << "\"\n";
+  }
+  for (BoxId child = box.first_child; child != NO_BOX;
+       child = tree[child].next_sibling) {
+    dump_layout_box(os, tree, child, depth + 1);
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    std::cout << "usage: " << argv[0]
+              << " page.html page.css [--width px] [--height px]"
+                 " [--dump dom|css|style|layout|display|all]..."
+              << std::endl;
+    return 2;
+  }
+  int width = 1280, height = 720;
+  std::set<std::string> dumps;
+  for (int i = 3; i < argc; i++) {
+    if (std::strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+      width = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--height") == 0 && i + 1 < argc) {
+      height = std::atoi(argv[++i]);
+    } else if (std::strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+      dumps.insert(argv[++i]);
+    }
+  }
+  auto dump = [&](const char *stage) {
+    if (dumps.count(stage) == 0 && dumps.count("all") == 0) {
+      return false;
+    }
+    std::cout << "== " << stage << "\n";
+    return true;
+  };
+
+  std::string html, css;
+  if (!read_file(argv[1], html) || !read_file(argv[2], css)) {
+    std::cout << "Failed to read " << argv[1] << " or " << argv[2]
+              << std::endl;
+    return 1;
+  }
+
+  std::vector<StageStats> stages;
+  Node *root = nullptr;
+  run_stage(stages, "parse_html", [&] { root = parse_html(html); });
+  stages.back().nodes = count_nodes(root);
+  if (dump("dom")) {
+    dump_node(std::cout, root);
+  }
+
+  // through the stylesheet cache, like the window loads it
+  SharedStyleSheet sheet;
+  run_stage(stages, "load_stylesheet", [&] { sheet = load_stylesheet(css); });
+  stages.back().nodes = sheet->rules.size();
+  if (dump("css")) {
+    std::cout << *sheet << "\n";
+  }
+
+  StyledNode styled_root;
+  run_stage(stages, "style_tree",
+            [&] { styled_root = style_tree(root, *sheet); });
+  stages.back().nodes = count_nodes(styled_root);
+  if (dump("style")) {
+    dump_styled_node(std::cout, styled_root);
+  }
+
+  LayoutTree tree;
+  run_stage(stages, "build_layout_tree",
+            [&] { tree = build_layout_tree(styled_root); });
+  stages.back().nodes = tree.size();
+
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(width);
+  tree.viewport = viewport.content;
+  tree.viewport.height = LayoutUnit::from_px(height);
+  run_stage(stages, "layout", [&] { tree.layout(viewport); });
+  stages.back().nodes = tree.stats.laid_out;
+  if (dump("layout") && tree.root != NO_BOX) {
+    dump_layout_box(std::cout, tree, tree.root);
+  }
+
+  DisplayList list;
+  run_stage(stages, "build_display_list",
+            [&] { list = build_display_list(tree); });
+  stages.back().nodes = list.size();
+  if (dump("display")) {
+    for (const CommandHeader &command : list) {
+      std::cout << command << "\n";
+    }
+  }
+
+  // nodes are what the stage made: DOM nodes, rules, styled nodes, boxes,
+  // boxes laid out and display commands
+  std::cout << std::left << std::setw(20) << "stage" << std::setw(12) << "ms"
+            << std::setw(14) << "allocations" << "nodes" << std::endl;
+  StageStats total{"total"};
+  for (const StageStats &stage : stages) {
+    std::cout << std::setw(20) << stage.name << std::setw(12) << stage.ms
+              << std::setw(14) << stage.allocations << stage.nodes
+              << std::endl;
+    total.ms += stage.ms;
+    total.allocations += stage.allocations;
+  }
+  std::cout << std::setw(20) << total.name << std::setw(12) << total.ms
+            << std::setw(14) << total.allocations << std::endl;
+  return 0;
+}
@@ -36,7 +36,8 @@ struct Node {
   std::vector<Node *> children;
 
   Node(NodeType t = NodeType::Unknown) : type(t) {}
-  Node(NodeType t, std::vector<Node *> c) : type(t), children(c) {}
+  Node(NodeType t, std::vector<Node *> c)
+      : type(t), children(std::move(c)) {}
 
   // TODO this causes a segfault so lets just leak
   // virtual ~Node() {
@@ -65,7 +66,7 @@ struct Node {
 
 struct TextNode : public Node {
   std::string content;
-  TextNode(std::string c) : Node(NodeType::Text), content(c) {}
+  TextNode(std::string c) : Node(NodeType::Text), content(std::move(c)) {}
 
   std::ostream &print(std::ostream &os) const override {
     Node::print(os);
@@ -103,9 +104,10 @@ struct ElementNode : public Node {
   AttributeMap attrs;
 
   ElementNode(std::string n, AttributeMap a)
-      : Node(NodeType::Element), name(n), attrs(a) {}
+      : Node(NodeType::Element), name(std::move(n)), attrs(std::move(a)) {}
   ElementNode(std::string n, AttributeMap a, std::vector<Node *> c)
-      : Node(NodeType::Element, c), name(n), attrs(a) {}
+      : Node(NodeType::Element, std::move(c)), name(std::move(n)),
+        attrs(std::move(a)) {}
   std::ostream &print(std::ostream &os) const override {
     Node::print(os);
     os << "ElementNode (Type: " << this->type << ")\n";
@@ -115,28 +117,50 @@ struct ElementNode : public Node {
     return os;
   }
 
-  std::string id() { return attrs.at("id"); }
+  std::string id() const { return attrs.at("id"); }
 
-  std::set<std::string> classes() {
+  std::set<std::string> classes() const {
     std::set<std::string> s;
-    try {
-      std::string classes_str = attrs.at("class");
-      auto classes = split(classes_str, " ");
-      for (auto class_ : classes) {
-        s.insert(class_);
-      }
-    } catch (const std::exception &e) {
+    // most elements have no class, dont pay for an exception on those
+    auto it = attrs.find("class");
+    if (it == attrs.end()) {
       return s;
     }
+    for (auto &class_ : split(it->second, " ")) {
+      s.insert(std::move(class_));
+    }
     return s;
   }
+
+  // whether `name` is one of the classes, looked for in the attribute in
+  // place since selector matching asks for every rule and element
+  bool has_class(const std::string &name) const {
+    auto it = attrs.find("class");
+    if (it == attrs.end()) {
+      return false;
+    }
+    const std::string &list = it->second;
+    for (size_t start = 0;;) {
+      size_t end = std::min(list.find(' ', start), list.size());
+      if (list.compare(start, end - start, name) == 0) {
+        return true;
+      }
+      if (end == list.size()) {
+        return false;
+      }
+      start = end + 1;
+    }
+  }
 };
 
-TextNode *createText(std::string content) { return new TextNode(content); }
+TextNode *createText(std::string content) {
+  return new TextNode(std::move(content));
+}
 
 ElementNode *createElement(std::string name, AttributeMap attrs,
                            std::vector<Node *> children) {
-  return new ElementNode(name, attrs, children);
+  return new ElementNode(std::move(name), std::move(attrs),
+                         std::move(children));
 }
 
 struct HtmlParser : public Parser {
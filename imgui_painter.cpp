@@ -0,0 +1,713 @@
+#ifndef IMGUI_PAINTER_CPP
+#define IMGUI_PAINTER_CPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "imgui/imgui.h"
+
+#include "display_list.cpp"
+#include "glyph_atlas.cpp"
+
+// straight alpha, like the ImGui backends blend
+ImU32 im_color(PackedColor packed) {
+  Color color = unpack_color(packed);
+  return IM_COL32(color.r, color.g, color.b, color.a);
+}
+
+const float PI = 3.14159265f;
+
+// outer and inner edge of a border, snapped like the software rasterizer
+// does it
+void border_edges(const BorderCommand &border, PixelRect &outer,
+                  PixelRect &inner) {
+  Rect box = border.box.rect();
+  LayoutUnit top = LayoutUnit::from_raw(border.widths[SIDE_TOP]);
+  LayoutUnit right = LayoutUnit::from_raw(border.widths[SIDE_RIGHT]);
+  LayoutUnit bottom = LayoutUnit::from_raw(border.widths[SIDE_BOTTOM]);
+  LayoutUnit left = LayoutUnit::from_raw(border.widths[SIDE_LEFT]);
+  outer = box.snapped();
+  inner = Rect{box.x + left, box.y + top, box.width - left - right,
+               box.height - top - bottom}
+              .snapped();
+}
+
+// square corners and one color, so the border is just rects
+bool is_square_border(const BorderCommand &border) {
+  for (int i = 0; i < 4; i++) {
+    if (border.radii[i] != 0 || border.colors[i] != border.colors[0]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The rects of a square border, top and bottom across the whole box and
+// the sides between them so they do not overlap. Some can be empty.
+void square_border_rects(const BorderCommand &border, PixelRect rects[4]) {
+  PixelRect o, i;
+  border_edges(border, o, i);
+  int right = o.x + o.width, bottom = o.y + o.height;
+  int inner_top = std::clamp(i.y, o.y, bottom);
+  int inner_bottom = std::clamp(i.y + i.height, inner_top, bottom);
+  rects[SIDE_TOP] = PixelRect{o.x, o.y, o.width, inner_top - o.y};
+  rects[SIDE_BOTTOM] =
+      PixelRect{o.x, inner_bottom, o.width, bottom - inner_bottom};
+  rects[SIDE_LEFT] =
+      PixelRect{o.x, inner_top, i.x - o.x, inner_bottom - inner_top};
+  rects[SIDE_RIGHT] = PixelRect{i.x + i.width, inner_top,
+                                right - i.x - i.width,
+                                inner_bottom - inner_top};
+}
+
+// a background with rounded corners, as one convex path ImGui antialiases
+void add_rounded_rect(ImDrawList *draw_list, const RoundedRectCommand &rect,
+                      const ImVec2 &origin) {
+  PixelRect box = rect.box.rect().snapped();
+  float left = origin.x + box.x, top = origin.y + box.y;
+  float right = left + box.width, bottom = top + box.height;
+  // corner points and where each arc starts, clockwise from the top left
+  ImVec2 corners[4] = {ImVec2(left, top), ImVec2(right, top),
+                       ImVec2(right, bottom), ImVec2(left, bottom)};
+  for (int c = 0; c < 4; c++) {
+    float r = LayoutUnit::from_raw(rect.radii[c]).to_float();
+    if (r <= 0) {
+      draw_list->PathLineTo(corners[c]);
+      continue;
+    }
+    ImVec2 center(corners[c].x + (c == 0 || c == 3 ? r : -r),
+                  corners[c].y + (c < 2 ? r : -r));
+    float start = PI * (1.0f + 0.5f * c);
+    draw_list->PathArcTo(center, r, start, start + PI * 0.5f);
+  }
+  draw_list->PathFillConvex(im_color(rect.color));
+}
+
+// Any other border, as a strip of quads around the box with a pixel of
+// fringe fading out on both edges for antialiasing. Each corner is split
+// in the middle between the colors of its two sides.
+void add_border(ImDrawList *draw_list, const BorderCommand &border,
+                const ImVec2 &origin) {
+  PixelRect o, i;
+  border_edges(border, o, i);
+  if (i.width <= 0 || i.height <= 0) {
+    // the border fills the box
+    RoundedRectCommand rect;
+    rect.color = border.colors[SIDE_TOP];
+    rect.box = border.box;
+    std::copy(border.radii, border.radii + 4, rect.radii);
+    add_rounded_rect(draw_list, rect, origin);
+    return;
+  }
+  float widths[4] = {float(i.y - o.y), float(o.x + o.width - i.x - i.width),
+                     float(o.y + o.height - i.y - i.height), float(i.x - o.x)};
+  ImVec2 outer[4] = {ImVec2(o.x, o.y), ImVec2(o.x + o.width, o.y),
+                     ImVec2(o.x + o.width, o.y + o.height),
+                     ImVec2(o.x, o.y + o.height)};
+  ImVec2 inner[4] = {ImVec2(i.x, i.y), ImVec2(i.x + i.width, i.y),
+                     ImVec2(i.x + i.width, i.y + i.height),
+                     ImVec2(i.x, i.y + i.height)};
+
+  struct Sample {
+    ImVec2 outer, inner, normal;
+    // of the segment to the next sample
+    ImU32 color;
+  };
+  std::vector<Sample> samples;
+  for (int c = 0; c < 4; c++) {
+    float r = LayoutUnit::from_raw(border.radii[c]).to_float();
+    float sx = c == 0 || c == 3 ? 1.0f : -1.0f;
+    float sy = c < 2 ? 1.0f : -1.0f;
+    float horizontal = widths[c == 0 || c == 3 ? SIDE_LEFT : SIDE_RIGHT];
+    float vertical = widths[c < 2 ? SIDE_TOP : SIDE_BOTTOM];
+    ImVec2 outer_center(outer[c].x + sx * r, outer[c].y + sy * r);
+    ImVec2 inner_center(outer[c].x + sx * std::max(r, horizontal),
+                        outer[c].y + sy * std::max(r, vertical));
+    float rx = std::max(r - horizontal, 0.0f);
+    float ry = std::max(r - vertical, 0.0f);
+    // the side before the corner and the one after it, going clockwise
+    ImU32 before = im_color(border.colors[(c + 3) % 4]);
+    ImU32 after = im_color(border.colors[c]);
+    int segments = r > 0 ? std::clamp(static_cast<int>(r) / 2 * 2 + 2, 2, 16)
+                         : 2;
+    for (int k = 0; k <= segments; k++) {
+      float angle = PI * (1.0f + 0.5f * c) + PI * 0.5f * k / segments;
+      ImVec2 normal(std::cos(angle), std::sin(angle));
+      Sample sample;
+      if (r > 0) {
+        sample.outer = ImVec2(outer_center.x + r * normal.x,
+                              outer_center.y + r * normal.y);
+        sample.inner = ImVec2(inner_center.x + rx * normal.x,
+                              inner_center.y + ry * normal.y);
+      } else {
+        // a square corner, the fringe goes out along the miter
+        float m = std::max(std::fabs(normal.x), std::fabs(normal.y));
+        normal = ImVec2(normal.x / m, normal.y / m);
+        sample.outer = outer[c];
+        sample.inner = inner[c];
+      }
+      sample.normal = normal;
+      sample.color = k < segments / 2 ? before : after;
+      samples.push_back(sample);
+    }
+  }
+
+  ImVec2 uv = ImGui::GetFontTexUvWhitePixel();
+  size_t count = samples.size();
+  draw_list->PrimReserve(static_cast<int>(count * 18),
+                         static_cast<int>(count * 12));
+  for (size_t k = 0; k < count; k++) {
+    const Sample &a = samples[k];
+    const Sample &b = samples[(k + 1) % count];
+    ImU32 color = a.color;
+    ImU32 clear = color & ~IM_COL32_A_MASK;
+    auto at = [](const ImVec2 &p, const ImVec2 &n, float d) {
+      return ImVec2(p.x + n.x * d, p.y + n.y * d);
+    };
+    // outer fringe, body, inner fringe; each from a to b
+    ImVec2 points[12] = {
+        at(a.outer, a.normal, 0.5f),  at(b.outer, b.normal, 0.5f),
+        at(b.outer, b.normal, -0.5f), at(a.outer, a.normal, -0.5f),
+        at(a.outer, a.normal, -0.5f), at(b.outer, b.normal, -0.5f),
+        at(b.inner, b.normal, 0.5f),  at(a.inner, a.normal, 0.5f),
+        at(a.inner, a.normal, 0.5f),  at(b.inner, b.normal, 0.5f),
+        at(b.inner, b.normal, -0.5f), at(a.inner, a.normal, -0.5f)};
+    ImU32 colors[12] = {clear, clear, color, color, color, color,
+                        color, color, color, color, clear, clear};
+    ImDrawIdx first = static_cast<ImDrawIdx>(draw_list->_VtxCurrentIdx);
+    for (int q = 0; q < 3; q++) {
+      ImDrawIdx base = static_cast<ImDrawIdx>(first + q * 4);
+      for (int index : {0, 1, 2, 0, 2, 3}) {
+        draw_list->PrimWriteIdx(static_cast<ImDrawIdx>(base + index));
+      }
+    }
+    for (int v = 0; v < 12; v++) {
+      draw_list->PrimWriteVtx(points[v], uv, colors[v]);
+    }
+  }
+}
+
+// The straightforward translation, one ImGui call per command. Kept as the
+// reference the batched painter is benchmarked against.
+void paint_item(ImDrawList *draw_list, const CommandHeader &command,
+                const ImVec2 &origin) {
+  switch (command.op()) {
+  case DisplayOp::SOLID_COLOR: {
+    const SolidColorCommand &solid = command.as<SolidColorCommand>();
+    PixelRect box = solid.box.rect().snapped();
+    draw_list->AddRectFilled(
+        ImVec2(origin.x + box.x, origin.y + box.y),
+        ImVec2(origin.x + box.x + box.width, origin.y + box.y + box.height),
+        im_color(solid.color));
+  } break;
+  case DisplayOp::TEXT: {
+    const TextCommand &text = command.as<TextCommand>();
+    PixelRect box = text.box.rect().snapped();
+    draw_list->AddText(ImGui::GetFont(), text.font_size,
+                       ImVec2(origin.x + box.x, origin.y + box.y),
+                       im_color(text.color), text.text(),
+                       text.text() + text.length);
+  } break;
+  case DisplayOp::BORDER: {
+    const BorderCommand &border = command.as<BorderCommand>();
+    if (!is_square_border(border)) {
+      add_border(draw_list, border, origin);
+      break;
+    }
+    PixelRect rects[4];
+    square_border_rects(border, rects);
+    for (const PixelRect &r : rects) {
+      if (r.width > 0 && r.height > 0) {
+        draw_list->AddRectFilled(
+            ImVec2(origin.x + r.x, origin.y + r.y),
+            ImVec2(origin.x + r.x + r.width, origin.y + r.y + r.height),
+            im_color(border.colors[0]));
+      }
+    }
+  } break;
+  case DisplayOp::ROUNDED_RECT:
+    add_rounded_rect(draw_list, command.as<RoundedRectCommand>(), origin);
+    break;
+  }
+}
+
+// rects per PrimReserve, 4 vertices each have to fit 16 bit indices
+const size_t MAX_BATCH_RECTS = 0xffff / 4;
+
+struct BatchedRect {
+  PixelRect box;
+  ImU32 color;
+};
+
+// corners and texture coordinates, like PrimRectUV takes them
+struct Quad {
+  ImVec2 a, b, uv_a, uv_b;
+  ImU32 color;
+};
+
+// Writes the vertices and indices of `quads` straight into the draw list,
+// the same ones PrimRectUV would, with one PrimReserve per
+// MAX_BATCH_RECTS. Returns the number of PrimReserve calls.
+size_t write_quads(ImDrawList *draw_list, const Quad *quads, size_t size) {
+  size_t reserves = 0;
+  for (size_t first = 0; first < size; first += MAX_BATCH_RECTS) {
+    size_t count = std::min(size - first, MAX_BATCH_RECTS);
+    draw_list->PrimReserve(static_cast<int>(count * 6),
+                           static_cast<int>(count * 4));
+    ImDrawVert *vtx = draw_list->_VtxWritePtr;
+    ImDrawIdx *idx = draw_list->_IdxWritePtr;
+    ImDrawIdx base = static_cast<ImDrawIdx>(draw_list->_VtxCurrentIdx);
+    for (size_t i = first; i < first + count; i++) {
+      const Quad &q = quads[i];
+      vtx[0] = ImDrawVert{q.a, q.uv_a, q.color};
+      vtx[1] = ImDrawVert{ImVec2(q.b.x, q.a.y), ImVec2(q.uv_b.x, q.uv_a.y),
+                          q.color};
+      vtx[2] = ImDrawVert{q.b, q.uv_b, q.color};
+      vtx[3] = ImDrawVert{ImVec2(q.a.x, q.b.y), ImVec2(q.uv_a.x, q.uv_b.y),
+                          q.color};
+      idx[0] = base;
+      idx[1] = static_cast<ImDrawIdx>(base + 1);
+      idx[2] = static_cast<ImDrawIdx>(base + 2);
+      idx[3] = base;
+      idx[4] = static_cast<ImDrawIdx>(base + 2);
+      idx[5] = static_cast<ImDrawIdx>(base + 3);
+      vtx += 4;
+      idx += 6;
+      base = static_cast<ImDrawIdx>(base + 4);
+    }
+    draw_list->_VtxWritePtr = vtx;
+    draw_list->_IdxWritePtr = idx;
+    draw_list->_VtxCurrentIdx += static_cast<unsigned int>(count * 4);
+    reserves++;
+  }
+  return reserves;
+}
+
+// a glyph quad and the atlas page it samples
+struct GlyphQuad {
+  int page;
+  Quad quad;
+};
+
+struct ImGuiPaintStats {
+  size_t rects = 0;
+  size_t merged = 0;
+  size_t texts = 0;
+  size_t batches = 0;
+  // rounded backgrounds and borders that are not just rects, as paths
+  size_t shapes = 0;
+  // rects and texts outside the clip rect, dropped
+  size_t culled = 0;
+};
+
+// `into` grows to cover `r` too, if the two of them make up a rect
+bool merge_rect(PixelRect &into, const PixelRect &r) {
+  int right = into.x + into.width, bottom = into.y + into.height;
+  int r_right = r.x + r.width, r_bottom = r.y + r.height;
+  if (r.x >= into.x && r.y >= into.y && r_right <= right &&
+      r_bottom <= bottom) {
+    return true;
+  }
+  if (into.x >= r.x && into.y >= r.y && right <= r_right &&
+      bottom <= r_bottom) {
+    into = r;
+    return true;
+  }
+  // stacked on top of each other, or side by side, touching or overlapping
+  bool columns = r.x == into.x && r.width == into.width &&
+                 r.y <= bottom && r_bottom >= into.y;
+  bool rows = r.y == into.y && r.height == into.height && r.x <= right &&
+              r_right >= into.x;
+  if (!columns && !rows) {
+    return false;
+  }
+  int left = std::min(into.x, r.x), top = std::min(into.y, r.y);
+  into = PixelRect{left, top, std::max(right, r_right) - left,
+                   std::max(bottom, r_bottom) - top};
+  return true;
+}
+
+bool overlaps(const PixelRect &a, const PixelRect &b) {
+  return a.x < b.x + b.width && b.x < a.x + a.width && a.y < b.y + b.height &&
+         b.y < a.y + a.height;
+}
+
+// Translates a display list to ImDrawList primitives. Solid colors are
+// merged with the rect before them when they share its (opaque) color and
+// make up one rect together, and written out with one PrimReserve per
+// batch instead of one AddRectFilled each. Text is held back and painted
+// after the batch, so a batch only ends at a rect that would be painted
+// over text held back (or at a shape). Text goes through ImGui's font, or
+// through a GlyphAtlas that has every size the page uses. With the atlas,
+// rects sample the white pixel of an atlas page and the glyphs of all the
+// texts held back are written a page at a time, so the texture only
+// changes when the glyphs move to another page.
+struct ImGuiPainter {
+  ImFont *font = nullptr;
+  // glyphs come from here when set, the owner calls begin_frame() on it
+  // once per frame and uploads what changed
+  GlyphAtlas *atlas = nullptr;
+  // the texture of an atlas page
+  std::function<ImTextureID(int)> page_texture;
+  // counters for the last paint() call
+  ImGuiPaintStats stats;
+
+  // scratch, kept between frames
+  std::vector<BatchedRect> batch;
+  // text held back until the batch is written, the layout units their
+  // boxes cover and how many pixels their glyphs can reach past that
+  std::vector<const TextCommand *> texts;
+  int64_t text_left, text_top, text_right, text_bottom;
+  int text_margin;
+  // the clip rect of the draw list in page pixels and in layout units
+  PixelRect clip;
+  PackedRect text_clip;
+  std::vector<Quad> quads;
+  std::vector<GlyphQuad> glyphs;
+  // the atlas page the draw list samples, with an atlas
+  int page = 0;
+
+  // paints the commands at `offsets` in order, with the page origin at
+  // `origin` in screen coordinates
+  void paint(const DisplayList &list, const std::vector<uint32_t> &offsets,
+             ImDrawList *draw_list, const ImVec2 &origin) {
+    this->stats = ImGuiPaintStats();
+    this->batch.clear();
+    this->texts.clear();
+    ImVec2 clip_min = draw_list->GetClipRectMin();
+    ImVec2 clip_max = draw_list->GetClipRectMax();
+    int left = static_cast<int>(std::floor(clip_min.x - origin.x));
+    int top = static_cast<int>(std::floor(clip_min.y - origin.y));
+    this->clip = PixelRect{
+        left, top, static_cast<int>(std::ceil(clip_max.x - origin.x)) - left,
+        static_cast<int>(std::ceil(clip_max.y - origin.y)) - top};
+    this->text_clip = pack_rect(Rect{LayoutUnit::from_px(this->clip.x),
+                                     LayoutUnit::from_px(this->clip.y),
+                                     LayoutUnit::from_px(this->clip.width),
+                                     LayoutUnit::from_px(this->clip.height)});
+    if (this->atlas) {
+      if (this->atlas->pages.empty()) {
+        // for its white pixel
+        this->atlas->add_page();
+      }
+      this->page = 0;
+      draw_list->PushTextureID(this->page_texture(this->page));
+    }
+    for (uint32_t offset : offsets) {
+      const CommandHeader &command = list.at(offset);
+      switch (command.op()) {
+      case DisplayOp::SOLID_COLOR: {
+        const SolidColorCommand &solid = command.as<SolidColorCommand>();
+        this->add_rect(solid.box.rect().snapped(), solid.color, draw_list,
+                       origin);
+      } break;
+      case DisplayOp::BORDER: {
+        const BorderCommand &border = command.as<BorderCommand>();
+        if (is_square_border(border)) {
+          PixelRect rects[4];
+          square_border_rects(border, rects);
+          for (const PixelRect &r : rects) {
+            this->add_rect(r, border.colors[0], draw_list, origin);
+          }
+        } else {
+          this->flush(draw_list, origin);
+          this->begin_shape(draw_list);
+          add_border(draw_list, border, origin);
+          this->end_shape(draw_list);
+        }
+      } break;
+      case DisplayOp::ROUNDED_RECT:
+        this->flush(draw_list, origin);
+        this->begin_shape(draw_list);
+        add_rounded_rect(draw_list, command.as<RoundedRectCommand>(), origin);
+        this->end_shape(draw_list);
+        break;
+      case DisplayOp::TEXT: {
+        // this runs for every glyph run on the page, so only layout units
+        // here and exact bounds once a rect comes close
+        const TextCommand &text = command.as<TextCommand>();
+        if (!intersects(paint_bounds(command), this->text_clip)) {
+          this->stats.culled++;
+          break;
+        }
+        int64_t right = int64_t(text.box.x) + text.box.width;
+        int64_t bottom = int64_t(text.box.y) + text.box.height;
+        int overflow = text_overflow(text.font_size);
+        if (this->texts.empty()) {
+          this->text_left = text.box.x;
+          this->text_top = text.box.y;
+          this->text_right = right;
+          this->text_bottom = bottom;
+          this->text_margin = overflow;
+        } else {
+          this->text_left = std::min<int64_t>(this->text_left, text.box.x);
+          this->text_top = std::min<int64_t>(this->text_top, text.box.y);
+          this->text_right = std::max(this->text_right, right);
+          this->text_bottom = std::max(this->text_bottom, bottom);
+          this->text_margin = std::max(this->text_margin, overflow);
+        }
+        this->texts.push_back(&text);
+      } break;
+      }
+    }
+    this->flush(draw_list, origin);
+    if (this->atlas) {
+      draw_list->PopTextureID();
+    }
+  }
+
+  // ImGui paths sample the white pixel of its own font texture
+  void begin_shape(ImDrawList *draw_list) {
+    if (this->atlas) {
+      draw_list->PushTextureID(ImGui::GetIO().Fonts->TexID);
+    }
+  }
+
+  void end_shape(ImDrawList *draw_list) {
+    if (this->atlas) {
+      draw_list->PopTextureID();
+    }
+    this->stats.shapes++;
+  }
+
+  // whether `box` would be painted over text held back
+  bool covers_text(const PixelRect &box) const {
+    if (this->texts.empty()) {
+      return false;
+    }
+    int overflow = this->text_margin;
+    int left = LayoutUnit::from_raw(this->text_left).round() - overflow;
+    int top = LayoutUnit::from_raw(this->text_top).round() - overflow;
+    PixelRect all{left, top,
+                  LayoutUnit::from_raw(this->text_right).round() + overflow -
+                      left,
+                  LayoutUnit::from_raw(this->text_bottom).round() + overflow -
+                      top};
+    if (!overlaps(box, all)) {
+      return false;
+    }
+    for (const TextCommand *text : this->texts) {
+      if (overlaps(box, paint_bounds(text->header).rect().snapped())) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void add_rect(const PixelRect &box, PackedColor packed, ImDrawList *draw_list,
+                const ImVec2 &origin) {
+    if (box.width <= 0 || box.height <= 0) {
+      // sides of a border without width
+      return;
+    }
+    if (!overlaps(box, this->clip)) {
+      this->stats.culled++;
+      return;
+    }
+    if (this->covers_text(box)) {
+      this->flush(draw_list, origin);
+    }
+    ImU32 color = im_color(packed);
+    this->stats.rects++;
+    // translucent rects that overlap have to blend twice
+    bool opaque = (color >> IM_COL32_A_SHIFT & 0xff) == 255;
+    if (opaque && !this->batch.empty() && this->batch.back().color == color &&
+        merge_rect(this->batch.back().box, box)) {
+      this->stats.merged++;
+      return;
+    }
+    this->batch.push_back(BatchedRect{box, color});
+  }
+
+  void flush(ImDrawList *draw_list, const ImVec2 &origin) {
+    ImVec2 uv = ImGui::GetFontTexUvWhitePixel();
+    if (this->atlas) {
+      // the middle of the pixel at (0, 0)
+      uv = ImVec2(0.5f / this->atlas->page_size,
+                  0.5f / this->atlas->page_size);
+    }
+    this->quads.clear();
+    for (const BatchedRect &r : this->batch) {
+      ImVec2 a(origin.x + r.box.x, origin.y + r.box.y);
+      ImVec2 b(a.x + r.box.width, a.y + r.box.height);
+      this->quads.push_back(Quad{a, b, uv, uv, r.color});
+    }
+    this->stats.batches +=
+        write_quads(draw_list, this->quads.data(), this->quads.size());
+    this->batch.clear();
+
+    this->glyphs.clear();
+    for (const TextCommand *text : this->texts) {
+      if (this->atlas) {
+        this->add_glyphs(*text, origin);
+      } else {
+        PixelRect box = text->box.rect().snapped();
+        draw_list->AddText(this->font ? this->font : ImGui::GetFont(),
+                           text->font_size,
+                           ImVec2(origin.x + box.x, origin.y + box.y),
+                           im_color(text->color), text->text(),
+                           text->text() + text->length);
+      }
+      this->stats.texts++;
+    }
+    this->texts.clear();
+    if (this->atlas) {
+      this->write_glyphs(draw_list);
+    }
+  }
+
+  // Glyphs from the atlas at the same pixels the software rasterizer puts
+  // them, written out by write_glyphs().
+  void add_glyphs(const TextCommand &text, const ImVec2 &origin) {
+    Font &font = *this->atlas->font;
+    if (!font.loaded) {
+      return;
+    }
+    FontSize &size = font.at_size(static_cast<int>(text.font_size));
+    PixelRect box = text.box.rect().snapped();
+    float x = origin.x + box.x;
+    float baseline = origin.y + box.y + size.ascent.round();
+    float texel = 1.0f / this->atlas->page_size;
+    ImU32 color = im_color(text.color);
+    walk_glyphs(size, text.text(), text.length, [&](int glyph, int pen) {
+      const AtlasGlyph *g = this->atlas->glyph(size, glyph);
+      if (g == nullptr || g->page < 0) {
+        return;
+      }
+      ImVec2 a(x + pen + g->x0, baseline + g->y0);
+      ImVec2 b(a.x + g->width, a.y + g->height);
+      ImVec2 uv_a(g->x * texel, g->y * texel);
+      ImVec2 uv_b((g->x + g->width) * texel, (g->y + g->height) * texel);
+      this->glyphs.push_back(GlyphQuad{g->page, Quad{a, b, uv_a, uv_b, color}});
+    });
+  }
+
+  // The glyphs collected since the last flush, those on the page the draw
+  // list is on first and then the other pages in order. Glyphs on
+  // different pages only change order when the texts overlap each other.
+  void write_glyphs(ImDrawList *draw_list) {
+    int current = this->page;
+    std::stable_sort(this->glyphs.begin(), this->glyphs.end(),
+                     [current](const GlyphQuad &a, const GlyphQuad &b) {
+                       return std::make_pair(a.page != current, a.page) <
+                              std::make_pair(b.page != current, b.page);
+                     });
+    for (size_t first = 0; first < this->glyphs.size();) {
+      int page = this->glyphs[first].page;
+      this->quads.clear();
+      size_t end = first;
+      for (; end < this->glyphs.size() && this->glyphs[end].page == page;
+           end++) {
+        this->quads.push_back(this->glyphs[end].quad);
+      }
+      if (page != this->page) {
+        draw_list->PopTextureID();
+        draw_list->PushTextureID(this->page_texture(page));
+        this->page = page;
+      }
+      this->stats.batches +=
+          write_quads(draw_list, this->quads.data(), this->quads.size());
+      first = end;
+    }
+  }
+};
+
+struct DrawCacheStats {
+  size_t frames = 0;
+  // frames that had to paint the page again
+  size_t painted = 0;
+};
+
+// The page painted once into a draw list of its own, in page coordinates,
+// and handed to the renderer as separate draw data. Frames reuse it while
+// the display list stays the same and the screen stays inside the painted
+// area; scrolling only moves DisplayPos, which the renderer turns into its
+// projection, so a static page costs the same whatever is on it.
+struct PageDrawCache {
+  ImGuiPainter painter;
+  DrawCacheStats stats;
+  // screens painted above and below (and left and right of) the visible
+  // one, scrolling less than that reuses the cache
+  int margin_screens = 1;
+
+  std::unique_ptr<ImDrawList> draw_list;
+  ImDrawList *lists[1] = {nullptr};
+  ImDrawData draw_data;
+  // what the draw list holds, list version, atlas generation and page
+  // pixels
+  uint64_t version = 0;
+  uint64_t atlas_generation = 0;
+  PixelRect painted;
+  // scratch, kept between frames
+  std::vector<uint32_t> offsets;
+
+  // paints again on the next frame
+  void invalidate() { this->version = 0; }
+
+  // Draw data for the part of `list` at `scroll` (page pixels) filling a
+  // screen of `size`. Only valid until the next call; render it before
+  // ImGui's own draw data so the UI ends up on top.
+  ImDrawData *frame(const DisplayList &list, int scroll_x, int scroll_y,
+                    const ImVec2 &size) {
+    this->stats.frames++;
+    int width = static_cast<int>(size.x), height = static_cast<int>(size.y);
+    bool inside = scroll_x >= this->painted.x && scroll_y >= this->painted.y &&
+                  scroll_x + width <= this->painted.x + this->painted.width &&
+                  scroll_y + height <= this->painted.y + this->painted.height;
+    GlyphAtlas *atlas = this->painter.atlas;
+    bool evicted = atlas && atlas->generation != this->atlas_generation;
+    // unindexed lists have no version, they are painted every frame
+    if (list.version == 0 || list.version != this->version || !inside ||
+        evicted) {
+      this->paint(list, PixelRect{scroll_x - this->margin_screens * width,
+                                  scroll_y - this->margin_screens * height,
+                                  (1 + 2 * this->margin_screens) * width,
+                                  (1 + 2 * this->margin_screens) * height});
+      this->version = list.version;
+      this->atlas_generation = atlas ? atlas->generation : 0;
+    }
+
+    ImDrawData &data = this->draw_data;
+    data.Valid = true;
+    data.CmdLists = this->lists;
+    data.CmdListsCount = 1;
+    data.TotalVtxCount = this->draw_list->VtxBuffer.Size;
+    data.TotalIdxCount = this->draw_list->IdxBuffer.Size;
+    data.DisplayPos = ImVec2(scroll_x, scroll_y);
+    data.DisplaySize = size;
+    data.FramebufferScale = ImGui::GetIO().DisplayFramebufferScale;
+    return &data;
+  }
+
+  void paint(const DisplayList &list, const PixelRect &area) {
+    this->stats.painted++;
+    if (!this->draw_list) {
+      this->draw_list =
+          std::make_unique<ImDrawList>(ImGui::GetDrawListSharedData());
+      this->lists[0] = this->draw_list.get();
+    }
+    ImDrawList *draw_list = this->draw_list.get();
+    draw_list->_ResetForNewFrame();
+    draw_list->PushTextureID(ImGui::GetIO().Fonts->TexID);
+    // also culls the text outside of it
+    draw_list->PushClipRect(ImVec2(area.x, area.y),
+                            ImVec2(area.x + area.width, area.y + area.height));
+
+    list.query(Rect{LayoutUnit::from_px(area.x), LayoutUnit::from_px(area.y),
+                    LayoutUnit::from_px(area.width),
+                    LayoutUnit::from_px(area.height)},
+               this->offsets);
+    this->painter.paint(list, this->offsets, draw_list, ImVec2(0, 0));
+    draw_list->PopClipRect();
+    draw_list->PopTextureID();
+    draw_list->_PopUnusedDrawCmd();
+    this->painted = area;
+  }
+};
+
+#endif
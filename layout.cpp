@@ -0,0 +1,1131 @@
+#ifndef LAYOUT_CPP
+#define LAYOUT_CPP
+
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "css_parser.cpp"
+#include "font.cpp"
+#include "layout_unit.cpp"
+
+struct EdgeSize {
+  LayoutUnit left, right, top, bottom;
+};
+
+// Whole device pixels, what a Rect turns into at paint time.
+struct PixelRect {
+  int x = 0, y = 0, width = 0, height = 0;
+};
+
+struct Rect {
+  LayoutUnit x, y, width, height;
+
+  Rect expanded_by(EdgeSize edge) const {
+    return Rect{
+        this->x - edge.left,
+        this->y - edge.top,
+        this->width + edge.left + edge.right,
+        this->height + edge.top + edge.bottom,
+    };
+  }
+
+  // Snaps the edges (not the size) to pixels so neighbouring boxes stay
+  // seamless.
+  PixelRect snapped() const {
+    int left = this->x.round();
+    int top = this->y.round();
+    return PixelRect{left, top, (this->x + this->width).round() - left,
+                     (this->y + this->height).round() - top};
+  }
+
+  friend std::ostream &operator<<(std::ostream &os, const Rect &r) {
+    os << "Rect(" << r.x << "," << r.y << "," << r.width << "," << r.height
+       << ")";
+    return os;
+  }
+};
+
+struct Dimensions {
+  Rect content;
+  EdgeSize padding;
+  EdgeSize margin;
+  EdgeSize border;
+
+  Rect padding_box() const { return this->content.expanded_by(this->padding); }
+  Rect border_box() const {
+    return this->padding_box().expanded_by(this->border);
+  }
+  Rect margin_box() const {
+    return this->border_box().expanded_by(this->margin);
+  }
+};
+
+enum BoxType { b_BLOCK, b_INLINE, b_ANON };
+
+BoxType display_to_box_type(DisplayType d) {
+  switch (d) {
+  case DisplayType::BLOCK:
+    return BoxType::b_BLOCK;
+  case DisplayType::INLINE:
+    return BoxType::b_INLINE;
+  case DisplayType::NONE:
+  default:
+    return BoxType::b_ANON;
+  }
+}
+
+const DeclarationValueType AUTO = std::string("auto");
+const DeclarationValueType ZERO = Length{0, Unit::px};
+
+bool is_keyword(const DeclarationValueType &value, const char *keyword) {
+  return std::holds_alternative<std::string>(value) &&
+         std::get<std::string>(value) == keyword;
+}
+
+bool is_auto(const DeclarationValueType &value) {
+  return is_keyword(value, "auto");
+}
+
+LayoutUnit to_layout_unit(const DeclarationValueType &value) {
+  if (!std::holds_alternative<Length>(value)) {
+    // auto and other keywords
+    return LayoutUnit();
+  }
+  const Length &l = std::get<Length>(value);
+  switch (l.unit) {
+  case Unit::em:
+    // TODO use the font size once we have one
+    return LayoutUnit::from_float(l.num * 16);
+  case Unit::px:
+  default:
+    return LayoutUnit::from_float(l.num);
+  }
+}
+
+// Boxes live in a per document arena (LayoutTree::boxes) and refer to each
+// other by index, so handles stay valid while the tree is being built.
+typedef uint32_t BoxId;
+const BoxId NO_BOX = UINT32_MAX;
+
+// A run of words on one line, relative to the content box of the box that
+// holds the inline formatting context.
+struct TextFragment {
+  // the text box the words came from
+  BoxId box = NO_BOX;
+  const std::string *text = nullptr;
+  uint32_t start = 0;
+  uint32_t length = 0;
+  int font_size = 0;
+  Rect rect;
+};
+
+// A word waiting to be put on a line.
+struct InlineItem {
+  BoxId box;
+  const std::string *text;
+  uint32_t start;
+  uint32_t length;
+  FontSize *font;
+  LayoutUnit width;
+  // words without whitespace in between (`<em>world</em>!`) have to stay on
+  // the same line
+  bool space_before;
+};
+
+bool is_collapsible_space(char c) {
+  return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\f';
+}
+
+struct LayoutBox {
+  Dimensions dims;
+  BoxType type = BoxType::b_ANON;
+  // null for anonymous boxes
+  const StyledNode *style = nullptr;
+
+  BoxId parent = NO_BOX;
+  BoxId first_child = NO_BOX;
+  BoxId last_child = NO_BOX;
+  BoxId next_sibling = NO_BOX;
+  uint32_t child_count = 0;
+  // boxes are allocated in preorder, so a subtree is the id range
+  // [id, id + subtree_size)
+  uint32_t subtree_size = 1;
+
+  // min-content and max-content contribution, margins included
+  LayoutUnit min_content_width;
+  LayoutUnit max_content_width;
+
+  // lines of text when this box holds an inline formatting context
+  std::vector<TextFragment> fragments;
+
+  // everything in this subtree that affects its layout, split into style
+  // (including the shape of the tree) and text, see LayoutCache
+  uint64_t style_hash = 0;
+  uint64_t content_hash = 0;
+
+  // incremental layout state, a box is only laid out again when it (or
+  // something below it) changed or its containing block got a new width
+  bool needs_layout = true;
+  bool child_needs_layout = true;
+  LayoutUnit last_containing_width = LayoutUnit::from_raw(-1);
+  // off screen with content-visibility: auto (or in lazy mode), so only the
+  // box itself is placed, with an estimated height, and the children are
+  // left alone until it comes near the viewport
+  bool deferred = false;
+
+  // position: fixed, placed where it would be in flow but it takes no room
+  // there, so the boxes after it and its parent's height ignore it
+  bool fixed = false;
+  // overflow: scroll or auto, the children scroll inside the padding box
+  bool scrolls = false;
+
+  DeclarationValueType lookup(const std::string &name,
+                              const std::string &fallback_name,
+                              const DeclarationValueType &default_value) const {
+    if (this->style == nullptr) {
+      return default_value;
+    }
+    return this->style->lookup(name, fallback_name, default_value);
+  }
+};
+
+uint64_t hash_combine(uint64_t seed, uint64_t value) {
+  return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+uint64_t hash_value(const DeclarationValueType &value) {
+  uint64_t h = value.index();
+  if (auto *s = std::get_if<std::string>(&value)) {
+    h = hash_combine(h, std::hash<std::string>{}(*s));
+  } else if (auto *i = std::get_if<int>(&value)) {
+    h = hash_combine(h, static_cast<uint64_t>(*i));
+  } else if (auto *c = std::get_if<Color>(&value)) {
+    for (int channel : {c->r, c->g, c->b, c->a}) {
+      h = hash_combine(h, static_cast<uint64_t>(channel));
+    }
+  } else if (auto *l = std::get_if<Length>(&value)) {
+    uint32_t bits;
+    std::memcpy(&bits, &l->num, sizeof(bits));
+    h = hash_combine(hash_combine(h, bits), l->unit);
+  }
+  return h;
+}
+
+uint64_t hash_properties(const PropertyMap &values) {
+  uint64_t h = values.size();
+  for (const auto &pair : values) {
+    h = hash_combine(h, std::hash<std::string>{}(pair.first));
+    h = hash_combine(h, hash_value(pair.second));
+  }
+  return h;
+}
+
+struct LayoutCacheKey {
+  uint64_t style_hash;
+  uint64_t content_hash;
+  int32_t available_width;
+  // font-size is inherited, so it can change layout from outside the subtree
+  int font_size;
+
+  bool operator==(const LayoutCacheKey &o) const {
+    return this->style_hash == o.style_hash &&
+           this->content_hash == o.content_hash &&
+           this->available_width == o.available_width &&
+           this->font_size == o.font_size;
+  }
+};
+
+struct LayoutCacheKeyHash {
+  size_t operator()(const LayoutCacheKey &key) const {
+    uint64_t h = hash_combine(key.style_hash, key.content_hash);
+    h = hash_combine(h, static_cast<uint32_t>(key.available_width));
+    return hash_combine(h, static_cast<uint64_t>(key.font_size));
+  }
+};
+
+// A laid out subtree, positions relative to the content box of its root.
+struct LayoutCacheEntry {
+  std::vector<Dimensions> dims;
+  // boxes inside an inline formatting context aren't positioned, they keep
+  // their dims as is
+  std::vector<uint8_t> positioned;
+  std::vector<LayoutUnit> containing_widths;
+  // fragment boxes are offsets from the root and the text pointers are
+  // rebound to the subtree the entry gets copied into
+  std::vector<std::vector<TextFragment>> fragments;
+};
+
+// Memoized subtree layouts, for documents that repeat the same rows and
+// cards thousands of times. Can be shared between layout trees, but not
+// between threads. A subtree is only stored the second time its key shows
+// up, so one-off subtrees (like the root) never get copied.
+struct LayoutCache {
+  std::unordered_map<LayoutCacheKey, LayoutCacheEntry, LayoutCacheKeyHash>
+      entries;
+  std::unordered_set<LayoutCacheKey, LayoutCacheKeyHash> seen;
+  size_t hits = 0;
+  size_t misses = 0;
+
+  void clear() {
+    this->entries.clear();
+    this->seen.clear();
+    this->hits = 0;
+    this->misses = 0;
+  }
+};
+
+struct LayoutStats {
+  size_t laid_out = 0;
+  // clean subtrees that were skipped, and how many boxes had to be moved
+  // because something before them changed height
+  size_t skipped = 0;
+  size_t translated = 0;
+  // boxes left as placeholders, and how far the content in the viewport
+  // moved because placeholders above it got their real height. Add it to
+  // the scroll offset to keep what is on screen in place.
+  size_t deferred = 0;
+  LayoutUnit scroll_adjustment;
+};
+
+// how far outside of the viewport deferred boxes are laid out anyway, so
+// they are ready before they scroll into view
+const LayoutUnit LAZY_PREFETCH_MARGIN = LayoutUnit::from_px(1000);
+// height of a placeholder before any real height is known
+const LayoutUnit DEFAULT_PLACEHOLDER_HEIGHT = LayoutUnit::from_px(100);
+
+struct LayoutTree {
+  std::vector<LayoutBox> boxes;
+  BoxId root = NO_BOX;
+  // counters for the last call to layout()
+  LayoutStats stats;
+  // optional, subtrees that match an earlier layout are copied from here
+  LayoutCache *cache = nullptr;
+  bool hashes_computed = false;
+
+  // Lazy mode treats every child of the root as content-visibility: auto,
+  // so the first layout only does the part of the document around the
+  // viewport (in document coordinates). Call layout() again after
+  // scrolling to fill in more.
+  bool lazy = false;
+  Rect viewport;
+  LayoutUnit prefetch_margin = LAZY_PREFETCH_MARGIN;
+  // in lazy mode, the children of the root from here on were never looked
+  // at and have no geometry, their height is estimated as a whole
+  BoxId lazy_tail = NO_BOX;
+  uint32_t lazy_visited = 0;
+  // real heights seen so far, their average is the estimate for the rest
+  LayoutUnit lazy_height_sum;
+  uint32_t lazy_height_count = 0;
+
+  LayoutBox &operator[](BoxId id) { return this->boxes[id]; }
+  const LayoutBox &operator[](BoxId id) const { return this->boxes[id]; }
+  size_t size() const { return this->boxes.size(); }
+
+  BoxId new_box(BoxType type, const StyledNode *style) {
+    LayoutBox &b = this->boxes.emplace_back();
+    b.type = type;
+    b.style = style;
+    return static_cast<BoxId>(this->boxes.size() - 1);
+  }
+
+  void append_child(BoxId parent, BoxId child) {
+    LayoutBox &p = this->boxes[parent];
+    this->boxes[child].parent = parent;
+    if (p.last_child == NO_BOX) {
+      p.first_child = child;
+    } else {
+      this->boxes[p.last_child].next_sibling = child;
+    }
+    p.last_child = child;
+    p.child_count++;
+  }
+
+  // where inline children of `id` should be added
+  BoxId get_inline_container(BoxId id) {
+    switch (this->boxes[id].type) {
+    case BoxType::b_INLINE:
+    case BoxType::b_ANON:
+      return id;
+    case BoxType::b_BLOCK:
+    default:
+      BoxId last_child = this->boxes[id].last_child;
+      if (last_child != NO_BOX &&
+          this->boxes[last_child].type == BoxType::b_ANON) {
+        return last_child;
+      }
+      BoxId anon = this->new_box(BoxType::b_ANON, nullptr);
+      this->append_child(id, anon);
+      return anon;
+    }
+  }
+
+  // Call when the style or content of a box changed. Ancestors are flagged
+  // so the next layout() walks down to it and skips everything else. The
+  // font-size is inherited, so the descendants that take theirs from the box
+  // are laid out again as well.
+  void mark_needs_layout(BoxId id) {
+    this->mark_inheriting(id);
+    for (BoxId p = this->boxes[id].parent;
+         p != NO_BOX && !this->boxes[p].child_needs_layout;
+         p = this->boxes[p].parent) {
+      this->boxes[p].child_needs_layout = true;
+    }
+    if (this->hashes_computed) {
+      for (BoxId b = id; b != NO_BOX; b = this->boxes[b].parent) {
+        this->update_hashes(b);
+      }
+    }
+  }
+
+  // flags `id` and its descendants up to those with a font-size of their own
+  void mark_inheriting(BoxId id) {
+    this->boxes[id].needs_layout = true;
+    for (BoxId child = this->boxes[id].first_child; child != NO_BOX;
+         child = this->boxes[child].next_sibling) {
+      const StyledNode *style = this->boxes[child].style;
+      if (style == nullptr || !style->value("font-size")) {
+        this->mark_inheriting(child);
+      }
+    }
+  }
+
+  // Hashes of `id` assuming its children already have theirs.
+  void update_hashes(BoxId id) {
+    LayoutBox &box = this->boxes[id];
+    uint64_t style = hash_combine(box.type, box.subtree_size);
+    uint64_t content = 0;
+    if (box.style != nullptr) {
+      style = hash_combine(style, hash_properties(box.style->values));
+      Node *node = box.style->node;
+      if (node != nullptr && node->type == NodeType::Text) {
+        content = std::hash<std::string>{}(
+            static_cast<TextNode *>(node)->content);
+      }
+    }
+    for (BoxId child = box.first_child; child != NO_BOX;
+         child = this->boxes[child].next_sibling) {
+      style = hash_combine(style, this->boxes[child].style_hash);
+      content = hash_combine(content, this->boxes[child].content_hash);
+    }
+    box.style_hash = style;
+    box.content_hash = content;
+  }
+
+  void compute_hashes() {
+    // children always come after their parent
+    for (size_t i = this->boxes.size(); i-- > 0;) {
+      this->update_hashes(static_cast<BoxId>(i));
+    }
+    this->hashes_computed = true;
+  }
+
+  LayoutCacheKey cache_key(BoxId id, const Dimensions &containing_block) {
+    const LayoutBox &box = this->boxes[id];
+    return LayoutCacheKey{box.style_hash, box.content_hash,
+                          containing_block.content.width.raw,
+                          this->font_for(id).px};
+  }
+
+  bool layout_from_cache(BoxId id, const Dimensions &containing_block) {
+    auto it = this->cache->entries.find(this->cache_key(id, containing_block));
+    if (it == this->cache->entries.end() ||
+        it->second.dims.size() != this->boxes[id].subtree_size) {
+      this->cache->misses++;
+      return false;
+    }
+    this->cache->hits++;
+
+    const LayoutCacheEntry &entry = it->second;
+    const Dimensions &root = entry.dims[0];
+    LayoutUnit x = containing_block.content.x + root.margin.left +
+                   root.border.left + root.padding.left;
+    LayoutUnit y = containing_block.content.y +
+                   containing_block.content.height + root.margin.top +
+                   root.border.top + root.padding.top;
+
+    for (uint32_t i = 0; i < entry.dims.size(); i++) {
+      LayoutBox &box = this->boxes[id + i];
+      box.dims = entry.dims[i];
+      if (entry.positioned[i]) {
+        box.dims.content.x += x;
+        box.dims.content.y += y;
+      }
+      box.last_containing_width = entry.containing_widths[i];
+      box.needs_layout = false;
+      box.child_needs_layout = false;
+      box.deferred = false;
+
+      box.fragments = entry.fragments[i];
+      for (TextFragment &fragment : box.fragments) {
+        fragment.box += id;
+        Node *node = this->boxes[fragment.box].style->node;
+        fragment.text = &static_cast<TextNode *>(node)->content;
+      }
+    }
+    return true;
+  }
+
+  void store_in_cache(BoxId id, const Dimensions &containing_block) {
+    LayoutCacheKey key = this->cache_key(id, containing_block);
+    if (this->cache->entries.count(key) != 0) {
+      return;
+    }
+    if (this->cache->seen.insert(key).second) {
+      // first time we see it, might never come back
+      return;
+    }
+
+    uint32_t size = this->boxes[id].subtree_size;
+    LayoutUnit x = this->boxes[id].dims.content.x;
+    LayoutUnit y = this->boxes[id].dims.content.y;
+
+    LayoutCacheEntry entry;
+    entry.dims.reserve(size);
+    entry.positioned.resize(size, 1);
+    entry.containing_widths.reserve(size);
+    entry.fragments.resize(size);
+    for (uint32_t i = 0; i < size; i++) {
+      const LayoutBox &box = this->boxes[id + i];
+      if (i > 0) {
+        BoxId parent = box.parent;
+        entry.positioned[i] = entry.positioned[parent - id] &&
+                              !this->establishes_inline_context(parent);
+      }
+      Dimensions d = box.dims;
+      if (entry.positioned[i]) {
+        d.content.x -= x;
+        d.content.y -= y;
+      }
+      entry.dims.push_back(d);
+      entry.containing_widths.push_back(box.last_containing_width);
+
+      entry.fragments[i] = box.fragments;
+      for (TextFragment &fragment : entry.fragments[i]) {
+        fragment.box -= id;
+        fragment.text = nullptr;
+      }
+    }
+    this->cache->entries.emplace(key, std::move(entry));
+  }
+
+  void layout(Dimensions containing_block) {
+    this->stats = LayoutStats();
+    this->lazy_tail = NO_BOX;
+    if (this->root == NO_BOX) {
+      return;
+    }
+    if (this->cache != nullptr && !this->hashes_computed) {
+      this->compute_hashes();
+    }
+    this->layout_box(this->root, containing_block);
+  }
+
+  // Anonymous boxes (and an inline root) hold inline content, which is laid
+  // out as lines of text instead of stacked boxes.
+  // TODO blocks inside of inlines are flowed as if they were inline
+  bool establishes_inline_context(BoxId id) const {
+    return this->boxes[id].type != BoxType::b_BLOCK;
+  }
+
+  // TODO inherit properties while styling, for now look up the tree
+  DeclarationValueType
+  inherited_value(BoxId id, const std::string &name,
+                  const DeclarationValueType &default_value) const {
+    for (BoxId b = id; b != NO_BOX; b = this->boxes[b].parent) {
+      const StyledNode *style = this->boxes[b].style;
+      if (style == nullptr) {
+        continue;
+      }
+      auto v = style->value(name);
+      if (v) {
+        return v.value();
+      }
+    }
+    return default_value;
+  }
+
+  FontSize &font_for(BoxId id) const {
+    DeclarationValueType size =
+        this->inherited_value(id, "font-size", Length{16, Unit::px});
+    return default_font().at_size(std::max(1, to_layout_unit(size).round()));
+  }
+
+  void layout_box(BoxId id, const Dimensions &containing_block) {
+    LayoutBox &box = this->boxes[id];
+    if (!box.needs_layout && !box.child_needs_layout &&
+        box.last_containing_width == containing_block.content.width) {
+      // same constraints and nothing inside changed, so the size is still
+      // good and at most the position moved
+      this->stats.skipped++;
+      this->reposition_clean_box(id, containing_block);
+      return;
+    }
+
+    bool may_defer = this->may_defer(id);
+    if (may_defer && !this->near_viewport(id, containing_block)) {
+      this->defer_layout(id, containing_block);
+      return;
+    }
+    // a box never looked at before was part of an estimate as well
+    bool was_deferred = box.deferred || box.last_containing_width.raw == -1;
+    LayoutUnit old_height = box.deferred ? box.dims.margin_box().height
+                            : may_defer  ? this->estimated_height(id)
+                                         : LayoutUnit();
+    size_t deferred_before = this->stats.deferred;
+
+    // a lone box is cheaper to lay out than to look up
+    bool cacheable = this->cache != nullptr && box.subtree_size > 1;
+    if (cacheable && this->layout_from_cache(id, containing_block)) {
+      if (may_defer) {
+        this->realized(id, was_deferred, old_height);
+      }
+      return;
+    }
+
+    this->stats.laid_out++;
+    if (this->establishes_inline_context(id)) {
+      this->layout_inline_context(id, containing_block);
+    } else {
+      this->layout_block(id, containing_block);
+    }
+
+    // placeholders further down have to be looked at again next time
+    bool has_deferred = this->stats.deferred != deferred_before;
+    box.needs_layout = false;
+    box.child_needs_layout = has_deferred;
+    box.deferred = false;
+    box.last_containing_width = containing_block.content.width;
+
+    if (may_defer) {
+      this->realized(id, was_deferred, old_height);
+    }
+    if (cacheable && !has_deferred) {
+      this->store_in_cache(id, containing_block);
+    }
+  }
+
+  bool may_defer(BoxId id) const {
+    const LayoutBox &box = this->boxes[id];
+    if (this->lazy && box.parent == this->root && box.parent != NO_BOX) {
+      return true;
+    }
+    return box.type == BoxType::b_BLOCK &&
+           is_auto(box.lookup("content-visibility", "content-visibility",
+                              ZERO));
+  }
+
+  LayoutUnit prefetch_bottom() const {
+    return this->viewport.y + this->viewport.height + this->prefetch_margin;
+  }
+
+  bool in_prefetch_window(LayoutUnit top, LayoutUnit bottom) const {
+    return bottom >= this->viewport.y - this->prefetch_margin &&
+           top <= this->prefetch_bottom();
+  }
+
+  // whether the margin box, at the height it has now (or its estimate)
+  // would be near the viewport if placed next in `containing_block`
+  bool near_viewport(BoxId id, const Dimensions &containing_block) const {
+    const LayoutBox &box = this->boxes[id];
+    LayoutUnit top =
+        containing_block.content.y + containing_block.content.height;
+    LayoutUnit height = box.last_containing_width.raw == -1
+                            ? this->estimated_height(id)
+                            : box.dims.margin_box().height;
+    return this->in_prefetch_window(top, top + height);
+  }
+
+  LayoutUnit estimated_height(BoxId id) const {
+    const LayoutBox &box = this->boxes[id];
+    DeclarationValueType size =
+        box.lookup("contain-intrinsic-size", "contain-intrinsic-size", AUTO);
+    if (std::holds_alternative<Length>(size)) {
+      return to_layout_unit(size);
+    }
+    if (this->lazy_height_count != 0) {
+      return this->lazy_height_sum / this->lazy_height_count;
+    }
+    return DEFAULT_PLACEHOLDER_HEIGHT;
+  }
+
+  // Place the box itself and keep whatever height it had, the estimate the
+  // first time. The children keep stale geometry and are not painted.
+  void defer_layout(BoxId id, const Dimensions &containing_block) {
+    LayoutBox &box = this->boxes[id];
+    this->stats.deferred++;
+    if (box.deferred &&
+        box.last_containing_width == containing_block.content.width) {
+      // only the position can have changed, and only the box itself has
+      // meaningful geometry
+      Dimensions &d = box.dims;
+      d.content.x = containing_block.content.x + d.margin.left +
+                    d.border.left + d.padding.left;
+      d.content.y = containing_block.content.y +
+                    containing_block.content.height + d.margin.top +
+                    d.border.top + d.padding.top;
+      return;
+    }
+    bool first_time = box.last_containing_width.raw == -1;
+    LayoutUnit height = box.dims.content.height;
+    this->calculate_block_width(id, containing_block);
+    this->calculate_block_position(id, containing_block);
+    if (first_time) {
+      // the estimate covers the whole margin box
+      height = this->estimated_height(id) - box.dims.margin.top -
+               box.dims.border.top - box.dims.padding.top -
+               box.dims.padding.bottom - box.dims.border.bottom -
+               box.dims.margin.bottom;
+      height = std::max(height, LayoutUnit());
+    }
+    box.dims.content.height = height;
+    this->calculate_block_height(id);
+    box.deferred = true;
+    box.needs_layout = true;
+    box.last_containing_width = containing_block.content.width;
+  }
+
+  // a deferred box got its real size, a box that ended up above the
+  // viewport pushed the content on screen down by the difference
+  void realized(BoxId id, bool was_deferred, LayoutUnit old_height) {
+    LayoutUnit height = this->boxes[id].dims.margin_box().height;
+    if (was_deferred) {
+      const Rect margin_box = this->boxes[id].dims.margin_box();
+      if (margin_box.y + margin_box.height <= this->viewport.y) {
+        this->stats.scroll_adjustment += height - old_height;
+      }
+    }
+    this->lazy_height_sum += height;
+    this->lazy_height_count++;
+  }
+
+  void reposition_clean_box(BoxId id, const Dimensions &containing_block) {
+    const Dimensions &d = this->boxes[id].dims;
+    LayoutUnit x = containing_block.content.x + d.margin.left +
+                   d.border.left + d.padding.left;
+    LayoutUnit y = containing_block.content.y +
+                   containing_block.content.height + d.margin.top +
+                   d.border.top + d.padding.top;
+    LayoutUnit dx = x - d.content.x;
+    LayoutUnit dy = y - d.content.y;
+    if (dx != LayoutUnit() || dy != LayoutUnit()) {
+      this->translate_subtree(id, dx, dy);
+    }
+  }
+
+  void translate_subtree(BoxId id, LayoutUnit dx, LayoutUnit dy) {
+    this->stats.translated++;
+    Rect &content = this->boxes[id].dims.content;
+    content.x += dx;
+    content.y += dy;
+    if (this->establishes_inline_context(id)) {
+      // text fragments are relative to the content box
+      return;
+    }
+    for (BoxId child = this->boxes[id].first_child; child != NO_BOX;
+         child = this->boxes[child].next_sibling) {
+      this->translate_subtree(child, dx, dy);
+    }
+  }
+
+  void layout_block(BoxId id, const Dimensions &containing_block) {
+    // width depends on the parent, so do that first
+    this->calculate_block_width(id, containing_block);
+    this->calculate_block_position(id, containing_block);
+    // height depends on the children
+    this->layout_block_children(id);
+    this->calculate_block_height(id);
+  }
+
+  void layout_inline_context(BoxId id, const Dimensions &containing_block) {
+    this->calculate_block_width(id, containing_block);
+    this->calculate_block_position(id, containing_block);
+    this->layout_inline_lines(id);
+    this->calculate_block_height(id);
+  }
+
+  // Splits the text under `id` into words. The inline boxes are handled as
+  // part of this context and never laid out on their own, so they are
+  // marked clean here.
+  void collect_inline_items(BoxId id, std::vector<InlineItem> &items,
+                            bool &pending_space) {
+    for (BoxId child = this->boxes[id].first_child; child != NO_BOX;
+         child = this->boxes[child].next_sibling) {
+      LayoutBox &c = this->boxes[child];
+      c.needs_layout = false;
+      c.child_needs_layout = false;
+
+      Node *node = c.style == nullptr ? nullptr : c.style->node;
+      if (node == nullptr || node->type != NodeType::Text) {
+        this->collect_inline_items(child, items, pending_space);
+        continue;
+      }
+
+      const std::string &text = static_cast<TextNode *>(node)->content;
+      FontSize &font = this->font_for(child);
+      size_t i = 0;
+      while (i < text.size()) {
+        if (is_collapsible_space(text[i])) {
+          pending_space = true;
+          i++;
+          continue;
+        }
+        size_t start = i;
+        while (i < text.size() && !is_collapsible_space(text[i])) {
+          i++;
+        }
+        items.push_back(InlineItem{
+            child, &text, static_cast<uint32_t>(start),
+            static_cast<uint32_t>(i - start), &font,
+            font.word_width(text.data() + start, i - start), pending_space});
+        pending_space = false;
+      }
+    }
+  }
+
+  // Greedy line breaking at whitespace, words on a line share a baseline.
+  void layout_inline_lines(BoxId id) {
+    std::vector<InlineItem> items;
+    bool pending_space = false;
+    this->collect_inline_items(id, items, pending_space);
+
+    LayoutBox &box = this->boxes[id];
+    box.fragments.clear();
+    LayoutUnit available = box.dims.content.width;
+
+    LayoutUnit x;
+    LayoutUnit y;
+    size_t line_start = 0;
+    std::vector<const InlineItem *> line_items;
+
+    auto finish_line = [&]() {
+      LayoutUnit ascent;
+      LayoutUnit descent;
+      for (const InlineItem *item : line_items) {
+        ascent = std::max(ascent, item->font->ascent);
+        descent =
+            std::max(descent, item->font->line_height - item->font->ascent);
+      }
+      for (size_t f = line_start; f < box.fragments.size(); f++) {
+        const InlineItem *item = line_items[f - line_start];
+        box.fragments[f].rect.y = y + ascent - item->font->ascent;
+      }
+      y += ascent + descent;
+      x = LayoutUnit();
+      line_start = box.fragments.size();
+      line_items.clear();
+    };
+
+    size_t i = 0;
+    while (i < items.size()) {
+      size_t end = i + 1;
+      LayoutUnit unit_width = items[i].width;
+      while (end < items.size() && !items[end].space_before) {
+        unit_width += items[end].width;
+        end++;
+      }
+
+      LayoutUnit space =
+          items[i].space_before ? items[i].font->space_width : LayoutUnit();
+      if (x > LayoutUnit() && x + space + unit_width > available) {
+        finish_line();
+      }
+      if (x > LayoutUnit()) {
+        x += space;
+      }
+
+      for (; i < end; i++) {
+        const InlineItem &item = items[i];
+        TextFragment fragment;
+        fragment.box = item.box;
+        fragment.text = item.text;
+        fragment.start = item.start;
+        fragment.length = item.length;
+        fragment.font_size = item.font->px;
+        fragment.rect = Rect{x, y, item.width, item.font->line_height};
+        box.fragments.push_back(fragment);
+        line_items.push_back(&item);
+        x += item.width;
+      }
+    }
+    if (!line_items.empty()) {
+      finish_line();
+    }
+    box.dims.content.height = y;
+  }
+
+  void calculate_block_width(BoxId id, const Dimensions &containing_block) {
+    LayoutBox &box = this->boxes[id];
+
+    DeclarationValueType width = box.lookup("width", "width", AUTO);
+    DeclarationValueType margin_left =
+        box.lookup("margin-left", "margin", ZERO);
+    DeclarationValueType margin_right =
+        box.lookup("margin-right", "margin", ZERO);
+
+    LayoutUnit border_left =
+        to_layout_unit(box.lookup("border-left-width", "border-width", ZERO));
+    LayoutUnit border_right =
+        to_layout_unit(box.lookup("border-right-width", "border-width", ZERO));
+    LayoutUnit padding_left =
+        to_layout_unit(box.lookup("padding-left", "padding", ZERO));
+    LayoutUnit padding_right =
+        to_layout_unit(box.lookup("padding-right", "padding", ZERO));
+
+    bool width_auto = is_auto(width);
+    bool margin_left_auto = is_auto(margin_left);
+    bool margin_right_auto = is_auto(margin_right);
+    LayoutUnit w = to_layout_unit(width);
+    LayoutUnit ml = to_layout_unit(margin_left);
+    LayoutUnit mr = to_layout_unit(margin_right);
+
+    LayoutUnit total = ml + mr + border_left + border_right + padding_left +
+                padding_right + w;
+
+    // the box is too big, auto margins are treated as 0
+    if (!width_auto && total > containing_block.content.width) {
+      margin_left_auto = false;
+      margin_right_auto = false;
+    }
+
+    LayoutUnit underflow = containing_block.content.width - total;
+
+    if (!width_auto && !margin_left_auto && !margin_right_auto) {
+      // over constrained, give the difference to the right margin
+      mr += underflow;
+    } else if (!width_auto && !margin_left_auto && margin_right_auto) {
+      mr = underflow;
+    } else if (!width_auto && margin_left_auto && !margin_right_auto) {
+      ml = underflow;
+    } else if (width_auto) {
+      if (underflow >= LayoutUnit()) {
+        w = underflow;
+      } else {
+        // width cant be negative, take it out of the right margin
+        w = LayoutUnit();
+        mr += underflow;
+      }
+    } else {
+      // both margins auto, center the box
+      ml = underflow / 2;
+      mr = underflow - ml;
+    }
+
+    Dimensions &d = box.dims;
+    d.content.width = w;
+    d.padding.left = padding_left;
+    d.padding.right = padding_right;
+    d.border.left = border_left;
+    d.border.right = border_right;
+    d.margin.left = ml;
+    d.margin.right = mr;
+  }
+
+  void calculate_vertical_edges(BoxId id) {
+    LayoutBox &box = this->boxes[id];
+    Dimensions &d = box.dims;
+
+    d.margin.top = to_layout_unit(box.lookup("margin-top", "margin", ZERO));
+    d.margin.bottom =
+        to_layout_unit(box.lookup("margin-bottom", "margin", ZERO));
+    d.border.top =
+        to_layout_unit(box.lookup("border-top-width", "border-width", ZERO));
+    d.border.bottom =
+        to_layout_unit(box.lookup("border-bottom-width", "border-width", ZERO));
+    d.padding.top = to_layout_unit(box.lookup("padding-top", "padding", ZERO));
+    d.padding.bottom =
+        to_layout_unit(box.lookup("padding-bottom", "padding", ZERO));
+  }
+
+  void calculate_block_position(BoxId id, const Dimensions &containing_block) {
+    this->calculate_vertical_edges(id);
+
+    Dimensions &d = this->boxes[id].dims;
+    d.content.x = containing_block.content.x + d.margin.left + d.border.left +
+                  d.padding.left;
+    // the containing block's height so far is where the previous sibling
+    // ended
+    d.content.y = containing_block.content.y +
+                  containing_block.content.height + d.margin.top +
+                  d.border.top + d.padding.top;
+  }
+
+  void layout_block_children(BoxId id) {
+    Dimensions &d = this->boxes[id].dims;
+    d.content.height = LayoutUnit();
+    bool lazy_root = this->lazy && id == this->root;
+    uint32_t index = 0;
+    for (BoxId child = this->boxes[id].first_child; child != NO_BOX;
+         child = this->boxes[child].next_sibling, index++) {
+      if (lazy_root && index >= this->lazy_visited) {
+        if (d.content.y + d.content.height > this->prefetch_bottom()) {
+          // nothing from here on was ever looked at, so skip the walk and
+          // estimate all of it, which keeps the first layout independent
+          // of the length of the document. LayoutUnit tops out around 33M
+          // px, so very long documents get a clamped scrollbar.
+          int64_t remaining = this->boxes[id].child_count - index;
+          int64_t tail = this->estimated_height(child).raw * remaining;
+          d.content.height += LayoutUnit::from_raw(static_cast<int32_t>(
+              std::min<int64_t>(tail, INT32_MAX / 2)));
+          this->lazy_tail = child;
+          this->stats.deferred++;
+          return;
+        }
+        this->lazy_visited = index + 1;
+      }
+      this->layout_box(child, d);
+      if (!this->boxes[child].fixed) {
+        d.content.height += this->boxes[child].dims.margin_box().height;
+      }
+    }
+  }
+
+  void calculate_block_height(BoxId id) {
+    LayoutBox &box = this->boxes[id];
+    // an explicit height wins over the height of the children
+    DeclarationValueType height = box.lookup("height", "height", AUTO);
+    if (std::holds_alternative<Length>(height)) {
+      box.dims.content.height = to_layout_unit(height);
+    }
+  }
+
+  // non-auto margins plus borders and padding
+  LayoutUnit horizontal_edges(BoxId id) const {
+    const LayoutBox &box = this->boxes[id];
+    LayoutUnit edges;
+    edges += to_layout_unit(box.lookup("margin-left", "margin", ZERO));
+    edges += to_layout_unit(box.lookup("margin-right", "margin", ZERO));
+    edges +=
+        to_layout_unit(box.lookup("border-left-width", "border-width", ZERO));
+    edges +=
+        to_layout_unit(box.lookup("border-right-width", "border-width", ZERO));
+    edges += to_layout_unit(box.lookup("padding-left", "padding", ZERO));
+    edges += to_layout_unit(box.lookup("padding-right", "padding", ZERO));
+    return edges;
+  }
+
+  // Intrinsic widths of `id` assuming its children already have theirs.
+  void intrinsic_widths_from_children(BoxId id) {
+    LayoutBox &box = this->boxes[id];
+    LayoutUnit edges = this->horizontal_edges(id);
+
+    DeclarationValueType width = box.lookup("width", "width", AUTO);
+    if (std::holds_alternative<Length>(width)) {
+      box.min_content_width = to_layout_unit(width) + edges;
+      box.max_content_width = box.min_content_width;
+      return;
+    }
+
+    LayoutUnit min_content;
+    LayoutUnit max_content;
+    for (BoxId child = box.first_child; child != NO_BOX;
+         child = this->boxes[child].next_sibling) {
+      min_content = std::max(min_content, this->boxes[child].min_content_width);
+      max_content = std::max(max_content, this->boxes[child].max_content_width);
+    }
+    box.min_content_width = min_content + edges;
+    box.max_content_width = max_content + edges;
+  }
+
+  // min-content is the widest unbreakable run of words, max-content
+  // everything on one line
+  void inline_intrinsic_widths(BoxId id) {
+    std::vector<InlineItem> items;
+    bool pending_space = false;
+    this->collect_inline_items(id, items, pending_space);
+
+    LayoutUnit min_content;
+    LayoutUnit max_content;
+    LayoutUnit unit_width;
+    for (size_t i = 0; i < items.size(); i++) {
+      if (items[i].space_before && i > 0) {
+        max_content += items[i].font->space_width;
+        unit_width = LayoutUnit();
+      }
+      unit_width += items[i].width;
+      max_content += items[i].width;
+      min_content = std::max(min_content, unit_width);
+    }
+
+    LayoutUnit edges = this->horizontal_edges(id);
+    LayoutBox &box = this->boxes[id];
+    box.min_content_width = min_content + edges;
+    box.max_content_width = max_content + edges;
+  }
+
+  void compute_intrinsic_widths(BoxId id) {
+    if (this->establishes_inline_context(id)) {
+      this->inline_intrinsic_widths(id);
+      return;
+    }
+    for (BoxId child = this->boxes[id].first_child; child != NO_BOX;
+         child = this->boxes[child].next_sibling) {
+      this->compute_intrinsic_widths(child);
+    }
+    this->intrinsic_widths_from_children(id);
+  }
+};
+
+BoxId build_layout_box(LayoutTree &tree, const StyledNode &styled_node) {
+  BoxId id =
+      tree.new_box(display_to_box_type(styled_node.display()), &styled_node);
+  LayoutBox &box = tree[id];
+  if (box.type == BoxType::b_BLOCK) {
+    // both only change with a restyle, which builds a new tree anyway
+    box.fixed = is_keyword(box.lookup("position", "position", ZERO), "fixed");
+    DeclarationValueType overflow = box.lookup("overflow-y", "overflow", ZERO);
+    box.scrolls = is_keyword(overflow, "scroll") || is_auto(overflow);
+  }
+
+  for (const StyledNode &child : styled_node.children) {
+    switch (child.display()) {
+    case DisplayType::BLOCK:
+      tree.append_child(id, build_layout_box(tree, child));
+      break;
+    case DisplayType::INLINE: {
+      BoxId container = tree.get_inline_container(id);
+      tree.append_child(container, build_layout_box(tree, child));
+    } break;
+    case DisplayType::NONE:
+    default:
+      // display none, dont render them
+      break;
+    }
+  }
+  return id;
+}
+
+size_t count_styled_nodes(const StyledNode &styled_node) {
+  size_t count = 1;
+  for (const StyledNode &child : styled_node.children) {
+    count += count_styled_nodes(child);
+  }
+  return count;
+}
+
+// The styled tree has to outlive the layout tree, boxes point back into it.
+LayoutTree build_layout_tree(const StyledNode &styled_node) {
+  if (styled_node.display() == DisplayType::NONE) {
+    std::cout << "Root node has display:none" << std::endl;
+    assert(false);
+  }
+
+  LayoutTree tree;
+  // at least one box per styled node, so the arena mostly grows once
+  tree.boxes.reserve(count_styled_nodes(styled_node));
+  tree.root = build_layout_box(tree, styled_node);
+
+  // children always come after their parent, so walking backwards sees
+  // every subtree before the box that contains it
+  for (size_t i = tree.size(); i-- > 0;) {
+    LayoutBox &box = tree[static_cast<BoxId>(i)];
+    if (box.parent != NO_BOX) {
+      tree[box.parent].subtree_size += box.subtree_size;
+    }
+  }
+  return tree;
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef LAYOUT_UNIT_CPP
+#define LAYOUT_UNIT_CPP
+
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+
+// Fixed point layout coordinate: 1/64 of a pixel in an int32, which covers
+// about +-33 million pixels (same as Blink). Layout only ever does integer
+// math on these so results don't depend on how the work was split across
+// threads, and device pixels only show up at paint time.
+struct LayoutUnit {
+  static const int FRACTION_BITS = 6;
+  static const int32_t SCALE = 1 << FRACTION_BITS;
+
+  int32_t raw = 0;
+
+  constexpr LayoutUnit() = default;
+
+  static constexpr LayoutUnit from_raw(int32_t raw) {
+    LayoutUnit u;
+    u.raw = raw;
+    return u;
+  }
+  static constexpr LayoutUnit from_px(int px) { return from_raw(px * SCALE); }
+  static LayoutUnit from_float(float px) {
+    return from_raw(static_cast<int32_t>(std::lround(px * SCALE)));
+  }
+
+  float to_float() const { return static_cast<float>(this->raw) / SCALE; }
+  // nearest device pixel, halves round up
+  int round() const { return (this->raw + SCALE / 2) >> FRACTION_BITS; }
+
+  LayoutUnit operator-() const { return from_raw(-this->raw); }
+  LayoutUnit operator+(LayoutUnit o) const { return from_raw(raw + o.raw); }
+  LayoutUnit operator-(LayoutUnit o) const { return from_raw(raw - o.raw); }
+  LayoutUnit operator*(int n) const { return from_raw(this->raw * n); }
+  LayoutUnit operator/(int n) const { return from_raw(this->raw / n); }
+  LayoutUnit &operator+=(LayoutUnit o) {
+    this->raw += o.raw;
+    return *this;
+  }
+  LayoutUnit &operator-=(LayoutUnit o) {
+    this->raw -= o.raw;
+    return *this;
+  }
+
+  bool operator==(LayoutUnit o) const { return this->raw == o.raw; }
+  bool operator!=(LayoutUnit o) const { return this->raw != o.raw; }
+  bool operator<(LayoutUnit o) const { return this->raw < o.raw; }
+  bool operator>(LayoutUnit o) const { return this->raw > o.raw; }
+  bool operator<=(LayoutUnit o) const { return this->raw <= o.raw; }
+  bool operator>=(LayoutUnit o) const { return this->raw >= o.raw; }
+
+  friend std::ostream &operator<<(std::ostream &os, const LayoutUnit &u) {
+    os << u.to_float();
+    return os;
+  }
+};
+
+#endif
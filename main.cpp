@@ -4,8 +4,11 @@
 #include "imgui/imgui.h"
 
 #include "base_window.hpp"
+#include "compositor.cpp"
 #include "css_parser.cpp"
 #include "html_parser.cpp"
+#include "imgui_painter.cpp"
+#include "layout.cpp"
 #include "painter.cpp"
 
 void loop(GLFWwindow *window, Node *root) {
@@ -17,22 +20,12 @@ void loop(GLFWwindow *window, Node *root) {
   ImGui::ShowDemoWindow(&show);
 }
 
-void paint_item(DisplayCommand command) {
-  if (command.type == DisplayCommandType::SOLID_COLOR) {
-    auto box = command.box;
-    ImDrawList *draw_list = ImGui::GetWindowDrawList();
-    draw_list->AddRect(
-        ImVec2(box.x, box.y), ImVec2(box.x + box.width, box.y + box.height),
-        ImColor(command.color.r, command.color.g, command.color.b));
-  }
-}
-
-StyleSheet example_parse_css() {
+SharedStyleSheet example_parse_css() {
   std::ifstream css("example_html/index.css");
   std::stringstream cssbuffer;
   cssbuffer << css.rdbuf();
-  StyleSheet sheet = parse_css(cssbuffer.str());
-  // std::cout << sheet << std::endl;
+  SharedStyleSheet sheet = load_stylesheet(cssbuffer.str());
+  // std::cout << *sheet << std::endl;
   return sheet;
 }
 
@@ -46,44 +39,98 @@ Node *example_parse_html() {
   return root;
 }
 
-StyledNode style_tree(Node *root, StyleSheet sheet) {
-  StyledNode styled_node;
-  PropertyMap values;
-
-  if (root->type == NodeType::Element) {
-    ElementNode *elem = dynamic_cast<ElementNode *>(root);
-    values = specified_values(*elem, sheet);
-  } else {
-    // case NodeType::Text:
-    // case NodeType::Unknown:
-    // leave empty
-  }
-
-  std::vector<StyledNode> children;
-  for (Node *node : root->children) {
-    children.push_back(style_tree(node, sheet));
-  }
-
-  styled_node.node = *root;
-  styled_node.values = values;
-  styled_node.children = children;
-  return styled_node;
-}
-
-int main() {
+// The page is composited from layers on the CPU and shown as a texture,
+// or with --draw-lists painted into ImGui draw lists on the GPU.
+int main(int argc, char **argv) {
+  bool draw_lists = argc > 1 && std::string(argv[1]) == "--draw-lists";
   Node *root = example_parse_html();
-  StyleSheet sheet = example_parse_css();
-  StyledNode styled_root = style_tree(root, sheet);
-  LayoutBox layed_root = build_layout_tree(styled_root);
-  DisplayList display_list = build_display_list(layed_root);
+  SharedStyleSheet sheet = example_parse_css();
+  StyledNode styled_root = style_tree(root, *sheet);
+  LayoutTree layout_tree = build_layout_tree(styled_root);
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(1280);
+  // content-visibility: auto boxes far from here are skipped
+  layout_tree.viewport = viewport.content;
+  layout_tree.viewport.height = LayoutUnit::from_px(720);
+  layout_tree.layout(viewport);
+  DisplayList display_list = build_display_list(layout_tree);
 
   GLFWwindow *window = init_window();
   if (window == nullptr) {
     std::cout << "Failed to init glfw window" << std::endl;
     return -1;
   }
+  // draw page text with the same font layout measured it with
+  ImGui::GetIO().Fonts->AddFontFromFileTTF(DEFAULT_FONT_PATH, 32.0f);
+
+  // the page is painted once and reused until it scrolls too far, its
+  // text comes from a glyph atlas that has every size the page uses
+  PageDrawCache page_cache;
+  GlyphAtlas atlas;
+  AtlasTextures atlas_textures;
+  page_cache.painter.atlas = &atlas;
+  page_cache.painter.page_texture = [&](int page) {
+    return atlas_textures.texture(page);
+  };
+  int scroll = 0;
+  auto painted = [&]() {
+    ImGuiIO &io = ImGui::GetIO();
+    if (!io.WantCaptureMouse) {
+      scroll = std::max(0, scroll - static_cast<int>(io.MouseWheel * 40));
+    }
+    atlas.begin_frame();
+    ImDrawData *data =
+        page_cache.frame(display_list, 0, scroll, io.DisplaySize);
+    atlas_textures.upload(atlas);
+    return data;
+  };
 
-  run_until_close(window, std::bind(loop, std::placeholders::_1, root));
+  // scrolling only moves the layers around, they are rasterized again when
+  // they scroll past what was rasterized; when the window gets wider or
+  // narrower the page is laid out again and only the damage is repainted
+  Compositor compositor;
+  compositor.set_layers(build_layers(layout_tree));
+  compositor.set_geometry(export_geometry(layout_tree));
+  Framebuffer fb;
+  FramebufferTexture fb_texture;
+  auto composited = [&]() {
+    ImGuiIO &io = ImGui::GetIO();
+    PixelRect screen{0, 0, std::max(1, static_cast<int>(io.DisplaySize.x)),
+                     std::max(1, static_cast<int>(io.DisplaySize.y))};
+    if (fb.width != screen.width || fb.height != screen.height) {
+      fb = Framebuffer(screen.width, screen.height);
+    }
+    if (viewport.content.width != LayoutUnit::from_px(screen.width)) {
+      viewport.content.width = LayoutUnit::from_px(screen.width);
+      layout_tree.viewport.width = viewport.content.width;
+      layout_tree.viewport.height = LayoutUnit::from_px(screen.height);
+      layout_tree.layout(viewport);
+      compositor.set_layers(build_layers(layout_tree));
+      compositor.set_geometry(export_geometry(layout_tree));
+    }
+    if (!io.WantCaptureMouse && io.MouseWheel != 0) {
+      // the scroll container under the mouse, or the page
+      size_t layer = compositor.layer_at(static_cast<int>(io.MousePos.x),
+                                         static_cast<int>(io.MousePos.y));
+      compositor.scroll_by(layer, 0, static_cast<int>(-io.MouseWheel * 40),
+                           screen);
+    }
+    compositor.composite(fb, pack_color(Color{255, 255, 255, 255}));
+    if (compositor.stats.damaged_percent > 0) {
+      std::cout << "frame " << compositor.stats.composites << ": "
+                << compositor.stats.damaged_percent << "% damaged"
+                << std::endl;
+    }
+    return fb_texture.frame(fb);
+  };
+  std::function<ImDrawData *()> page = composited;
+  if (draw_lists) {
+    page = painted;
+  }
+  // frames only when there is input, nothing on the page moves by itself
+  GlfwFrameScheduler scheduler;
+  run_until_close(window, scheduler,
+                  std::bind(loop, std::placeholders::_1, root), page);
 
   return 0;
 }
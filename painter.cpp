@@ -1,92 +1,223 @@
 #ifndef PAINTER_CPP
 #define PAINTER_CPP
 
+#include <algorithm>
+#include <deque>
 #include <vector>
 
-#include "css_parser.cpp"
+#include "display_list.cpp"
+#include "layout.cpp"
 
-enum DisplayCommandType {
-  SOLID_COLOR,
-};
+const Color DEFAULT_COLOR{100, 100, 100, 255};
 
-struct DisplayCommand {
-  DisplayCommandType type;
-  Color color;
-  Rect box;
+// `name`, or `fallback_name` where that is not set, from the style of the
+// box; gray without a color
+Color get_color(const LayoutBox &layout, const std::string &name,
+                const std::string &fallback_name) {
+  DeclarationValueType color =
+      layout.lookup(name, fallback_name, DEFAULT_COLOR);
+  if (std::holds_alternative<Color>(color)) {
+    return std::get<Color>(color);
+  }
+  return DEFAULT_COLOR;
+}
 
-  friend std::ostream &operator<<(std::ostream &os, const DisplayCommand &dc) {
-    os << "DisplayCommand: ";
-    os << "(" << dc.type << ")";
-    os << " color: " << dc.color;
-    os << "\n";
-    os << dc.box;
-    return os;
+// Corner radii of the border box, top left first. Like CSS they are scaled
+// down together when two of them do not fit along a side.
+bool border_radii(const LayoutBox &layout, LayoutUnit radii[4]) {
+  const char *names[4] = {"border-top-left-radius", "border-top-right-radius",
+                          "border-bottom-right-radius",
+                          "border-bottom-left-radius"};
+  bool rounded = false;
+  for (int i = 0; i < 4; i++) {
+    radii[i] = std::max(
+        to_layout_unit(layout.lookup(names[i], "border-radius", ZERO)),
+        LayoutUnit());
+    rounded = rounded || radii[i].raw != 0;
   }
-};
+  if (!rounded) {
+    return false;
+  }
+  Rect box = layout.dims.border_box();
+  // the radii of the two corners of each side, top, right, bottom, left
+  double scale = 1;
+  for (int side = 0; side < 4; side++) {
+    int64_t sum = int64_t(radii[side].raw) + radii[(side + 1) % 4].raw;
+    LayoutUnit length = side % 2 == 0 ? box.width : box.height;
+    if (sum > length.raw) {
+      scale = std::min(scale, double(std::max(length.raw, 0)) / sum);
+    }
+  }
+  for (int i = 0; i < 4; i++) {
+    radii[i] = LayoutUnit::from_raw(static_cast<int32_t>(radii[i].raw * scale));
+  }
+  return true;
+}
 
-typedef std::vector<DisplayCommand> DisplayList;
+void render_background(DisplayList &list, const LayoutBox &layout) {
+  auto color = get_color(layout, "background-color", "background");
+  LayoutUnit radii[4];
+  if (border_radii(layout, radii)) {
+    list.push_rounded_rect(pack_color(color), layout.dims.border_box(), radii);
+    return;
+  }
+  list.push_solid_color(pack_color(color), layout.dims.border_box());
+}
 
-Color get_color(LayoutBox layout, std::string name) {
-  // TODO support get color
-  return Color{100, 100, 100, 255};
+// one command for all four sides, none without a border
+void render_borders(DisplayList &list, const LayoutBox &layout) {
+  const EdgeSize &border = layout.dims.border;
+  LayoutUnit widths[4] = {border.top, border.right, border.bottom,
+                          border.left};
+  if (widths[0].raw <= 0 && widths[1].raw <= 0 && widths[2].raw <= 0 &&
+      widths[3].raw <= 0) {
+    return;
+  }
+  const char *names[4] = {"border-top-color", "border-right-color",
+                          "border-bottom-color", "border-left-color"};
+  PackedColor colors[4];
+  for (int i = 0; i < 4; i++) {
+    colors[i] = pack_color(get_color(layout, names[i], "border-color"));
+  }
+  LayoutUnit radii[4];
+  border_radii(layout, radii);
+  list.push_border(layout.dims.border_box(), widths, colors, radii);
 }
 
-void render_background(DisplayList &list, LayoutBox layout) {
-  auto color = get_color(layout, "background");
-  list.push_back(DisplayCommand{DisplayCommandType::SOLID_COLOR, color,
-                                layout.dims.border_box()});
+Color text_color(const LayoutTree &tree, BoxId id) {
+  DeclarationValueType color =
+      tree.inherited_value(id, "color", Color{0, 0, 0, 255});
+  if (std::holds_alternative<Color>(color)) {
+    return std::get<Color>(color);
+  }
+  return Color{0, 0, 0, 255};
 }
 
-void render_borders(DisplayList &list, LayoutBox layout) {
-  auto color = get_color(layout, "border-color");
-
-  auto dims = layout.dims;
-  auto border = dims.border_box();
-  list.push_back(DisplayCommand{DisplayCommandType::SOLID_COLOR, color,
-                                Rect{
-                                    border.x,
-                                    border.y,
-                                    dims.border.left,
-                                    border.height,
-                                }});
-
-  list.push_back(DisplayCommand{DisplayCommandType::SOLID_COLOR, color,
-                                Rect{
-                                    border.x + border.width - dims.border.right,
-                                    border.y,
-                                    dims.border.right,
-                                    border.height,
-                                }});
-  list.push_back(DisplayCommand{DisplayCommandType::SOLID_COLOR, color,
-                                Rect{
-                                    border.x,
-                                    border.y,
-                                    border.width,
-                                    dims.border.top,
-                                }});
-  list.push_back(
-      DisplayCommand{DisplayCommandType::SOLID_COLOR, color,
-                     Rect{
-                         border.x,
-                         border.y + border.height - dims.border.bottom,
-                         border.width,
-                         dims.border.bottom,
-                     }});
+void render_text(DisplayList &list, const LayoutTree &tree, BoxId id) {
+  const LayoutBox &layout = tree[id];
+  for (const TextFragment &fragment : layout.fragments) {
+    Rect rect = fragment.rect;
+    rect.x += layout.dims.content.x;
+    rect.y += layout.dims.content.y;
+
+    // the text is copied, so the list does not depend on the DOM
+    list.push_text(pack_color(text_color(tree, fragment.box)), rect,
+                   fragment.font_size, fragment.text->data() + fragment.start,
+                   fragment.length);
+  }
 }
 
-void render_layout_box(DisplayList &list, LayoutBox layout) {
+enum class LayerKind { ROOT, SCROLL, FIXED };
+
+// Part of the page that moves on its own when scrolling: the page itself,
+// the children of a scroll container or a fixed box and everything in it.
+// Commands are where layout put them, as if nothing was scrolled.
+struct Layer {
+  LayerKind kind;
+  // the box that starts it, the root box for the root layer
+  BoxId box;
+  // the layer it is in, itself for the root
+  size_t parent;
+  // Content of a layer that comes after a scroll container in it goes into
+  // a layer of its own, so it paints over the scroll layer. That layer
+  // continues this one and scrolls with it; itself for the others.
+  size_t continues;
+  // scroll layers only show the padding box of their container
+  Rect clip;
+  DisplayList list;
+};
+
+// in tree order, so a layer comes after the one it is in
+typedef std::deque<Layer> LayerList;
+
+// `layers` splits what is painted into layers, `list` being the one of
+// layer `layer`, without it everything goes into `list`. A deque so lists
+// stay where they are while layers are added. Returns the list what comes
+// after the box goes into, `list` unless the box has a scroll container in
+// it.
+DisplayList *render_layout_box(DisplayList &list, const LayoutTree &tree,
+                               BoxId id, LayerList *layers = nullptr,
+                               size_t layer = 0) {
+  const LayoutBox &layout = tree[id];
+  list.begin_box(id);
   render_background(list, layout);
   render_borders(list, layout);
-  // TODO render text
-  for (auto child : layout.children) {
-    render_layout_box(list, child);
+  if (tree.establishes_inline_context(id)) {
+    // inline children only show up through the text fragments
+    render_text(list, tree, id);
+    return &list;
+  }
+  // the container itself scrolls with the layer it is in, its children
+  // go into a layer of their own. The root's layer is the page.
+  DisplayList *children = &list;
+  size_t children_layer = layer;
+  bool scroll_layer = layers != nullptr && layout.scrolls && id != tree.root;
+  if (scroll_layer) {
+    size_t index = layers->size();
+    layers->push_back(Layer{LayerKind::SCROLL, id, layer, index,
+                            layout.dims.padding_box(), DisplayList()});
+    children = &layers->back().list;
+    children_layer = index;
   }
+  bool lazy_root = tree.lazy && id == tree.root;
+  for (BoxId child = layout.first_child; child != NO_BOX;
+       child = tree[child].next_sibling) {
+    if (child == tree.lazy_tail) {
+      // never laid out, see LayoutTree::layout_block_children
+      break;
+    }
+    if (tree[child].deferred) {
+      // only a placeholder, the children have no geometry yet
+      continue;
+    }
+    if (lazy_root) {
+      Rect box = tree[child].dims.margin_box();
+      if (!tree.in_prefetch_window(box.y, box.y + box.height)) {
+        continue;
+      }
+    }
+    if (layers != nullptr && tree[child].fixed) {
+      size_t index = layers->size();
+      layers->push_back(Layer{LayerKind::FIXED, child, children_layer, index,
+                              Rect(), DisplayList()});
+      render_layout_box(layers->back().list, tree, child, layers, index);
+      continue;
+    }
+    children = render_layout_box(*children, tree, child, layers,
+                                 children_layer);
+  }
+  if (!scroll_layer) {
+    return children;
+  }
+  // the rest of the layer the container is in paints over it
+  const Layer &in = (*layers)[layer];
+  layers->push_back(
+      Layer{in.kind, in.box, in.parent, layer, in.clip, DisplayList()});
+  return &layers->back().list;
 }
 
-DisplayList build_display_list(LayoutBox root) {
+DisplayList build_display_list(const LayoutTree &tree) {
   DisplayList list;
-  render_layout_box(list, root);
+  if (tree.root != NO_BOX) {
+    render_layout_box(list, tree, tree.root);
+  }
+  list.build_index();
   return list;
 }
 
+// the root layer first, then the others in tree order
+LayerList build_layers(const LayoutTree &tree) {
+  LayerList layers;
+  if (tree.root == NO_BOX) {
+    return layers;
+  }
+  layers.push_back(
+      Layer{LayerKind::ROOT, tree.root, 0, 0, Rect(), DisplayList()});
+  render_layout_box(layers.front().list, tree, tree.root, &layers, 0);
+  for (Layer &layer : layers) {
+    layer.list.build_index();
+  }
+  return layers;
+}
+
 #endif
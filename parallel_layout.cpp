@@ -0,0 +1,162 @@
+#ifndef PARALLEL_LAYOUT_CPP
+#define PARALLEL_LAYOUT_CPP
+
+#include "layout.cpp"
+#include "thread_pool.cpp"
+
+// Subtrees smaller than this stay on the current thread, a task costs more
+// than laying out a couple hundred boxes.
+const uint32_t PARALLEL_LAYOUT_CUTOFF = 256;
+
+// Block layout split into passes that only look at a box and its direct
+// children, so sibling subtrees can run on different threads:
+//
+//   1. bottom up: intrinsic min/max-content widths
+//   2. top down: used widths, horizontal position and vertical edges
+//   3. bottom up: heights
+//   4. top down: vertical position
+//
+// It does the same integer math as LayoutTree::layout, so the result is
+// identical to the sequential engine. Passes 2 to 4 lay out everything, so
+// a tree in lazy mode or with content-visibility: auto boxes goes through
+// LayoutTree::layout instead, which knows how to skip them.
+struct ParallelLayout {
+  LayoutTree &tree;
+  ThreadPool &pool;
+  uint32_t cutoff;
+
+  ParallelLayout(LayoutTree &t, ThreadPool &p,
+                 uint32_t c = PARALLEL_LAYOUT_CUTOFF)
+      : tree(t), pool(p), cutoff(c) {}
+
+  template <typename F> void for_each_child(BoxId id, F f) {
+    if (this->tree.establishes_inline_context(id)) {
+      // inline children belong to the lines of `id`
+      return;
+    }
+    TaskGroup group(this->pool);
+    for (BoxId child = this->tree[id].first_child; child != NO_BOX;
+         child = this->tree[child].next_sibling) {
+      if (this->tree[child].subtree_size >= this->cutoff) {
+        group.run([f, child] { f(child); });
+      } else {
+        f(child);
+      }
+    }
+    group.wait();
+  }
+
+  void intrinsic_widths(BoxId id) {
+    if (this->tree[id].subtree_size < this->cutoff ||
+        this->tree.establishes_inline_context(id)) {
+      this->tree.compute_intrinsic_widths(id);
+      return;
+    }
+    this->for_each_child(id, [this](BoxId child) {
+      this->intrinsic_widths(child);
+    });
+    this->tree.intrinsic_widths_from_children(id);
+  }
+
+  void assign_widths(BoxId id, const Dimensions &containing_block) {
+    this->tree.calculate_block_width(id, containing_block);
+    this->tree.calculate_vertical_edges(id);
+
+    LayoutBox &box = this->tree[id];
+    Dimensions &d = box.dims;
+    d.content.x = containing_block.content.x + d.margin.left + d.border.left +
+                  d.padding.left;
+    box.last_containing_width = containing_block.content.width;
+
+    this->for_each_child(id, [this, &d](BoxId child) {
+      this->assign_widths(child, d);
+    });
+  }
+
+  void assign_heights(BoxId id) {
+    this->for_each_child(id, [this](BoxId child) {
+      this->assign_heights(child);
+    });
+
+    LayoutBox &box = this->tree[id];
+    if (this->tree.establishes_inline_context(id)) {
+      this->tree.layout_inline_lines(id);
+    } else {
+      box.dims.content.height = LayoutUnit();
+      for (BoxId child = box.first_child; child != NO_BOX;
+           child = this->tree[child].next_sibling) {
+        if (!this->tree[child].fixed) {
+          box.dims.content.height +=
+              this->tree[child].dims.margin_box().height;
+        }
+      }
+    }
+    this->tree.calculate_block_height(id);
+    box.needs_layout = false;
+    box.child_needs_layout = false;
+  }
+
+  void assign_positions(BoxId id) {
+    if (this->tree.establishes_inline_context(id)) {
+      // text fragments are relative to the content box
+      return;
+    }
+    const Dimensions &d = this->tree[id].dims;
+    LayoutUnit y = d.content.y;
+    for (BoxId child = this->tree[id].first_child; child != NO_BOX;
+         child = this->tree[child].next_sibling) {
+      Dimensions &c = this->tree[child].dims;
+      c.content.y = y + c.margin.top + c.border.top + c.padding.top;
+      if (!this->tree[child].fixed) {
+        y += c.margin_box().height;
+      }
+    }
+
+    this->for_each_child(id, [this](BoxId child) {
+      this->assign_positions(child);
+    });
+  }
+
+  // whether some box may be left unlaid out depending on the viewport
+  bool defers_layout() const {
+    if (this->tree.lazy) {
+      return true;
+    }
+    for (BoxId id = 0; id < this->tree.size(); id++) {
+      if (this->tree.may_defer(id)) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void layout(const Dimensions &containing_block) {
+    BoxId root = this->tree.root;
+    if (root == NO_BOX) {
+      return;
+    }
+    this->intrinsic_widths(root);
+    if (this->defers_layout()) {
+      this->tree.layout(containing_block);
+      return;
+    }
+    this->assign_widths(root, containing_block);
+    this->assign_heights(root);
+
+    Dimensions &d = this->tree[root].dims;
+    d.content.y = containing_block.content.y +
+                  containing_block.content.height + d.margin.top +
+                  d.border.top + d.padding.top;
+    this->assign_positions(root);
+
+    this->tree.stats = LayoutStats();
+    this->tree.stats.laid_out = this->tree.size();
+  }
+};
+
+void parallel_layout(LayoutTree &tree, const Dimensions &containing_block,
+                     ThreadPool &pool) {
+  ParallelLayout(tree, pool).layout(containing_block);
+}
+
+#endif
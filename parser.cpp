@@ -38,13 +38,14 @@ struct Parser {
   }
 
   // Do the next characters start with the given string?
-  bool starts_with(std::string prefix) {
-    auto found = std::mismatch(prefix.begin(), prefix.end(),
-                               input.substr(position).begin());
-    return found.first == prefix.end();
+  bool starts_with(const std::string &prefix) {
+    // compared in place, a copy of the rest of the input made parsing
+    // quadratic
+    return !this->is_eof() &&
+           this->input.compare(this->position, prefix.size(), prefix) == 0;
   }
 
-  bool is_eof() { return this->position > this->input.size(); }
+  bool is_eof() { return this->position >= (int)this->input.size(); }
 
   char consume_next_character() {
     auto c = this->next_character();
@@ -0,0 +1,858 @@
+#ifndef RASTER_CPP
+#define RASTER_CPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define RASTER_AVX_DISPATCH
+#endif
+
+#include "display_list.cpp"
+#include "font.cpp"
+
+// x / 255 rounded, exact for anything a product of two channels can be
+uint32_t div255(uint32_t x) { return (x + 128 + ((x + 128) >> 8)) >> 8; }
+
+// Display lists have straight alpha, framebuffers premultiplied alpha so
+// translucent pixels (in the surface of a compositing layer) blend with
+// one multiply per channel.
+uint32_t premultiply(PackedColor color) {
+  uint32_t a = color >> 24;
+  if (a == 255) {
+    return color;
+  }
+  uint32_t out = a << 24;
+  for (int shift = 0; shift < 24; shift += 8) {
+    out |= div255((color >> shift & 0xff) * a) << shift;
+  }
+  return out;
+}
+
+PackedColor unpremultiply(uint32_t pixel) {
+  uint32_t a = pixel >> 24;
+  if (a == 255 || a == 0) {
+    return pixel;
+  }
+  uint32_t out = a << 24;
+  for (int shift = 0; shift < 24; shift += 8) {
+    uint32_t c = ((pixel >> shift & 0xff) * 255 + a / 2) / a;
+    out |= std::min(c, 255u) << shift;
+  }
+  return out;
+}
+
+// Software backend for the display list, for machines without a GPU
+// (screenshots, golden images). Pixels are RGBA in memory, premultiplied.
+struct Framebuffer {
+  int width = 0, height = 0;
+  std::vector<uint32_t> pixels;
+
+  Framebuffer() = default;
+  Framebuffer(int w, int h) : width(w), height(h), pixels(w * h) {}
+
+  uint32_t *row(int y) { return this->pixels.data() + y * this->width; }
+  const uint32_t *row(int y) const {
+    return this->pixels.data() + y * this->width;
+  }
+  void clear(PackedColor color) {
+    std::fill(this->pixels.begin(), this->pixels.end(), premultiply(color));
+  }
+};
+
+PixelRect intersect(const PixelRect &a, const PixelRect &b) {
+  int left = std::max(a.x, b.x);
+  int top = std::max(a.y, b.y);
+  int right = std::min(a.x + a.width, b.x + b.width);
+  int bottom = std::min(a.y + a.height, b.y + b.height);
+  return PixelRect{left, top, std::max(right - left, 0),
+                   std::max(bottom - top, 0)};
+}
+
+void fill_span_scalar(uint32_t *dst, int count, PackedColor color) {
+  for (int i = 0; i < count; i++) {
+    dst[i] = color;
+  }
+}
+
+void fill_span_sse2(uint32_t *dst, int count, PackedColor color) {
+  int i = 0;
+#if defined(__SSE2__)
+  __m128i v = _mm_set1_epi32(static_cast<int>(color));
+  for (; i + 4 <= count; i += 4) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), v);
+  }
+#endif
+  fill_span_scalar(dst + i, count - i, color);
+}
+
+#if defined(RASTER_AVX_DISPATCH)
+// built for AVX no matter the compiler flags, only called when the cpu has it
+__attribute__((target("avx"))) void fill_span_avx(uint32_t *dst, int count,
+                                                  PackedColor color) {
+  int i = 0;
+  __m256i v = _mm256_set1_epi32(static_cast<int>(color));
+  for (; i + 8 <= count; i += 8) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), v);
+  }
+  fill_span_sse2(dst + i, count - i, color);
+}
+#endif
+
+typedef void (*FillSpan)(uint32_t *, int, PackedColor);
+
+FillSpan best_fill_span() {
+#if defined(RASTER_AVX_DISPATCH)
+  if (__builtin_cpu_supports("avx")) {
+    return fill_span_avx;
+  }
+#endif
+  return fill_span_sse2;
+}
+
+const FillSpan fill_span = best_fill_span();
+
+// Premultiplied `src` over `dst`. The SIMD versions below have to match
+// this bit for bit.
+uint32_t blend_pixel(uint32_t src, uint32_t dst) {
+  uint32_t inverse = 255 - (src >> 24);
+  uint32_t out = 0;
+  for (int shift = 0; shift < 32; shift += 8) {
+    uint32_t d = dst >> shift & 0xff;
+    uint32_t c = (src >> shift & 0xff) + div255(d * inverse);
+    out |= std::min(c, 255u) << shift;
+  }
+  return out;
+}
+
+void blend_span_scalar(uint32_t *dst, const uint32_t *src, int count) {
+  for (int i = 0; i < count; i++) {
+    dst[i] = blend_pixel(src[i], dst[i]);
+  }
+}
+
+void blend_color_span_scalar(uint32_t *dst, int count, uint32_t src) {
+  for (int i = 0; i < count; i++) {
+    dst[i] = blend_pixel(src, dst[i]);
+  }
+}
+
+#if defined(__SSE2__)
+// four pixels, widened to 16 bits per channel two at a time
+inline __m128i blend4_sse2(__m128i src, __m128i dst) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i inverse = _mm_sub_epi32(_mm_set1_epi32(255), _mm_srli_epi32(src, 24));
+  inverse = _mm_or_si128(inverse, _mm_slli_epi32(inverse, 16));
+  __m128i bias = _mm_set1_epi16(128);
+  __m128i halves[2];
+  for (int h = 0; h < 2; h++) {
+    __m128i d = h == 0 ? _mm_unpacklo_epi8(dst, zero)
+                       : _mm_unpackhi_epi8(dst, zero);
+    __m128i a = h == 0 ? _mm_unpacklo_epi32(inverse, inverse)
+                       : _mm_unpackhi_epi32(inverse, inverse);
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(d, a), bias);
+    halves[h] = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+  }
+  return _mm_adds_epu8(src, _mm_packus_epi16(halves[0], halves[1]));
+}
+#endif
+
+// 8 pixels a step; runs of opaque or empty sources are copied or skipped
+void blend_span_sse2(uint32_t *dst, const uint32_t *src, int count) {
+  int i = 0;
+#if defined(__SSE2__)
+  __m128i alpha = _mm_set1_epi32(static_cast<int>(0xff000000));
+  __m128i zero = _mm_setzero_si128();
+  for (; i + 8 <= count; i += 8) {
+    __m128i s0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+    __m128i s1 =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i + 4));
+    __m128i both = _mm_and_si128(_mm_and_si128(s0, s1), alpha);
+    __m128i any = _mm_or_si128(s0, s1);
+    __m128i *d = reinterpret_cast<__m128i *>(dst + i);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(any, zero)) == 0xffff) {
+      continue;
+    }
+    if (_mm_movemask_epi8(_mm_cmpeq_epi32(both, alpha)) == 0xffff) {
+      _mm_storeu_si128(d, s0);
+      _mm_storeu_si128(d + 1, s1);
+      continue;
+    }
+    _mm_storeu_si128(d, blend4_sse2(s0, _mm_loadu_si128(d)));
+    _mm_storeu_si128(d + 1, blend4_sse2(s1, _mm_loadu_si128(d + 1)));
+  }
+#endif
+  blend_span_scalar(dst + i, src + i, count - i);
+}
+
+void blend_color_span_sse2(uint32_t *dst, int count, uint32_t src) {
+  int i = 0;
+#if defined(__SSE2__)
+  __m128i s = _mm_set1_epi32(static_cast<int>(src));
+  for (; i + 8 <= count; i += 8) {
+    __m128i *d = reinterpret_cast<__m128i *>(dst + i);
+    _mm_storeu_si128(d, blend4_sse2(s, _mm_loadu_si128(d)));
+    _mm_storeu_si128(d + 1, blend4_sse2(s, _mm_loadu_si128(d + 1)));
+  }
+#endif
+  blend_color_span_scalar(dst + i, count - i, src);
+}
+
+#if defined(RASTER_AVX_DISPATCH)
+// blend4_sse2 on both 128 bit lanes, the unpacks and the pack stay within
+// a lane so the pixels come back in order
+__attribute__((target("avx2"))) inline __m256i blend8_avx2(__m256i src,
+                                                          __m256i dst) {
+  __m256i zero = _mm256_setzero_si256();
+  __m256i inverse =
+      _mm256_sub_epi32(_mm256_set1_epi32(255), _mm256_srli_epi32(src, 24));
+  inverse = _mm256_or_si256(inverse, _mm256_slli_epi32(inverse, 16));
+  __m256i bias = _mm256_set1_epi16(128);
+  __m256i lo = _mm256_mullo_epi16(_mm256_unpacklo_epi8(dst, zero),
+                                  _mm256_unpacklo_epi32(inverse, inverse));
+  __m256i hi = _mm256_mullo_epi16(_mm256_unpackhi_epi8(dst, zero),
+                                  _mm256_unpackhi_epi32(inverse, inverse));
+  lo = _mm256_add_epi16(lo, bias);
+  hi = _mm256_add_epi16(hi, bias);
+  lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+  hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+  return _mm256_adds_epu8(src, _mm256_packus_epi16(lo, hi));
+}
+
+// 16 pixels a step
+__attribute__((target("avx2"))) void
+blend_span_avx2(uint32_t *dst, const uint32_t *src, int count) {
+  int i = 0;
+  __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xff000000));
+  __m256i zero = _mm256_setzero_si256();
+  for (; i + 16 <= count; i += 16) {
+    __m256i s0 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i));
+    __m256i s1 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i + 8));
+    __m256i both = _mm256_and_si256(_mm256_and_si256(s0, s1), alpha);
+    __m256i any = _mm256_or_si256(s0, s1);
+    __m256i *d = reinterpret_cast<__m256i *>(dst + i);
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(any, zero)) == -1) {
+      continue;
+    }
+    if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(both, alpha)) == -1) {
+      _mm256_storeu_si256(d, s0);
+      _mm256_storeu_si256(d + 1, s1);
+      continue;
+    }
+    _mm256_storeu_si256(d, blend8_avx2(s0, _mm256_loadu_si256(d)));
+    _mm256_storeu_si256(d + 1, blend8_avx2(s1, _mm256_loadu_si256(d + 1)));
+  }
+  blend_span_sse2(dst + i, src + i, count - i);
+}
+
+__attribute__((target("avx2"))) void
+blend_color_span_avx2(uint32_t *dst, int count, uint32_t src) {
+  int i = 0;
+  __m256i s = _mm256_set1_epi32(static_cast<int>(src));
+  for (; i + 16 <= count; i += 16) {
+    __m256i *d = reinterpret_cast<__m256i *>(dst + i);
+    _mm256_storeu_si256(d, blend8_avx2(s, _mm256_loadu_si256(d)));
+    _mm256_storeu_si256(d + 1, blend8_avx2(s, _mm256_loadu_si256(d + 1)));
+  }
+  blend_color_span_sse2(dst + i, count - i, src);
+}
+#endif
+
+typedef void (*BlendSpan)(uint32_t *, const uint32_t *, int);
+typedef void (*BlendColorSpan)(uint32_t *, int, uint32_t);
+
+BlendSpan best_blend_span() {
+#if defined(RASTER_AVX_DISPATCH)
+  if (__builtin_cpu_supports("avx2")) {
+    return blend_span_avx2;
+  }
+#endif
+  return blend_span_sse2;
+}
+
+BlendColorSpan best_blend_color_span() {
+#if defined(RASTER_AVX_DISPATCH)
+  if (__builtin_cpu_supports("avx2")) {
+    return blend_color_span_avx2;
+  }
+#endif
+  return blend_color_span_sse2;
+}
+
+// premultiplied pixels over premultiplied pixels
+const BlendSpan blend_span = best_blend_span();
+// one premultiplied color over a run of pixels
+const BlendColorSpan blend_color_span = best_blend_color_span();
+
+// `color` (straight alpha) over what is there
+void fill_rect(Framebuffer &fb, const PixelRect &rect, const PixelRect &clip,
+               PackedColor color) {
+  PixelRect r = intersect(rect, clip);
+  uint32_t alpha = color >> 24;
+  if (alpha == 0) {
+    return;
+  }
+  for (int y = r.y; y < r.y + r.height; y++) {
+    if (alpha == 255) {
+      fill_span(fb.row(y) + r.x, r.width, color);
+    } else {
+      blend_color_span(fb.row(y) + r.x, r.width, premultiply(color));
+    }
+  }
+}
+
+// `color` replaces what is there, for backgrounds
+void clear_rect(Framebuffer &fb, const PixelRect &rect, PackedColor color) {
+  uint32_t pixel = premultiply(color);
+  for (int y = rect.y; y < rect.y + rect.height; y++) {
+    fill_span(fb.row(y) + rect.x, rect.width, pixel);
+  }
+}
+
+// coverage times the text color, over what is there
+void blend_glyph(Framebuffer &fb, const GlyphBitmap &glyph, int x, int y,
+                 const PixelRect &clip, PackedColor color) {
+  PixelRect r = intersect(PixelRect{x, y, glyph.width, glyph.height}, clip);
+  uint32_t alpha = color >> 24;
+  for (int row = r.y; row < r.y + r.height; row++) {
+    const unsigned char *coverage =
+        glyph.coverage.data() + (row - y) * glyph.width + (r.x - x);
+    uint32_t *dst = fb.row(row) + r.x;
+    for (int i = 0; i < r.width; i++) {
+      uint32_t a = coverage[i] * alpha / 255;
+      if (a == 0) {
+        continue;
+      }
+      dst[i] = blend_pixel(premultiply((color & 0xffffff) | a << 24), dst[i]);
+    }
+  }
+}
+
+// `origin` is the page position of the framebuffer's top left pixel
+void draw_text(Framebuffer &fb, const TextCommand &text, int origin_x,
+               int origin_y, const PixelRect &clip) {
+  Font &font = default_font();
+  if (!font.loaded) {
+    // TODO fallback metrics have no glyphs to draw
+    return;
+  }
+  FontSize &size = font.at_size(static_cast<int>(text.font_size));
+  PixelRect box = text.box.rect().snapped();
+  int baseline = box.y - origin_y + size.ascent.round();
+
+  // same walk as FontSize::measure so glyphs land where layout put them
+  walk_glyphs(size, text.text(), text.length, [&](int glyph, int pen) {
+    const GlyphBitmap &bitmap = size.glyph_bitmap(glyph);
+    int x = box.x - origin_x + pen;
+    blend_glyph(fb, bitmap, x + bitmap.x0, baseline + bitmap.y0, clip,
+                text.color);
+  });
+}
+
+// A box with elliptical corners, in framebuffer pixels. Corners are in CSS
+// order like in BorderCommand.
+struct RoundedBox {
+  float left = 0, top = 0, right = 0, bottom = 0;
+  float rx[4] = {0, 0, 0, 0};
+  float ry[4] = {0, 0, 0, 0};
+
+  bool empty() const {
+    return this->right <= this->left || this->bottom <= this->top;
+  }
+};
+
+// Distance from (x, y), relative to the center, to the ellipse: its value
+// over its gradient, which is exact for circles and close enough for
+// antialiasing otherwise.
+float ellipse_distance(float x, float y, float rx, float ry) {
+  float rx2 = rx * rx, ry2 = ry * ry;
+  float k0 = std::sqrt(x * x / rx2 + y * y / ry2);
+  float k1 = std::sqrt(x * x / (rx2 * rx2) + y * y / (ry2 * ry2));
+  if (k1 == 0) {
+    return -std::min(rx, ry);
+  }
+  return k0 * (k0 - 1) / k1;
+}
+
+// signed distance from (x, y) to the edge of `b`, negative inside
+float rounded_distance(const RoundedBox &b, float x, float y) {
+  for (int c = 0; c < 4; c++) {
+    if (b.rx[c] <= 0 || b.ry[c] <= 0) {
+      continue;
+    }
+    bool left = c == 0 || c == 3, top = c < 2;
+    float cx = left ? b.left + b.rx[c] : b.right - b.rx[c];
+    float cy = top ? b.top + b.ry[c] : b.bottom - b.ry[c];
+    if ((left ? x < cx : x > cx) && (top ? y < cy : y > cy)) {
+      return ellipse_distance(x - cx, y - cy, b.rx[c], b.ry[c]);
+    }
+  }
+  return std::max(std::max(b.left - x, x - b.right),
+                  std::max(b.top - y, y - b.bottom));
+}
+
+// 0 to 255, how much of the pixel at (x, y) is inside `b`
+uint32_t rounded_coverage(const RoundedBox &b, int x, int y) {
+  if (b.empty()) {
+    return 0;
+  }
+  float d = rounded_distance(b, x + 0.5f, y + 0.5f);
+  return static_cast<uint32_t>(std::clamp(0.5f - d, 0.0f, 1.0f) * 255 + 0.5f);
+}
+
+// Runs of pixels in a row with the same color and coverage, filled as one
+// span.
+struct SpanWriter {
+  uint32_t *row;
+  int start = 0, end = 0;
+  PackedColor color = 0;
+  uint32_t coverage = 0;
+
+  explicit SpanWriter(uint32_t *r) : row(r) {}
+
+  void add(int x, int count, PackedColor c, uint32_t cov) {
+    if (x == this->end && c == this->color && cov == this->coverage) {
+      this->end += count;
+      return;
+    }
+    this->flush();
+    this->start = x;
+    this->end = x + count;
+    this->color = c;
+    this->coverage = cov;
+  }
+
+  void flush() {
+    uint32_t alpha = div255((this->color >> 24) * this->coverage);
+    int count = this->end - this->start;
+    if (alpha == 255) {
+      fill_span(this->row + this->start, count, this->color);
+    } else if (alpha != 0 && count > 0) {
+      uint32_t color = premultiply((this->color & 0xffffff) | alpha << 24);
+      blend_color_span(this->row + this->start, count, color);
+    }
+    this->start = this->end;
+  }
+};
+
+// The color of the side the pixel at (x, y) is closest to, relative to
+// that side's width, so corners split along their diagonal like in CSS.
+PackedColor side_color(const RoundedBox &outer, const float widths[4],
+                       const PackedColor colors[4], int x, int y) {
+  float cx = x + 0.5f, cy = y + 0.5f;
+  float distances[4] = {cy - outer.top, outer.right - cx, outer.bottom - cy,
+                        cx - outer.left};
+  int closest = -1;
+  float best = 0;
+  for (int side = 0; side < 4; side++) {
+    if (widths[side] <= 0) {
+      continue;
+    }
+    float d = distances[side] / widths[side];
+    if (closest < 0 || d < best) {
+      closest = side;
+      best = d;
+    }
+  }
+  return colors[std::max(closest, 0)];
+}
+
+// Paints what is inside `outer` and not inside `inner` (which can be
+// empty) in one pass over the rows, a pixel in the color side_color()
+// gives it. Only the ends of a row, where the corners and the side borders
+// are, are looked at pixel by pixel.
+void fill_rounded(Framebuffer &fb, const RoundedBox &outer,
+                  const RoundedBox &inner, const float widths[4],
+                  const PackedColor colors[4], const PixelRect &clip) {
+  int left = static_cast<int>(std::floor(outer.left));
+  int top = static_cast<int>(std::floor(outer.top));
+  PixelRect r = intersect(
+      PixelRect{left, top,
+                static_cast<int>(std::ceil(outer.right)) - left,
+                static_cast<int>(std::ceil(outer.bottom)) - top},
+      clip);
+  bool hollow = !inner.empty();
+  auto pixel = [&](int x, int y, PackedColor &color) {
+    uint32_t coverage = rounded_coverage(outer, x, y);
+    if (hollow && coverage != 0) {
+      coverage -= std::min(coverage, rounded_coverage(inner, x, y));
+    }
+    color = side_color(outer, widths, colors, x, y);
+    return coverage;
+  };
+  for (int y = r.y; y < r.y + r.height; y++) {
+    float cy = y + 0.5f;
+    // how far in from either end a row can have more than one color
+    float left_zone = hollow ? widths[SIDE_LEFT] : 0;
+    float right_zone = hollow ? widths[SIDE_RIGHT] : 0;
+    for (int c = 0; c < 4; c++) {
+      bool in_corner = c < 2 ? cy < outer.top + outer.ry[c]
+                             : cy > outer.bottom - outer.ry[c];
+      if (!in_corner) {
+        continue;
+      }
+      float &zone = c == 0 || c == 3 ? left_zone : right_zone;
+      zone = std::max(zone, outer.rx[c]);
+    }
+    int end = r.x + r.width;
+    int a = std::clamp(static_cast<int>(std::ceil(outer.left + left_zone)),
+                       r.x, end);
+    int b = std::clamp(static_cast<int>(std::floor(outer.right - right_zone)),
+                       a, end);
+    SpanWriter writer(fb.row(y));
+    PackedColor color;
+    for (int x = r.x; x < a; x++) {
+      uint32_t coverage = pixel(x, y, color);
+      writer.add(x, 1, color, coverage);
+    }
+    if (a < b) {
+      // the same all the way, a side's color or nothing
+      uint32_t coverage = pixel(a, y, color);
+      writer.add(a, b - a, color, coverage);
+    }
+    for (int x = b; x < end; x++) {
+      uint32_t coverage = pixel(x, y, color);
+      writer.add(x, 1, color, coverage);
+    }
+    writer.flush();
+  }
+}
+
+// `count` pixels of `color` (straight alpha) over what is there. Runs as
+// short as the sides of most borders are written here instead of going
+// through fill_span.
+void fill_run(uint32_t *dst, int count, PackedColor color) {
+  uint32_t alpha = color >> 24;
+  if (count <= 0 || alpha == 0) {
+    return;
+  }
+  if (alpha != 255) {
+    blend_color_span(dst, count, premultiply(color));
+  } else if (count < 8) {
+    for (int i = 0; i < count; i++) {
+      dst[i] = color;
+    }
+  } else {
+    fill_span(dst, count, color);
+  }
+}
+
+// A border with square corners between `o` and `i` (framebuffer pixels),
+// the same pixels fill_rounded() paints for it. Rows are at most three
+// runs: the left side, the top or bottom (or nothing) and the right side.
+// Only where two colors meet in a corner is looked at pixel by pixel, and
+// that needs `i` not to be empty.
+void fill_square_border(Framebuffer &fb, const PixelRect &o,
+                        const PixelRect &i, const RoundedBox &outer,
+                        const float widths[4], const PackedColor colors[4],
+                        const PixelRect &clip) {
+  int right = o.x + o.width, bottom = o.y + o.height;
+  int inner_left = std::clamp(i.x, o.x, right);
+  int inner_right = std::clamp(i.x + i.width, inner_left, right);
+  int inner_top = std::clamp(i.y, o.y, bottom);
+  int inner_bottom = std::clamp(i.y + i.height, inner_top, bottom);
+  bool one_color = colors[0] == colors[1] && colors[0] == colors[2] &&
+                   colors[0] == colors[3];
+  PixelRect r = intersect(o, clip);
+  int clip_right = r.x + r.width;
+  for (int y = r.y; y < r.y + r.height; y++) {
+    uint32_t *row = fb.row(y);
+    auto run = [&](int from, int to, PackedColor color) {
+      from = std::max(from, r.x);
+      fill_run(row + from, std::min(to, clip_right) - from, color);
+    };
+    if (y >= inner_top && y < inner_bottom) {
+      run(o.x, inner_left, colors[SIDE_LEFT]);
+      run(inner_right, right, colors[SIDE_RIGHT]);
+      continue;
+    }
+    PackedColor color = colors[y < inner_top ? SIDE_TOP : SIDE_BOTTOM];
+    if (one_color) {
+      run(o.x, right, color);
+      continue;
+    }
+    for (int x = std::max(o.x, r.x); x < std::min(inner_left, clip_right);
+         x++) {
+      fill_run(row + x, 1, side_color(outer, widths, colors, x, y));
+    }
+    run(inner_left, inner_right, color);
+    for (int x = std::max(inner_right, r.x); x < std::min(right, clip_right);
+         x++) {
+      fill_run(row + x, 1, side_color(outer, widths, colors, x, y));
+    }
+  }
+}
+
+// outer and inner edges are snapped like the rects of the sides would be
+void draw_border(Framebuffer &fb, const BorderCommand &border, int origin_x,
+                 int origin_y, const PixelRect &clip) {
+  Rect box = border.box.rect();
+  LayoutUnit top = LayoutUnit::from_raw(border.widths[SIDE_TOP]);
+  LayoutUnit right = LayoutUnit::from_raw(border.widths[SIDE_RIGHT]);
+  LayoutUnit bottom = LayoutUnit::from_raw(border.widths[SIDE_BOTTOM]);
+  LayoutUnit left = LayoutUnit::from_raw(border.widths[SIDE_LEFT]);
+  PixelRect o = box.snapped();
+  PixelRect i = Rect{box.x + left, box.y + top, box.width - left - right,
+                     box.height - top - bottom}
+                    .snapped();
+  RoundedBox outer, inner;
+  outer.left = float(o.x - origin_x);
+  outer.top = float(o.y - origin_y);
+  outer.right = outer.left + o.width;
+  outer.bottom = outer.top + o.height;
+  inner.left = float(i.x - origin_x);
+  inner.top = float(i.y - origin_y);
+  inner.right = inner.left + i.width;
+  inner.bottom = inner.top + i.height;
+  float widths[4] = {inner.top - outer.top, outer.right - inner.right,
+                     outer.bottom - inner.bottom, inner.left - outer.left};
+  const PackedColor *colors = border.colors;
+  bool one_color = colors[0] == colors[1] && colors[0] == colors[2] &&
+                   colors[0] == colors[3];
+  if ((border.radii[0] | border.radii[1] | border.radii[2] |
+       border.radii[3]) == 0 &&
+      (one_color || (i.width > 0 && i.height > 0))) {
+    fill_square_border(
+        fb, PixelRect{o.x - origin_x, o.y - origin_y, o.width, o.height},
+        PixelRect{i.x - origin_x, i.y - origin_y, i.width, i.height}, outer,
+        widths, colors, clip);
+    return;
+  }
+  for (int c = 0; c < 4; c++) {
+    float radius = LayoutUnit::from_raw(border.radii[c]).to_float();
+    outer.rx[c] = outer.ry[c] = radius;
+    // the sides that meet at the corner
+    float horizontal = widths[c == 0 || c == 3 ? SIDE_LEFT : SIDE_RIGHT];
+    float vertical = widths[c < 2 ? SIDE_TOP : SIDE_BOTTOM];
+    inner.rx[c] = std::max(radius - horizontal, 0.0f);
+    inner.ry[c] = std::max(radius - vertical, 0.0f);
+  }
+  fill_rounded(fb, outer, inner, widths, border.colors, clip);
+}
+
+void fill_rounded_rect(Framebuffer &fb, const RoundedRectCommand &rounded,
+                       int origin_x, int origin_y, const PixelRect &clip) {
+  PixelRect box = rounded.box.rect().snapped();
+  RoundedBox outer;
+  outer.left = float(box.x - origin_x);
+  outer.top = float(box.y - origin_y);
+  outer.right = outer.left + box.width;
+  outer.bottom = outer.top + box.height;
+  for (int c = 0; c < 4; c++) {
+    outer.rx[c] = outer.ry[c] =
+        LayoutUnit::from_raw(rounded.radii[c]).to_float();
+  }
+  float widths[4] = {1, 1, 1, 1};
+  PackedColor colors[4] = {rounded.color, rounded.color, rounded.color,
+                           rounded.color};
+  fill_rounded(fb, outer, RoundedBox(), widths, colors, clip);
+}
+
+void rasterize_command(Framebuffer &fb, const CommandHeader &command,
+                       int origin_x, int origin_y, const PixelRect &clip) {
+  switch (command.op()) {
+  case DisplayOp::SOLID_COLOR: {
+    const SolidColorCommand &solid = command.as<SolidColorCommand>();
+    PixelRect box = solid.box.rect().snapped();
+    box.x -= origin_x;
+    box.y -= origin_y;
+    fill_rect(fb, box, clip, solid.color);
+  } break;
+  case DisplayOp::TEXT:
+    draw_text(fb, command.as<TextCommand>(), origin_x, origin_y, clip);
+    break;
+  case DisplayOp::BORDER:
+    draw_border(fb, command.as<BorderCommand>(), origin_x, origin_y, clip);
+    break;
+  case DisplayOp::ROUNDED_RECT:
+    fill_rounded_rect(fb, command.as<RoundedRectCommand>(), origin_x,
+                      origin_y, clip);
+    break;
+  }
+}
+
+// Paints `clip` (in framebuffer pixels) of the page at (origin_x, origin_y),
+// only the commands the index says are in there are looked at.
+void rasterize_area(const DisplayList &list, Framebuffer &fb, int origin_x,
+                    int origin_y, const PixelRect &clip) {
+  Rect view{LayoutUnit::from_px(origin_x + clip.x),
+            LayoutUnit::from_px(origin_y + clip.y),
+            LayoutUnit::from_px(clip.width), LayoutUnit::from_px(clip.height)};
+  std::vector<uint32_t> visible;
+  list.query(view, visible);
+  for (uint32_t offset : visible) {
+    rasterize_command(fb, list.at(offset), origin_x, origin_y, clip);
+  }
+}
+
+// the part of the page at (origin_x, origin_y) that fits in `fb`
+void rasterize(const DisplayList &list, Framebuffer &fb, int origin_x = 0,
+               int origin_y = 0) {
+  rasterize_area(list, fb, origin_x, origin_y,
+                 PixelRect{0, 0, fb.width, fb.height});
+}
+
+bool write_ppm(const std::string &path, const Framebuffer &fb) {
+  std::ofstream out(path, std::ios::binary);
+  out << "P6\n" << fb.width << " " << fb.height << "\n255\n";
+  std::vector<char> row(fb.width * 3);
+  for (int y = 0; y < fb.height; y++) {
+    for (int x = 0; x < fb.width; x++) {
+      uint32_t pixel = fb.row(y)[x];
+      row[x * 3] = static_cast<char>(pixel & 0xff);
+      row[x * 3 + 1] = static_cast<char>(pixel >> 8 & 0xff);
+      row[x * 3 + 2] = static_cast<char>(pixel >> 16 & 0xff);
+    }
+    out.write(row.data(), row.size());
+  }
+  return static_cast<bool>(out);
+}
+
+// Only reads what write_ppm writes (binary, 8 bit, no comments).
+bool read_ppm(const std::string &path, Framebuffer &fb) {
+  std::ifstream in(path, std::ios::binary);
+  std::string magic;
+  int width, height, max;
+  if (!(in >> magic >> width >> height >> max) || magic != "P6" ||
+      max != 255) {
+    return false;
+  }
+  in.get();
+  fb = Framebuffer(width, height);
+  std::vector<unsigned char> row(width * 3);
+  for (int y = 0; y < height; y++) {
+    if (!in.read(reinterpret_cast<char *>(row.data()), row.size())) {
+      return false;
+    }
+    for (int x = 0; x < width; x++) {
+      fb.row(y)[x] = row[x * 3] | row[x * 3 + 1] << 8 | row[x * 3 + 2] << 16 |
+                     0xff000000;
+    }
+  }
+  return true;
+}
+
+uint32_t crc32(const unsigned char *data, size_t length, uint32_t crc = 0) {
+  static uint32_t table[256];
+  if (table[1] == 0) {
+    for (uint32_t n = 0; n < 256; n++) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; k++) {
+        c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+      }
+      table[n] = c;
+    }
+  }
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++) {
+    crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+// PNG with uncompressed deflate blocks, big but needs no zlib.
+bool write_png(const std::string &path, const Framebuffer &fb) {
+  // scanlines, each with filter type 0
+  std::vector<unsigned char> raw;
+  raw.reserve((fb.width * 4 + 1) * fb.height);
+  for (int y = 0; y < fb.height; y++) {
+    raw.push_back(0);
+    for (int x = 0; x < fb.width; x++) {
+      uint32_t pixel = unpremultiply(fb.row(y)[x]);
+      for (int shift = 0; shift < 32; shift += 8) {
+        raw.push_back(static_cast<unsigned char>(pixel >> shift & 0xff));
+      }
+    }
+  }
+
+  std::vector<unsigned char> zlib = {0x78, 0x01};
+  uint32_t a = 1, b = 0;
+  for (size_t at = 0; at < raw.size() || at == 0;) {
+    size_t block = std::min<size_t>(raw.size() - at, 65535);
+    bool last = at + block == raw.size();
+    zlib.push_back(last ? 1 : 0);
+    for (uint32_t v : {uint32_t(block), uint32_t(~block & 0xffff)}) {
+      zlib.push_back(v & 0xff);
+      zlib.push_back(v >> 8 & 0xff);
+    }
+    zlib.insert(zlib.end(), raw.begin() + at, raw.begin() + at + block);
+    at += block;
+    if (last) {
+      break;
+    }
+  }
+  for (unsigned char c : raw) {
+    a = (a + c) % 65521;
+    b = (b + a) % 65521;
+  }
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    zlib.push_back((b << 16 | a) >> shift & 0xff);
+  }
+
+  std::ofstream out(path, std::ios::binary);
+  const unsigned char signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a,
+                                     '\n'};
+  out.write(reinterpret_cast<const char *>(signature), sizeof(signature));
+  auto chunk = [&](const char *type, const std::vector<unsigned char> &data) {
+    std::vector<unsigned char> body(type, type + 4);
+    body.insert(body.end(), data.begin(), data.end());
+    unsigned char header[4];
+    uint32_t length = static_cast<uint32_t>(data.size());
+    uint32_t crc = crc32(body.data(), body.size());
+    for (int i = 0; i < 4; i++) {
+      header[i] = length >> (24 - i * 8) & 0xff;
+    }
+    out.write(reinterpret_cast<const char *>(header), 4);
+    out.write(reinterpret_cast<const char *>(body.data()), body.size());
+    for (int i = 0; i < 4; i++) {
+      header[i] = crc >> (24 - i * 8) & 0xff;
+    }
+    out.write(reinterpret_cast<const char *>(header), 4);
+  };
+  std::vector<unsigned char> ihdr;
+  for (uint32_t v : {uint32_t(fb.width), uint32_t(fb.height)}) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      ihdr.push_back(v >> shift & 0xff);
+    }
+  }
+  // 8 bits per channel, RGBA, deflate, no filter, no interlace
+  ihdr.insert(ihdr.end(), {8, 6, 0, 0, 0});
+  chunk("IHDR", ihdr);
+  chunk("IDAT", zlib);
+  chunk("IEND", {});
+  return static_cast<bool>(out);
+}
+
+// pixels where any channel differs by more than `tolerance`, for golden
+// image tests; different sizes count as all different
+size_t count_different_pixels(const Framebuffer &a, const Framebuffer &b,
+                              int tolerance = 0) {
+  if (a.width != b.width || a.height != b.height) {
+    return std::max(a.pixels.size(), b.pixels.size());
+  }
+  size_t different = 0;
+  for (size_t i = 0; i < a.pixels.size(); i++) {
+    for (int shift = 0; shift < 24; shift += 8) {
+      int ca = a.pixels[i] >> shift & 0xff;
+      int cb = b.pixels[i] >> shift & 0xff;
+      if (std::abs(ca - cb) > tolerance) {
+        different++;
+        break;
+      }
+    }
+  }
+  return different;
+}
+
+#endif
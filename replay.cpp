@@ -0,0 +1,199 @@
+// Paints a display list recorded with `screenshot.exe --record` again and
+// again, through the software rasterizer and both ImGui painters, without
+// parsing or laying out anything. Each backend scrolls through the whole
+// page a screen at a time; then the same for the commands of every type
+// on their own, which is how long each type takes.
+//
+//   make replay
+//   ./replay.exe page.dl [--frames n] [--viewport width height]
+//
+// ImGui runs headless like imgui/examples/example_null, its draw data is
+// built but nothing is rendered.
+
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+
+#include "display_list.cpp"
+#include "imgui_painter.cpp"
+#include "raster.cpp"
+
+const PackedColor WHITE = 0xffffffff;
+
+const DisplayOp ALL_OPS[] = {DisplayOp::SOLID_COLOR, DisplayOp::TEXT,
+                             DisplayOp::BORDER, DisplayOp::ROUNDED_RECT};
+
+const char *op_name(DisplayOp op) {
+  switch (op) {
+  case DisplayOp::SOLID_COLOR:
+    return "solid_color";
+  case DisplayOp::TEXT:
+    return "text";
+  case DisplayOp::BORDER:
+    return "border";
+  case DisplayOp::ROUNDED_RECT:
+    return "rounded_rect";
+  }
+  return "unknown";
+}
+
+// the commands of `list` with opcode `op`, in the same order
+DisplayList only(const DisplayList &list, DisplayOp op) {
+  DisplayList out;
+  size_t i = 0;
+  for (const CommandHeader &command : list) {
+    if (command.op() == op) {
+      out.push_command(command, list.item_boxes[i]);
+    }
+    i++;
+  }
+  out.build_index();
+  return out;
+}
+
+struct Replay {
+  int width = 1280, height = 720;
+  int page_height = 0;
+  int frames = 10;
+};
+
+// Something that paints the part of a list on screen, the screen showing
+// the page from `scroll` down.
+struct Backend {
+  const char *name;
+  std::function<void(const DisplayList &, int scroll)> paint;
+};
+
+// milliseconds for painting every screen of the page `frames` times
+double replay(const Replay &r, const Backend &backend,
+              const DisplayList &list) {
+  auto start = std::chrono::steady_clock::now();
+  for (int frame = 0; frame < r.frames; frame++) {
+    for (int scroll = 0; scroll < r.page_height; scroll += r.height) {
+      backend.paint(list, scroll);
+    }
+  }
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+// a frame with one window covering the display, `paint` gets its draw
+// list and the screen position of the page origin
+template <typename F> void imgui_frame(const Replay &r, int scroll, F paint) {
+  ImGuiIO &io = ImGui::GetIO();
+  io.DisplaySize = ImVec2(static_cast<float>(r.width),
+                          static_cast<float>(r.height));
+  io.DeltaTime = 1.0f / 60.0f;
+  ImGui::NewFrame();
+  ImGui::SetNextWindowPos(ImVec2(0, 0));
+  ImGui::SetNextWindowSize(io.DisplaySize);
+  ImGui::Begin("page", nullptr,
+               ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoBackground);
+  paint(ImGui::GetWindowDrawList(),
+        ImVec2(0, static_cast<float>(-scroll)));
+  ImGui::End();
+  ImGui::Render();
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2) {
+    std::cout << "usage: " << argv[0]
+              << " page.dl [--frames n] [--viewport width height]"
+              << std::endl;
+    return 2;
+  }
+  Replay r;
+  for (int i = 2; i < argc; i++) {
+    if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+      r.frames = std::max(std::atoi(argv[++i]), 1);
+    } else if (std::strcmp(argv[i], "--viewport") == 0 && i + 2 < argc) {
+      r.width = std::max(std::atoi(argv[++i]), 1);
+      r.height = std::max(std::atoi(argv[++i]), 1);
+    }
+  }
+
+  DisplayList list;
+  LayoutUnit page_width, page_height;
+  if (!read_display_list(argv[1], list, page_width, page_height)) {
+    std::cout << "Failed to read " << argv[1] << std::endl;
+    return 1;
+  }
+  r.page_height = std::max(page_height.round(), 1);
+  int screens = (r.page_height + r.height - 1) / r.height;
+  std::cout << argv[1] << ": " << list.size() << " commands, "
+            << list.size_in_bytes() << " bytes, page " << page_width.round()
+            << "x" << r.page_height << ", " << screens << " screens of "
+            << r.width << "x" << r.height << ", " << r.frames << " times"
+            << std::endl;
+
+  IMGUI_CHECKVERSION();
+  ImGui::CreateContext();
+  ImGui::GetIO().BackendFlags |= ImGuiBackendFlags_RendererHasVtxOffset;
+  ImGui::GetIO().IniFilename = nullptr;
+  unsigned char *tex_pixels = nullptr;
+  int tex_w, tex_h;
+  ImGui::GetIO().Fonts->GetTexDataAsRGBA32(&tex_pixels, &tex_w, &tex_h);
+
+  Framebuffer fb(r.width, r.height);
+  std::vector<uint32_t> offsets;
+  ImGuiPainter painter;
+  auto in_view = [&](const DisplayList &l, int scroll) {
+    l.query(Rect{LayoutUnit(), LayoutUnit::from_px(scroll),
+                 LayoutUnit::from_px(r.width), LayoutUnit::from_px(r.height)},
+            offsets);
+  };
+  std::vector<Backend> backends = {
+      {"raster",
+       [&](const DisplayList &l, int scroll) {
+         fb.clear(WHITE);
+         rasterize(l, fb, 0, scroll);
+       }},
+      {"imgui",
+       [&](const DisplayList &l, int scroll) {
+         in_view(l, scroll);
+         imgui_frame(r, scroll, [&](ImDrawList *draw_list, ImVec2 origin) {
+           for (uint32_t offset : offsets) {
+             paint_item(draw_list, l.at(offset), origin);
+           }
+         });
+       }},
+      {"imgui_batched", [&](const DisplayList &l, int scroll) {
+         in_view(l, scroll);
+         imgui_frame(r, scroll, [&](ImDrawList *draw_list, ImVec2 origin) {
+           painter.paint(l, offsets, draw_list, origin);
+         });
+       }}};
+
+  std::vector<DisplayList> per_op;
+  for (DisplayOp op : ALL_OPS) {
+    per_op.push_back(only(list, op));
+  }
+
+  // ms per frame, a frame being every screen of the page once
+  std::cout << std::left << std::setw(16) << "ms per page" << std::setw(10)
+            << "commands";
+  for (const Backend &backend : backends) {
+    std::cout << std::setw(16) << backend.name;
+  }
+  std::cout << std::endl;
+  auto row = [&](const char *name, const DisplayList &l) {
+    std::cout << std::setw(16) << name << std::setw(10) << l.size();
+    for (const Backend &backend : backends) {
+      // once to warm up caches and glyphs
+      backend.paint(l, 0);
+      double ms = replay(r, backend, l) / r.frames;
+      std::cout << std::setw(16) << ms;
+    }
+    std::cout << std::endl;
+  };
+  row("all", list);
+  for (size_t i = 0; i < per_op.size(); i++) {
+    if (!per_op[i].empty()) {
+      row(op_name(ALL_OPS[i]), per_op[i]);
+    }
+  }
+
+  ImGui::DestroyContext();
+  return 0;
+}
@@ -0,0 +1,96 @@
+// Renders a page with the software rasterizer, no window or GL needed.
+//
+//   make screenshot
+//   ./screenshot.exe page.html page.css out.png [width height]
+//   ./screenshot.exe page.html page.css out.ppm --golden expected.ppm
+//   ./screenshot.exe page.html page.css out.png --record page.dl
+//
+// With --golden the result is compared to an earlier screenshot and the
+// exit code says whether they match. --record saves the display list of
+// the whole page for replay.exe.
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "css_parser.cpp"
+#include "html_parser.cpp"
+#include "layout.cpp"
+#include "painter.cpp"
+#include "raster.cpp"
+
+std::string read_file(const std::string &path) {
+  std::ifstream file(path);
+  std::stringstream buffer;
+  buffer << file.rdbuf();
+  return buffer.str();
+}
+
+bool ends_with(const std::string &s, const std::string &suffix) {
+  return s.size() >= suffix.size() &&
+         s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 4) {
+    std::cout << "usage: " << argv[0]
+              << " page.html page.css out.(png|ppm) [width height]"
+                 " [--golden expected.ppm] [--record page.dl]"
+              << std::endl;
+    return 2;
+  }
+  std::string out_path = argv[3];
+  int width = 1280, height = 720;
+  std::string golden, record;
+  for (int i = 4; i < argc; i++) {
+    if (std::strcmp(argv[i], "--golden") == 0 && i + 1 < argc) {
+      golden = argv[++i];
+    } else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      record = argv[++i];
+    } else if (i + 1 < argc) {
+      width = std::atoi(argv[i]);
+      height = std::atoi(argv[++i]);
+    }
+  }
+
+  Node *root = parse_html(read_file(argv[1]));
+  SharedStyleSheet sheet = load_stylesheet(read_file(argv[2]));
+  StyledNode styled_root = style_tree(root, *sheet);
+  LayoutTree layout_tree = build_layout_tree(styled_root);
+  Dimensions viewport;
+  viewport.content.width = LayoutUnit::from_px(width);
+  layout_tree.viewport = viewport.content;
+  layout_tree.viewport.height = LayoutUnit::from_px(height);
+  layout_tree.layout(viewport);
+  DisplayList display_list = build_display_list(layout_tree);
+  if (!record.empty() &&
+      !write_display_list(
+          record, display_list, viewport.content.width,
+          layout_tree[layout_tree.root].dims.margin_box().height)) {
+    std::cout << "Failed to write " << record << std::endl;
+    return 1;
+  }
+
+  Framebuffer fb(width, height);
+  fb.clear(pack_color(Color{255, 255, 255, 255}));
+  rasterize(display_list, fb);
+
+  bool written = ends_with(out_path, ".ppm") ? write_ppm(out_path, fb)
+                                             : write_png(out_path, fb);
+  if (!written) {
+    std::cout << "Failed to write " << out_path << std::endl;
+    return 1;
+  }
+  if (golden.empty()) {
+    return 0;
+  }
+
+  Framebuffer expected;
+  if (!read_ppm(golden, expected)) {
+    std::cout << "Failed to read " << golden << std::endl;
+    return 1;
+  }
+  size_t different = count_different_pixels(fb, expected);
+  std::cout << different << " pixels differ from " << golden << std::endl;
+  return different == 0 ? 0 : 1;
+}
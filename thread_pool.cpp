@@ -0,0 +1,163 @@
+#ifndef THREAD_POOL_CPP
+#define THREAD_POOL_CPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work stealing pool. Every thread owns a deque, it pushes and pops its own
+// work at the back and steals from the front of the others once it runs
+// dry. Slot 0 is used by threads outside the pool (the one waiting on a
+// TaskGroup), which help with the work instead of blocking.
+struct ThreadPool {
+  typedef std::function<void()> Task;
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<std::unique_ptr<Queue>> queues;
+  std::vector<std::thread> threads;
+  std::atomic<bool> stopping{false};
+  std::atomic<size_t> queued{0};
+  std::mutex sleep_mutex;
+  std::condition_variable wake;
+
+  // num_threads includes the calling thread
+  explicit ThreadPool(
+      size_t num_threads = std::thread::hardware_concurrency()) {
+    if (num_threads == 0) {
+      num_threads = 1;
+    }
+    for (size_t i = 0; i < num_threads; i++) {
+      this->queues.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 1; i < num_threads; i++) {
+      this->threads.emplace_back([this, i] { this->worker_loop(i); });
+    }
+  }
+
+  ~ThreadPool() {
+    this->stopping = true;
+    this->wake.notify_all();
+    for (auto &thread : this->threads) {
+      thread.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  size_t size() const { return this->queues.size(); }
+
+  // the pool the calling thread works for and its queue in that pool
+  struct Worker {
+    const ThreadPool *pool = nullptr;
+    size_t slot = 0;
+  };
+
+  static Worker &current_worker() {
+    static thread_local Worker worker;
+    return worker;
+  }
+
+  // threads that are not our workers, including those of other pools, share
+  // slot 0
+  size_t current_slot() const {
+    const Worker &worker = current_worker();
+    return worker.pool == this ? worker.slot : 0;
+  }
+
+  void spawn(Task task) {
+    Queue &queue = *this->queues[current_slot()];
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.tasks.push_back(std::move(task));
+    }
+    this->queued++;
+    this->wake.notify_one();
+  }
+
+  bool pop(Task &task) {
+    size_t slot = current_slot();
+    {
+      Queue &own = *this->queues[slot];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (!own.tasks.empty()) {
+        task = std::move(own.tasks.back());
+        own.tasks.pop_back();
+        this->queued--;
+        return true;
+      }
+    }
+    for (size_t i = 1; i < this->queues.size(); i++) {
+      Queue &victim = *this->queues[(slot + i) % this->queues.size()];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.tasks.empty()) {
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        this->queued--;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool run_one() {
+    Task task;
+    if (!this->pop(task)) {
+      return false;
+    }
+    task();
+    return true;
+  }
+
+  void worker_loop(size_t slot) {
+    current_worker() = Worker{this, slot};
+    while (!this->stopping) {
+      if (this->run_one()) {
+        continue;
+      }
+      std::unique_lock<std::mutex> lock(this->sleep_mutex);
+      // the timeout covers a spawn racing with us going to sleep
+      this->wake.wait_for(lock, std::chrono::milliseconds(1), [this] {
+        return this->stopping || this->queued > 0;
+      });
+    }
+  }
+};
+
+// Fork/join on top of the pool, wait() runs queued tasks until all of the
+// group's tasks are done.
+struct TaskGroup {
+  ThreadPool &pool;
+  std::atomic<size_t> remaining{0};
+
+  explicit TaskGroup(ThreadPool &p) : pool(p) {}
+  ~TaskGroup() { this->wait(); }
+
+  void run(ThreadPool::Task task) {
+    this->remaining++;
+    this->pool.spawn([this, task = std::move(task)] {
+      task();
+      this->remaining--;
+    });
+  }
+
+  void wait() {
+    while (this->remaining > 0) {
+      if (!this->pool.run_one()) {
+        std::this_thread::yield();
+      }
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef TILE_RASTER_CPP
+#define TILE_RASTER_CPP
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "raster.cpp"
+#include "thread_pool.cpp"
+
+// Tiles are squares of the page, not of the screen, so scrolling keeps
+// hitting the same tiles and only has to copy them to a new place.
+const int TILE_SIZE = 256;
+
+int floor_div(int a, int b) {
+  return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+struct TileKey {
+  // in tiles from the page origin
+  int x, y;
+  // every command that touches the tile, and the background
+  uint64_t content;
+
+  bool operator==(const TileKey &other) const {
+    return this->x == other.x && this->y == other.y &&
+           this->content == other.content;
+  }
+};
+
+struct TileKeyHash {
+  size_t operator()(const TileKey &key) const {
+    return hash_combine(hash_combine(key.content, key.x), key.y);
+  }
+};
+
+struct Tile {
+  Framebuffer pixels{TILE_SIZE, TILE_SIZE};
+  uint64_t last_used = 0;
+};
+
+// Tiles from earlier frames. A tile whose commands did not change hashes
+// to the same key and is reused as is.
+struct TileCache {
+  std::unordered_map<TileKey, std::unique_ptr<Tile>, TileKeyHash> tiles;
+  // 256 tiles are 64MB, a bit more than two 4K screens
+  size_t capacity = 256;
+  uint64_t frame = 0;
+
+  // drops the least recently used tiles, never the ones of this frame
+  void evict() {
+    if (this->tiles.size() <= this->capacity) {
+      return;
+    }
+    std::vector<uint64_t> ages;
+    for (auto &entry : this->tiles) {
+      ages.push_back(entry.second->last_used);
+    }
+    size_t excess = this->tiles.size() - this->capacity;
+    std::nth_element(ages.begin(), ages.begin() + excess - 1, ages.end());
+    uint64_t cutoff = std::min(ages[excess - 1], this->frame - 1);
+    for (auto it = this->tiles.begin(); it != this->tiles.end();) {
+      if (it->second->last_used <= cutoff) {
+        it = this->tiles.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+};
+
+struct TileStats {
+  size_t tiles = 0;
+  size_t rastered = 0;
+  size_t reused = 0;
+};
+
+uint64_t hash_command(const CommandHeader &command, uint64_t seed) {
+  const uint32_t *words = &command.bits;
+  for (uint32_t i = 0; i < command.size() / sizeof(uint32_t); i++) {
+    seed = hash_combine(seed, words[i]);
+  }
+  return seed;
+}
+
+// Splits the screen into tiles, bins the commands per tile and rasterizes
+// the tiles that are not in the cache on the pool.
+struct TileRasterizer {
+  // null rasterizes on the calling thread
+  ThreadPool *pool = nullptr;
+  TileCache cache;
+  // counters for the last frame
+  TileStats stats;
+
+  // scratch, kept between frames
+  std::vector<uint32_t> visible;
+  std::vector<std::vector<uint32_t>> bins;
+
+  // Same result as ::rasterize on a framebuffer cleared to `background`.
+  void rasterize(const DisplayList &list, Framebuffer &fb, int origin_x,
+                 int origin_y, PackedColor background) {
+    this->stats = TileStats();
+    this->cache.frame++;
+
+    int first_x = floor_div(origin_x, TILE_SIZE);
+    int first_y = floor_div(origin_y, TILE_SIZE);
+    int columns = floor_div(origin_x + fb.width - 1, TILE_SIZE) - first_x + 1;
+    int rows = floor_div(origin_y + fb.height - 1, TILE_SIZE) - first_y + 1;
+    this->bins.resize(columns * rows);
+    for (std::vector<uint32_t> &bin : this->bins) {
+      bin.clear();
+    }
+
+    // everything that can paint into one of the tiles, in paint order
+    Rect area{LayoutUnit::from_px(first_x * TILE_SIZE),
+              LayoutUnit::from_px(first_y * TILE_SIZE),
+              LayoutUnit::from_px(columns * TILE_SIZE),
+              LayoutUnit::from_px(rows * TILE_SIZE)};
+    list.query(area, this->visible);
+    for (uint32_t offset : this->visible) {
+      PixelRect box = paint_bounds(list.at(offset)).rect().snapped();
+      int left = std::max(floor_div(box.x, TILE_SIZE), first_x);
+      int top = std::max(floor_div(box.y, TILE_SIZE), first_y);
+      int right = std::min(
+          floor_div(box.x + std::max(box.width, 1) - 1, TILE_SIZE),
+          first_x + columns - 1);
+      int bottom = std::min(
+          floor_div(box.y + std::max(box.height, 1) - 1, TILE_SIZE),
+          first_y + rows - 1);
+      for (int y = top; y <= bottom; y++) {
+        for (int x = left; x <= right; x++) {
+          size_t bin = (y - first_y) * columns + (x - first_x);
+          this->bins[bin].push_back(offset);
+        }
+      }
+    }
+
+    std::vector<Tile *> tiles(this->bins.size());
+    std::vector<bool> stale(this->bins.size());
+    for (int row = 0; row < rows; row++) {
+      for (int column = 0; column < columns; column++) {
+        size_t i = row * columns + column;
+        uint64_t content = background;
+        for (uint32_t offset : this->bins[i]) {
+          content = hash_command(list.at(offset), content);
+        }
+        TileKey key{first_x + column, first_y + row, content};
+        std::unique_ptr<Tile> &tile = this->cache.tiles[key];
+        stale[i] = !tile;
+        if (!tile) {
+          tile = std::make_unique<Tile>();
+        }
+        tile->last_used = this->cache.frame;
+        tiles[i] = tile.get();
+        this->stats.tiles++;
+        (stale[i] ? this->stats.rastered : this->stats.reused)++;
+      }
+    }
+
+    // tiles write to their own pixels and their own part of `fb`
+    auto draw = [&](size_t i) {
+      int tile_x = (first_x + static_cast<int>(i) % columns) * TILE_SIZE;
+      int tile_y = (first_y + static_cast<int>(i) / columns) * TILE_SIZE;
+      Framebuffer &pixels = tiles[i]->pixels;
+      if (stale[i]) {
+        pixels.clear(background);
+        PixelRect clip{0, 0, TILE_SIZE, TILE_SIZE};
+        for (uint32_t offset : this->bins[i]) {
+          rasterize_command(pixels, list.at(offset), tile_x, tile_y, clip);
+        }
+      }
+      PixelRect target =
+          intersect(PixelRect{tile_x - origin_x, tile_y - origin_y, TILE_SIZE,
+                              TILE_SIZE},
+                    PixelRect{0, 0, fb.width, fb.height});
+      for (int y = target.y; y < target.y + target.height; y++) {
+        const uint32_t *src = pixels.row(y + origin_y - tile_y) +
+                              (target.x + origin_x - tile_x);
+        std::copy(src, src + target.width, fb.row(y) + target.x);
+      }
+    };
+    if (this->pool == nullptr) {
+      for (size_t i = 0; i < tiles.size(); i++) {
+        draw(i);
+      }
+    } else {
+      TaskGroup group(*this->pool);
+      for (size_t i = 0; i < tiles.size(); i++) {
+        group.run([&draw, i] { draw(i); });
+      }
+      group.wait();
+    }
+    this->cache.evict();
+  }
+};
+
+#endif